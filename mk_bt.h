@@ -32,6 +32,176 @@
  * to be a function that returns true when one element compares less then the
  * other.
  *
+ * When elements are large and ordered by only part of them, define `BT_KEY` to
+ * the type of that part and `BT_KEY_OF(elem)` to get a pointer to it from a
+ * pointer to an element. Then `BT_CMP` compares keys, and lookups, seeks and
+ * removals take just a key:
+ *
+ * ```c
+ * #define BT_ELEM          struct user
+ * #define BT_KEY           uint64_t
+ * #define BT_KEY_OF(elem)  (&(elem)->id)
+ * ```
+ *
+ * If `BT_CMP` is expensive (strings, composite keys), define
+ * `BT_NORMALIZE(key)` to map a key to a `BT_NORM_TYPE` integer such that
+ * whenever `BT_NORMALIZE(a) < BT_NORMALIZE(b)`, `a` compares less than `b`. For
+ * example the first 8 bytes of a string in big endian. It is stored next to
+ * every element, so searches compare integers and only call `BT_CMP` on ties.
+ *
+ * For trees larger than the last level cache, define `BT_PREFETCH` to have
+ * lookups prefetch every cache line of a node as soon as they know they'll
+ * descend into it, the root included. The lines a search of a node touches
+ * then miss the cache all at once, instead of one after another.
+ *
+ * Composite, signed or floating point keys can instead be encoded into bytes
+ * that compare with `memcmp` as the keys do, with `mk_bt_key.h`. Define
+ * `BT_KEY_BYTES` to their width, and `BT_KEY` defaults to `struct bt_key`, an
+ * array of that many bytes, `BT_ELEM` to `BT_KEY` and `BT_CMP` to a comparison
+ * of 8 bytes at a time, as big endian integers. A `BT_KEY` defined by the user
+ * must start with the encoded bytes.
+ *
+ * When most lookups are for keys that aren't in the tree, define `BT_BLOOM` to
+ * keep a blocked bloom filter of the keys. `bt_lookup` tests it before
+ * descending, `bt_insert` adds to it and `bt_bulk_load` rebuilds it. Removals
+ * don't clear it, call `bt_bloom_rebuild` after many of them. Keys are hashed
+ * with `BT_HASH`, which by default hashes the bytes of the key, so it must be
+ * defined for keys with padding or pointers.
+ *
+ * For skewed lookups, define `BT_CACHE` to keep a direct mapped cache, indexed
+ * by `BT_HASH` of the key, of where the last looked up elements are. A hit
+ * skips the descent, but still compares the key with the cached slot since
+ * elements move within and between nodes. Removals, the only operation that
+ * frees nodes, invalidate the whole cache. Lookups write to the cache even
+ * though they take a `const` tree, so concurrent lookups on the same tree need
+ * a lock that excludes each other, not a shared one. It can't be used with
+ * `BT_RW`, `BT_BLINK`, `BT_EPOCH` or `BT_MVCC`.
+ *
+ * For integer keys that rarely change, define `BT_LEARNED` to keep a piecewise
+ * linear model (a spline with a bounded error) from keys to leaves, built from
+ * the separators between consecutive leaves. Lookups use it to jump straight
+ * to a leaf after searching only a small window of separators. `BT_LEARNED_POS`
+ * must be monotonic with `BT_CMP`. Leaves split by insertions are flagged, so
+ * lookups that miss in them fall back to a normal descent, and removals
+ * disable the model. It is rebuilt by `bt_bulk_load` and once the tree changed
+ * `size / BT_LEARNED_REFRESH` times since it was last built.
+ *
+ * For the fastest point lookups, define `BT_HASH_INDEX` to keep an open
+ * addressing hash table, by `BT_HASH` of the key, of the node holding each
+ * element. Lookups (hits and misses) probe it and search a single node instead
+ * of descending, while ordered access still uses the tree. Every move of an
+ * element to another node (splits, rotations and merges) updates its slot, so
+ * each node keeps a pointer to the table.
+ *
+ * For integer keys, define `BT_RADIX` to also generate `struct bt_radix`, a
+ * directory of `2^bits` trees indexed by the top `bits` bits of
+ * `BT_RADIX_KEY(key)` (below the highest bit set in any key), which replaces
+ * the top levels of a single tree. Partitions are regular trees, in key order,
+ * so they can be worked on independently. The directory doubles once there
+ * are `BT_RADIX_FILL` elements per partition, and the partitions are merged
+ * when a larger key widens the range they cover. `BT_RADIX_KEY` must preserve
+ * the order of the keys, which the default cast doesn't for negative ones: it
+ * must be defined for signed keys, including the default `int` elements.
+ *
+ * Define `BT_SHARDS` to also generate `struct bt_shards`, a thread safe
+ * container of trees that each hold a range of keys behind their own mutex,
+ * so writers to different ranges don't contend. Shards that grow past twice
+ * their fair share are split, and neighbours that shrink are merged. It needs
+ * POSIX threads.
+ *
+ * Define `BT_RW` to also generate `struct bt_rw`, a thread safe wrapper of a
+ * single tree. Readers take one of `BT_RW_SLOTS` read locks, picked by thread,
+ * so they don't share a cache line. Writers buffer up to `BT_RW_BATCH`
+ * operations per thread, and then one of them (the combiner) applies every
+ * buffer that was published, sorted by key, holding all the read locks. It
+ * needs POSIX threads, and can't be used with `BT_CACHE`, since lookups write
+ * to the cache.
+ *
+ * Define `BT_BLINK` to also generate `struct bt_blink`, a concurrent B-link
+ * tree (Lehman and Yao). Elements are only in the leaves, and every node has a
+ * link to its right sibling and a high key, the upper bound of its keys. A
+ * split moves half of a node to a new sibling before its parent knows about
+ * it, so an operation that lands on a node whose high key is not greater than
+ * its key moves right instead of retrying. Writers latch one node at a time,
+ * and readers take no latches: they check that the version of each node
+ * didn't change while they read it, so keys must be safe to compare even if
+ * they were torn by a concurrent write (plain values, not pointers). Nodes
+ * aren't merged, and are only freed with the tree. It needs POSIX threads.
+ *
+ * Define `BT_EPOCH` to also generate `struct bt_epoch`, epoch based
+ * reclamation for memory that concurrent readers may still be using once it's
+ * unlinked. Threads pin the current epoch while they read, and retire what
+ * they unlink instead of freeing it. Retired pointers are freed, in batches of
+ * `BT_EPOCH_BATCH`, once every pinned thread has seen the epoch advance twice.
+ * It needs POSIX threads.
+ *
+ * Define `BT_MVCC` to also generate `struct bt_mvcc`, a `bt_blink` whose leaves
+ * point to a chain of versions of each element, newest first, tagged with the
+ * timestamp of the write. Readers take a snapshot and see the elements as of
+ * its timestamp while writers add versions, and `bt_mvcc_gc` frees the
+ * versions no snapshot can see anymore, through a `bt_epoch`. It implies
+ * `BT_BLINK` and `BT_EPOCH`, and the tree must only be written to through the
+ * `bt_mvcc_*` functions.
+ *
+ * Define `BT_TXN` to also generate `struct bt_txn`, a batch of insertions and
+ * removals staged in a buffer, sorted when read, and applied to the tree all at
+ * once on commit. Lookups through the transaction see the staged changes over
+ * the tree. On commit, the changes that fall in the same leaf are applied with
+ * a single descent, until one splits it, and removals that would need a
+ * rebalance go through `bt_remove`.
+ *
+ * Define `BT_AUGMENT` to keep in each node `aug`, the `BT_AUG_MERGE` of
+ * `BT_AUG_OF(elem)` over its subtree. `BT_AUG_MERGE` must be associative and
+ * commutative. Every operation that changes a node keeps it up to date.
+ *
+ * Define `BT_INTERVAL` for an interval tree, where each element spans from its
+ * key to `BT_INTERVAL_END(elem)` (a `const BT_KEY*`), and `aug` is the largest
+ * end in the subtree. `bt_interval_overlaps` skips the subtrees that end
+ * before the query. Starts must be unique, use a composite key otherwise.
+ *
+ * Define `BT_TTL` for elements that expire at `BT_TTL_EXPIRY(elem)`, and `aug`
+ * is the earliest expiry in the subtree. `bt_expire` removes a bounded number
+ * of expired elements, descending only where there are some, so sweeps can be
+ * split into slices.
+ *
+ * Define `BT_LRU` to also generate `struct bt_lru`, a cache of elements within
+ * a budget of bytes, counted with `BT_LRU_BYTES(elem)`, kept in a tree so they
+ * can be scanned in order. Each element has a reference bit in its node, and
+ * evictions follow the CLOCK algorithm, with a hand that sweeps the keys in
+ * order and evicts `BT_LRU_BATCH` elements at once.
+ *
+ * Define `BT_SLOTTED` to also generate `struct bt_slotted`, a tree of byte
+ * string keys and values of any length stored in pages of `BT_SLOTTED_PAGE`
+ * bytes, instead of behind pointers. Each page has an array of offsets sorted
+ * by key, growing from its start, and the entries growing from its end, and
+ * splits in halves of about as many bytes when an entry doesn't fit.
+ *
+ * Nodes are allocated with `BT_NODE_ALLOC(size)` and freed with
+ * `BT_NODE_FREE(node)`, `calloc` and `free` by default. Define `BT_ARENA` to
+ * allocate them from chunks of `BT_ARENA_CHUNK` bytes instead, mapped with
+ * `mmap` on 2MB boundaries and `madvise(MADV_HUGEPAGE)`, so that large trees
+ * take a TLB entry per 2MB of nodes rather than per 4kB. With
+ * `BT_ARENA_HUGETLB` chunks are first mapped from hugetlbfs. Each thread has
+ * its own arena, and keeps the nodes it frees for its next allocations, up to
+ * `2 * BT_ARENA_CACHE` of them: past that it gives `BT_ARENA_CACHE` back to a
+ * pool shared by the threads, behind a mutex, where threads that run out of
+ * freed nodes take them from before mapping a chunk. A thread that's about to
+ * exit should call `bt_arena_release`, to give the pool its freed nodes and
+ * the rest of its chunk, which would otherwise be lost. It needs POSIX threads.
+ *
+ * Define `BT_NUMA` to also generate `struct bt_numa`, a thread safe wrapper of
+ * a tree for machines with several NUMA nodes. Each node has a copy of the top
+ * `BT_NUMA_LEVELS` levels of the tree in its own memory, whose lowest level
+ * points to the nodes of the tree, and its own read lock, so lookups only
+ * cross to another node near the leaves. Writers take every lock, and the
+ * first write drops the copies: lookups use the tree until `BT_NUMA_REFRESH`
+ * lookups have run since the write, and the last of those rebuilds the copies.
+ * It implies `BT_ARENA`, whose chunks are bound to the node of the thread that
+ * maps them, so nodes are allocated on the node of the inserting thread.
+ * `BT_NUMA_NODE()` is the node of the calling thread, read with `getcpu`, and
+ * can be defined to simulate nodes. On other systems than Linux there's a
+ * single node. It needs POSIX threads.
+ *
  * All of those macros will be undefined at the end of this header file.
  *
  * In order to generate implementation and definitions in separate files. Just
@@ -44,19 +214,90 @@
  * Name                         Default                         Description
  * ----------------------------------------------------------------------------------------------------------------
  * BT_ELEM                      int                             Type of elements on the btree.
+ * BT_KEY                       BT_ELEM                         Type of the keys elements are ordered by.
+ * BT_KEY_OF(elem)              (elem)                          Pointer to the key of a `const BT_ELEM*`.
  * BT_MKID(name)                name                            Constructs a name.
  * BT_MKFN(type, name, ...)     type MKID(name)(__VA_ARGS__)    Constructs a function signature.
  * BT_FACTOR                    2                               The branching factor.
- * BT_CMP                       BT_MKID(bt_default_cmp)         The comparison function.
+ * BT_CMP                       BT_MKID(bt_default_cmp)         The comparison function (of keys).
  * BT_LESS                      -                               Compare less function.
+ * BT_LINEAR_SEARCH             -                               Search nodes linearly instead of binary search.
+ * BT_PREFETCH                  -                               Prefetch whole nodes while descending in lookups.
+ * BT_NORMALIZE(key)            -                               Order preserving integer prefix of a `const BT_KEY*`.
+ * BT_NORM_TYPE                 uint64_t                        Type returned by `BT_NORMALIZE`.
+ * BT_KEY_BYTES                 -                               Width of keys encoded with `mk_bt_key.h`.
  * BT_ELEM_FREE(elem)           <empty>                         Function to free an element of type `BT_ELEM`.
+ * BT_NODE_ALLOC(size)          calloc(1, size)                 Allocates a zeroed node.
+ * BT_NODE_FREE(node)           free(node)                      Frees a node.
+ * BT_HASH                      BT_MKID(bt_default_hash)        Hash function of a `const BT_KEY*`.
+ * BT_BLOOM                     -                               Keep a bloom filter of the keys for lookups.
+ * BT_BLOOM_BITS_PER_KEY        10                              Size of the bloom filter.
+ * BT_CACHE                     -                               Cache the location of recently looked up keys.
+ * BT_CACHE_SIZE                4096                            Number of cache entries (a power of two).
+ * BT_LEARNED                   -                               Jump to leaves with a learned model of the keys.
+ * BT_LEARNED_POS(key)          ((double)*(key))                Numeric position of a `const BT_KEY*`.
+ * BT_LEARNED_ERROR             32                              Maximum error of the model, in leaves.
+ * BT_LEARNED_REFRESH           8                               Rebuild after `size / BT_LEARNED_REFRESH` changes.
+ * BT_HASH_INDEX                -                               Keep a hash table of the node of each key.
+ * BT_RADIX                     -                               Generate `bt_radix`, trees partitioned by key bits.
+ * BT_RADIX_KEY(key)            ((uint64_t)*(key))              Order preserving integer of a `const BT_KEY*`.
+ * BT_RADIX_FILL                1024                            Elements per partition before doubling them.
+ * BT_RADIX_MAX_BITS            16                              Maximum number of bits of the directory.
+ * BT_SHARDS                    -                               Generate `bt_shards`, a thread safe sharded tree.
+ * BT_SHARDS_MIN                4096                            Shards are never split below this size.
+ * BT_RW                        -                               Generate `bt_rw`, a tree with batched writes.
+ * BT_RW_SLOTS                  64                              Number of read locks of a `bt_rw`.
+ * BT_RW_BATCH                  64                              Writes buffered by each thread of a `bt_rw`.
+ * BT_BLINK                     -                               Generate `bt_blink`, a B-link tree.
+ * BT_EPOCH                     -                               Generate `bt_epoch`, epoch based reclamation.
+ * BT_EPOCH_BATCH               64                              Retired pointers per thread between collections.
+ * BT_MVCC                      -                               Generate `bt_mvcc`, a multiversion `bt_blink`.
+ * BT_TXN                       -                               Generate `bt_txn`, batches applied on commit.
+ * BT_AUGMENT                   -                               Keep a summary of each subtree in its node.
+ * BT_AUG_TYPE                  -                               Type of the summary.
+ * BT_AUG_OF(elem)              -                               Summary of a `const BT_ELEM*`.
+ * BT_AUG_MERGE(a, b)           -                               Combines two summaries.
+ * BT_INTERVAL                  -                               Interval tree, with the maximum end as summary.
+ * BT_INTERVAL_END(elem)        -                               Pointer to the end of the interval of an element.
+ * BT_TTL                       -                               Track the earliest expiry, for `bt_expire`.
+ * BT_TTL_TYPE                  uint64_t                        Type of the expiries.
+ * BT_TTL_EXPIRY(elem)          -                               Expiry of a `const BT_ELEM*`.
+ * BT_LRU                       -                               Generate `bt_lru`, a cache with CLOCK eviction.
+ * BT_LRU_BYTES(elem)           sizeof(BT_ELEM)                 Bytes a `const BT_ELEM*` takes in a `bt_lru`.
+ * BT_LRU_BATCH                 64                              Elements evicted at once by a `bt_lru`.
+ * BT_SLOTTED                   -                               Generate `bt_slotted`, variable length entries in pages.
+ * BT_SLOTTED_PAGE              4096                            Bytes of a page of a `bt_slotted`, at most 65536.
+ * BT_ARENA                     -                               Allocate nodes from huge page backed chunks.
+ * BT_ARENA_CHUNK               (32 << 20)                      Bytes mapped at once by the arena.
+ * BT_ARENA_HUGETLB             -                               Map chunks from hugetlbfs first.
+ * BT_ARENA_CACHE               1024                            Freed nodes given back at once to the shared pool.
+ * BT_NUMA                      -                               Generate `bt_numa`, top levels copied per NUMA node.
+ * BT_NUMA_LEVELS               3                               Levels copied to each NUMA node.
+ * BT_NUMA_REFRESH              4096                            Lookups after a write before the copies are rebuilt.
+ * BT_NUMA_NODE()               BT_MKID(bt_numa_node)()         NUMA node of the calling thread.
  * BT_DECL_ONLY                 -                               If defined, will not generate implementation.
+ * BT_IMPL_ONLY                 -                               If defined, will not generate declarations.
  * BT_ITER_STACK_SIZE           32                              Iterator stack size (determines max size of tree).
  * BT_GENERATE                  -                               When set, will not include any other file.
  */
 
-#ifndef _BTREE_H_
-#define _BTREE_H_
+// There's no include guard, so the header can be included once per
+// instantiation.
+
+#ifdef BT_NUMA
+#ifndef BT_ARENA
+#define BT_ARENA
+#endif
+#endif
+
+#ifdef BT_MVCC
+#ifndef BT_BLINK
+#define BT_BLINK
+#endif
+#ifndef BT_EPOCH
+#define BT_EPOCH
+#endif
+#endif
 
 #ifndef BT_GENERATE
 
@@ -66,6 +307,21 @@
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/types.h>
+#if defined(BT_SHARDS) || defined(BT_RW) || defined(BT_BLINK) || defined(BT_EPOCH) || defined(BT_NUMA) || defined(BT_ARENA)
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+#if defined(BT_RW) || defined(BT_BLINK)
+#include <sched.h>
+#endif
+#ifdef BT_ARENA
+#include <sys/mman.h>
+#endif
+#ifdef BT_NUMA
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
 
 #else
 
@@ -78,13 +334,49 @@
 !#include <stdint.h>
 !#include <string.h>
 !#include <assert.h>
+!#include <sys/types.h>
+#if defined(BT_SHARDS) || defined(BT_RW) || defined(BT_BLINK) || defined(BT_EPOCH) || defined(BT_NUMA) || defined(BT_ARENA)
+!#include <pthread.h>
+!#include <stdatomic.h>
+#endif
+#if defined(BT_RW) || defined(BT_BLINK)
+!#include <sched.h>
+#endif
+#ifdef BT_ARENA
+!#include <sys/mman.h>
+#endif
+#ifdef BT_NUMA
+!#include <unistd.h>
+!#include <sys/syscall.h>
+#endif
 
 #endif
 
+// Negative `int` keys would be cast to the largest ones.
+#if defined(BT_RADIX) && !defined(BT_RADIX_KEY) && !defined(BT_ELEM) && !defined(BT_KEY) && !defined(BT_KEY_BYTES)
+#error "BT_RADIX needs an order preserving BT_RADIX_KEY(key) for the default signed elements"
+#endif
+
+#if defined(BT_KEY_BYTES) && !defined(BT_KEY)
+#define BT_KEY_STRUCT
+#define BT_KEY struct BT_MKID(bt_key)
+#ifndef BT_ELEM
+#define BT_ELEM BT_KEY
+#endif
+#endif
+
 #ifndef BT_ELEM
 #define BT_ELEM int
 #endif
 
+#ifndef BT_KEY
+#define BT_KEY BT_ELEM
+#endif
+
+#ifndef BT_KEY_OF
+#define BT_KEY_OF(elem) (elem)
+#endif
+
 #ifndef BT_MKID
 #define BT_MKID(name) name
 #endif
@@ -101,10 +393,242 @@
 #define BT_ELEM_FREE(elem)
 #endif
 
+#if defined(BT_NORMALIZE) && !defined(BT_NORM_TYPE)
+#define BT_NORM_TYPE uint64_t
+#endif
+
+#ifndef BT_BLOOM_BITS_PER_KEY
+#define BT_BLOOM_BITS_PER_KEY 10
+#endif
+
+#ifndef BT_CACHE_SIZE
+#define BT_CACHE_SIZE 4096
+#endif
+
+#ifndef BT_LEARNED_POS
+#define BT_LEARNED_POS(key) ((double)*(key))
+#endif
+
+#ifndef BT_LEARNED_ERROR
+#define BT_LEARNED_ERROR 32
+#endif
+
+#ifndef BT_LEARNED_REFRESH
+#define BT_LEARNED_REFRESH 8
+#endif
+
+#ifndef BT_RADIX_KEY
+#define BT_RADIX_KEY(key) ((uint64_t)*(key))
+#endif
+
+#ifndef BT_RADIX_FILL
+#define BT_RADIX_FILL 1024
+#endif
+
+#ifndef BT_RADIX_MAX_BITS
+#define BT_RADIX_MAX_BITS 16
+#endif
+
+#ifndef BT_SHARDS_MIN
+#define BT_SHARDS_MIN 4096
+#endif
+
+#ifndef BT_RW_SLOTS
+#define BT_RW_SLOTS 64
+#endif
+
+#ifndef BT_RW_BATCH
+#define BT_RW_BATCH 64
+#endif
+
+#ifndef BT_EPOCH_BATCH
+#define BT_EPOCH_BATCH 64
+#endif
+
+#ifndef BT_LRU_BYTES
+#define BT_LRU_BYTES(elem) sizeof(BT_ELEM)
+#endif
+
+#ifndef BT_LRU_BATCH
+#define BT_LRU_BATCH 64
+#endif
+
+#ifdef BT_ARENA
+#if defined(BT_NODE_ALLOC) || defined(BT_NODE_FREE)
+#error "BT_ARENA allocates the nodes, it can't be combined with BT_NODE_ALLOC or BT_NODE_FREE"
+#endif
+#define BT_NODE_ALLOC(size) BT_MKID(bt_arena_alloc)(size)
+#define BT_NODE_FREE(node)  BT_MKID(bt_arena_free)(node)
+#ifndef BT_ARENA_CHUNK
+#define BT_ARENA_CHUNK (32 << 20)
+#endif
+#ifndef BT_ARENA_CACHE
+#define BT_ARENA_CACHE 1024
+#endif
+#endif
+
+#ifdef BT_NUMA
+#ifndef BT_NUMA_LEVELS
+#define BT_NUMA_LEVELS 3
+#endif
+#ifndef BT_NUMA_REFRESH
+#define BT_NUMA_REFRESH 4096
+#endif
+#ifndef BT_NUMA_NODE
+#define BT_NUMA_NODE() BT_MKID(bt_numa_node)()
+#endif
+#endif
+
+#ifndef BT_NODE_ALLOC
+#define BT_NODE_ALLOC(size) calloc(1, size)
+#endif
+
+#ifndef BT_NODE_FREE
+#define BT_NODE_FREE(node) free(node)
+#endif
+
+#ifndef BT_ITER_STACK_SIZE
+// Allows for (2 * BT_FACTOR)^32 elements max. Even if BT_FACTOR is 1,
+// that's over 4M elements, which should be enough, if not, can always set
+// BT_ITER_STACK_SIZE to something larger.
+#define BT_ITER_STACK_SIZE 32
+#endif
+
+#ifdef BT_SLOTTED
+#ifndef BT_SLOTTED_PAGE
+#define BT_SLOTTED_PAGE 4096
+#endif
+#if BT_SLOTTED_PAGE > 65536
+#error "Offsets within a BT_SLOTTED_PAGE are 16 bits"
+#endif
+// Bytes of a page after its header.
+#define BT_SLOTTED_DATA (BT_SLOTTED_PAGE - 8 - sizeof(void*))
+// Largest key and value of an entry together, so that any page that can't
+// take one more entry splits into two that can.
+#define BT_SLOTTED_MAX (BT_SLOTTED_PAGE / 4 - 16)
+#endif
+
+#if defined(BT_RW) && defined(BT_CACHE)
+#error "BT_RW readers share the tree, but BT_CACHE lookups write to it"
+#endif
+
+#if (defined(BT_BLINK) || defined(BT_EPOCH)) && defined(BT_CACHE)
+#error "BT_CACHE lookups write to the tree, they can't run concurrently with other readers"
+#endif
+
+#ifdef BT_INTERVAL
+#ifdef BT_AUGMENT
+#error "BT_INTERVAL augments the tree with the maximum end, it can't have another BT_AUGMENT"
+#endif
+#ifndef BT_INTERVAL_END
+#error "BT_INTERVAL needs BT_INTERVAL_END(elem)"
+#endif
+#define BT_AUGMENT
+#define BT_AUG_TYPE         BT_KEY
+#define BT_AUG_OF(elem)     (*BT_INTERVAL_END(elem))
+#define BT_AUG_MERGE(a, b)  (BT_CMP(&(a), &(b)) < 0 ? (b) : (a))
+#endif
+
+#ifdef BT_TTL
+#if defined(BT_AUGMENT) || defined(BT_INTERVAL)
+#error "BT_TTL augments the tree with the minimum expiry, it can't have another BT_AUGMENT"
+#endif
+#ifndef BT_TTL_EXPIRY
+#error "BT_TTL needs BT_TTL_EXPIRY(elem)"
+#endif
+#ifndef BT_TTL_TYPE
+#define BT_TTL_TYPE uint64_t
+#endif
+#define BT_AUGMENT
+#define BT_AUG_TYPE         BT_TTL_TYPE
+#define BT_AUG_OF(elem)     ((BT_TTL_TYPE)BT_TTL_EXPIRY(elem))
+#define BT_AUG_MERGE(a, b)  ((b) < (a) ? (b) : (a))
+#endif
+
+#ifndef BT_IMPL_ONLY
+
+#ifdef BT_KEY_STRUCT
+// A key encoded with `mk_bt_key.h`.
+struct BT_MKID(bt_key)
+{
+    unsigned char bytes[BT_KEY_BYTES];
+};
+#endif
+
+#ifdef BT_CACHE
+// Slot of an element that was looked up. Only valid while `epoch` matches the
+// tree's `cache_epoch`, after that `node` may have been freed.
+struct BT_MKID(bt_cache_entry)
+{
+    struct BT_MKID(bnode)* node;
+    uint32_t i;
+    uint32_t epoch;
+};
+#endif
+
+#ifdef BT_HASH_INDEX
+// Slot of the hash index, empty if `node` is `NULL`.
+struct BT_MKID(bt_hindex_slot)
+{
+    uint64_t hash;
+    struct BT_MKID(bnode)* node;
+};
+
+// Linear probing table of `mask + 1` slots, one per element, at most half full.
+struct BT_MKID(bt_hindex)
+{
+    size_t mask;
+    size_t count;
+    struct BT_MKID(bt_hindex_slot)* slots;
+};
+#endif
+
+#ifdef BT_LEARNED
+// Point where the spline of the learned model changes slope.
+struct BT_MKID(bt_knot)
+{
+    double x;
+    double y;
+};
+
+// Model from keys to the index of the leaf that holds them. There's exactly
+// one separator in an inner node between two consecutive leaves, copies of
+// those (`m - 1` of them) are what the model is built from.
+struct BT_MKID(bt_learned)
+{
+    bool valid;
+    size_t m;
+    struct BT_MKID(bnode)** leaves;
+    BT_KEY* fences;
+    size_t knots;
+    struct BT_MKID(bt_knot)* knot;
+    // Insertions and removals since the model was built.
+    size_t changes;
+};
+#endif
+
 struct BT_MKID(bt)
 {
     struct BT_MKID(bnode)* root;
     size_t size;
+#ifdef BT_BLOOM
+    // Blocked bloom filter of the keys in the tree, with `bloom_blocks` blocks
+    // of 8 words (one cache line). May have false positives for removed keys.
+    uint64_t* bloom;
+    size_t bloom_blocks;
+#endif
+#ifdef BT_CACHE
+    // `BT_CACHE_SIZE` entries, indexed by the hash of the key.
+    struct BT_MKID(bt_cache_entry)* cache;
+    uint32_t cache_epoch;
+#endif
+#ifdef BT_LEARNED
+    struct BT_MKID(bt_learned) learned;
+#endif
+#ifdef BT_HASH_INDEX
+    // Allocated, since nodes point to it and trees are passed by value.
+    struct BT_MKID(bt_hindex)* hindex;
+#endif
 };
 
 struct BT_MKID(bnode)
@@ -112,35 +636,87 @@ struct BT_MKID(bnode)
     uint32_t n;
     // We allocate one more child and element in order to facilitate the split operation.
     BT_ELEM elems[2 * BT_FACTOR + 1];
+#ifdef BT_NORMALIZE
+    // `BT_NORMALIZE` of the key of each element.
+    BT_NORM_TYPE norms[2 * BT_FACTOR + 1];
+#endif
+#ifdef BT_LEARNED
+    // Set when the node is split, so it may not hold every key the learned
+    // model sends to it anymore.
+    bool dirty;
+#endif
+#ifdef BT_HASH_INDEX
+    struct BT_MKID(bt_hindex)* hindex;
+#endif
+#ifdef BT_AUGMENT
+    // `BT_AUG_MERGE` of `BT_AUG_OF` of every element in the subtree.
+    BT_AUG_TYPE aug;
+#endif
+#ifdef BT_LRU
+    // Reference bit of each element, set when it's put or looked up through
+    // a `bt_lru` and cleared by the clock hand.
+    bool used[2 * BT_FACTOR + 1];
+#endif
     struct BT_MKID(bnode)* children[2 * BT_FACTOR + 2];
 };
 
+struct BT_MKID(bt_iter_frame) {
+    size_t i;
+    struct BT_MKID(bnode)* node;
+};
+
+// In-Order Depth First Search iterator
+struct BT_MKID(bt_iter_dfs)
+{
+    size_t top;
+    struct BT_MKID( bt_iter_frame ) stack[BT_ITER_STACK_SIZE];
+};
+
 // Declarations
 
-BT_MKFN(int, bt_default_cmp, const BT_ELEM* a, const BT_ELEM* b);
+BT_MKFN(int, bt_default_cmp, const BT_KEY* a, const BT_KEY* b);
+BT_MKFN(uint64_t, bt_default_hash, const BT_KEY* key);
 
 BT_MKFN(struct BT_MKID(bt), bt_mk,);
 BT_MKFN(void, bt_node_free, struct BT_MKID(bnode)* node);
 BT_MKFN(void, bt_free, struct BT_MKID(bt) bt);
 
-// Binary searches for an element within a single node. If the element is found,
-// return the index to that element. If it is not, return the negative of the
-// index where the element would be inserted to maintain ordering minus one. So,
-// if the element wasn't found because it is too small, -1 would be returned.
-BT_MKFN(ssize_t, bt_node_bsearch, const struct BT_MKID(bnode)* node, const BT_ELEM* elem);
+// Same as `bt_node_free` and `bt_free`, but without freeing the elements, for
+// when they were moved somewhere else.
+BT_MKFN(void, bt_node_release, struct BT_MKID(bnode)* node);
+BT_MKFN(void, bt_release, struct BT_MKID(bt) bt);
+
+// Copies every element to `out`, which must have room for `bt->size` of them,
+// in order.
+BT_MKFN(void, bt_collect, struct BT_MKID(bt)* bt, BT_ELEM* out);
+
+// Binary searches for a key within a single node. If an element with that key
+// is found, return the index to that element. If it is not, return the negative
+// of the index where the element would be inserted to maintain ordering minus
+// one. So, if the key wasn't found because it is too small, -1 would be
+// returned.
+BT_MKFN(ssize_t, bt_node_bsearch, const struct BT_MKID(bnode)* node, const BT_KEY* key);
 
 // Returns a pointer to the element if found. `node` and `offset` are set to the
 // last node and child index respectively. When the function returns a valid
 // pointer (not NULL), `node` will point to the last visited leaf node and
-// `offset` will be the index where `elem` could be inserted in that node.
-BT_MKFN(BT_ELEM*, bt_lookup_node, const struct BT_MKID(bt)* bt, const BT_ELEM* elem, struct BT_MKID(bnode)** node);
+// `offset` will be the index where `key` could be inserted in that node.
+BT_MKFN(BT_ELEM*, bt_lookup_node, const struct BT_MKID(bt)* bt, const BT_KEY* key, struct BT_MKID(bnode)** node);
+
+#ifdef BT_PREFETCH
+// Prefetches every cache line of `node`, with compilers that can.
+BT_MKFN(void, bt_node_prefetch, const struct BT_MKID(bnode)* node);
+#endif
 
-// Looks up `elem` in the tree. If it is contained, returns a reference to the
-// element. If not, return `NULL`.
+// Looks up `key` in the tree. If an element with that key is contained,
+// returns a reference to the element. If not, return `NULL`. With `BT_CACHE`,
+// the cache is checked first, and filled in by every lookup that finds its key,
+// so lookups are writes despite the `const`. With `BT_BLOOM`, the bloom filter
+// is tested before descending.
 //
 // NOTE: Changing the looked up element in any way that affects its ordering is
 // a logic error.
-BT_MKFN(BT_ELEM*, bt_lookup, const struct BT_MKID(bt)* bt, const BT_ELEM* elem);
+BT_MKFN(BT_ELEM*, bt_lookup, const struct BT_MKID(bt)* bt, const BT_KEY* key);
 
 // Inserts `elem` into the tree. Returns `true` if there was already another
 // element in the tree that compares equal with `elem`. In that case, the value
@@ -148,6 +724,23 @@ BT_MKFN(BT_ELEM*, bt_lookup, const struct BT_MKID(bt)* bt, const BT_ELEM* elem);
 // null, the value will be freed. Otherwise the function returns `false`.
 BT_MKFN(bool, bt_insert, struct BT_MKID(bt)* bt, BT_ELEM elem, BT_ELEM* prev);
 
+// Accounts for a new element with `key` in the tree: its size, and the learned
+// model and bloom filter if any.
+BT_MKFN(void, bt_added, struct BT_MKID(bt)* bt, const BT_KEY* key);
+
+// Moves `count` elements, along with any data kept per element, from index
+// `si` of `src` to index `di` of `dst`. The ranges may overlap.
+BT_MKFN(void, bt_node_move, struct BT_MKID(bnode)* dst, size_t di, const struct BT_MKID(bnode)* src, size_t si, size_t count);
+
+// Puts `elem` at index `i` of `node`, overwriting whatever was there.
+BT_MKFN(void, bt_node_put, struct BT_MKID(bnode)* node, size_t i, BT_ELEM elem);
+
+#ifdef BT_AUGMENT
+// Recomputes the `aug` of `node` from its elements and the `aug` of its
+// children, which must be up to date.
+BT_MKFN(void, bt_node_augment, struct BT_MKID(bnode)* node);
+#endif
+
 // Splits the child node at `idx` of `parent` and modifies the `parent`s
 // children array to fit the newly created node. This function will not look at
 // any of the elements in the `elems` array of `parent`. Assumes that the child
@@ -160,299 +753,4676 @@ BT_MKFN(BT_ELEM, bt_split_node, struct BT_MKID(bnode)* parent, size_t idx);
 // with the replaced element from the tree.
 BT_MKFN(bool, bt_node_insert, struct BT_MKID(bnode)* node, BT_ELEM elem, BT_ELEM* prev);
 
-// TODO: Implement
-BT_MKFN(bool, bt_remove, struct BT_MKID(bt)* bt, BT_ELEM* elem, BT_ELEM* removed);
-// FIXME: Remove
-BT_MKFN(void, bt_print, struct BT_MKID(bnode)* node, int depth);
+// Builds a btree of `height` levels with the `n` sorted elements in `elems`,
+// with nodes as full as possible. Its root has at least `min_children`
+// children, unless it is a leaf. `n` must fit in such a tree.
+BT_MKFN(struct BT_MKID(bnode)*, bt_node_build, const BT_ELEM* elems, size_t n, size_t height, size_t min_children);
 
-#ifndef BT_DECL_ONLY
+// Inserts the `n` elements in `elems`, which must be sorted and without
+// duplicate keys, into the empty tree `bt`. Much faster than inserting them one
+// by one, and nodes are packed as full as possible.
+BT_MKFN(void, bt_bulk_load, struct BT_MKID(bt)* bt, const BT_ELEM* elems, size_t n);
 
-// Definitions
+// Fixes the child at `idx` of `parent` after it was left with `BT_FACTOR - 1`
+// elements, either by borrowing an element from one of its siblings or by
+// merging it with one of them. In the latter case `parent` loses an element,
+// and may be left with too few elements itself.
+BT_MKFN(void, bt_rebalance_node, struct BT_MKID(bnode)* parent, size_t idx);
 
-#ifndef BT_CMP
-#define BT_CMP BT_MKID(bt_default_cmp)
+// Removes the largest element of the btree of root `node` and puts it in
+// `removed`. Returns its reference bit with `BT_LRU`, so that it goes along
+// with the element, and `false` otherwise.
+BT_MKFN(bool, bt_node_remove_max, struct BT_MKID(bnode)* node, BT_ELEM* removed);
 
-#ifdef BT_LESS
+// Removes the element with `key` from the btree of root `node`. Returns `true`
+// if it was found and, in that case, `removed` will be overwritten with the
+// removed element.
+BT_MKFN(bool, bt_node_remove, struct BT_MKID(bnode)* node, const BT_KEY* key, BT_ELEM* removed);
 
-BT_MKFN(int, bt_default_cmp, const BT_ELEM* a, const BT_ELEM* b)
-{
-    if (BT_LESS(b, a)) return  1;
-    if (BT_LESS(a, b)) return -1;
-    return 0;
-}
+// Removes the element with `key` from the tree. Returns `true` if there was
+// one. In that case, the element will be put in `removed` or, in case `removed`
+// is null, it will be freed. Otherwise the function returns `false`.
+BT_MKFN(bool, bt_remove, struct BT_MKID(bt)* bt, const BT_KEY* key, BT_ELEM* removed);
 
-#else
+#ifdef BT_BLOOM
+// Returns `false` if `key` is definitely not in the tree.
+BT_MKFN(bool, bt_bloom_test, const struct BT_MKID(bt)* bt, const BT_KEY* key);
 
-BT_MKFN(int, bt_default_cmp, const BT_ELEM* a, const BT_ELEM* b)
-{
-    if (*a > *b) return  1;
-    if (*a < *b) return -1;
-    return 0;
-}
+// Adds `key` to the bloom filter, which must have been allocated.
+BT_MKFN(void, bt_bloom_add, struct BT_MKID(bt)* bt, const BT_KEY* key);
 
+// Reallocates the bloom filter with room for twice the current number of
+// elements and fills it with every key in the tree. Use it after removing many
+// elements, as removals leave their keys in the filter.
+BT_MKFN(void, bt_bloom_rebuild, struct BT_MKID(bt)* bt);
 #endif
+
+#ifdef BT_LEARNED
+// Looks up `key` with the learned model. Returns `false` if it can't tell
+// whether `key` is in the tree, in which case a normal descent is needed.
+// Otherwise, `elem` is set to the element or `NULL` and `node` to the leaf.
+BT_MKFN(bool, bt_learned_lookup, const struct BT_MKID(bt)* bt, const BT_KEY* key, BT_ELEM** elem, struct BT_MKID(bnode)** node);
+
+// Appends the leaves and separators of the subtree of `node` in order.
+BT_MKFN(void, bt_learned_collect, struct BT_MKID(bt_learned)* l, struct BT_MKID(bnode)* node);
+
+// Rebuilds the learned model from the current shape of the tree.
+BT_MKFN(void, bt_learned_build, struct BT_MKID(bt)* bt);
+
+// Counts a change to the tree, and rebuilds the model if there were enough.
+BT_MKFN(void, bt_learned_changed, struct BT_MKID(bt)* bt);
 #endif
 
-BT_MKFN(struct BT_MKID(bt), bt_mk,)
-{
-  return (struct BT_MKID(bt)) { .root = NULL };
-}
+#ifdef BT_HASH_INDEX
+// Looks up `key` in the hash index. If found, returns the element and sets
+// `node` to the node holding it, otherwise returns `NULL`.
+BT_MKFN(BT_ELEM*, bt_hindex_lookup, const struct BT_MKID(bt_hindex)* hx, const BT_KEY* key, struct BT_MKID(bnode)** node);
 
-BT_MKFN(void, bt_node_free, struct BT_MKID(bnode)* node)
-{
-    if (!node) return;
-    for (size_t i = 0; i < node->n; i++)
-    {
-        BT_ELEM_FREE(node->elems[i]);
-        BT_MKID(bt_node_free)(node->children[i]);
-    }
-    BT_MKID(bt_node_free)(node->children[node->n]);
-    free(node);
-}
+// Adds the slot of an element with `hash` that was inserted in `node`.
+BT_MKFN(void, bt_hindex_add, struct BT_MKID(bt_hindex)* hx, uint64_t hash, struct BT_MKID(bnode)* node);
 
-BT_MKFN(void, bt_free, struct BT_MKID(bt) bt)
-{
-    BT_MKID(bt_node_free)(bt.root);
-}
+// Points the slot of an element with `hash` that was in `from` to `to`, or
+// removes it if `to` is `NULL`.
+BT_MKFN(void, bt_hindex_move, struct BT_MKID(bt_hindex)* hx, uint64_t hash, const struct BT_MKID(bnode)* from, struct BT_MKID(bnode)* to);
 
-BT_MKFN(ssize_t, bt_node_bsearch, const struct BT_MKID(bnode)* node, const BT_ELEM* elem)
-{
-    // Binary search for the element in the current node.
-    // NOTE: `curr->n` can't bet 0 because of the btree invariants.
-    size_t left = 0;
-    size_t right = node->n;
-    size_t mid;
-    int cmp;
-    do
-    {
-        mid = left + (right - left) / 2;
-        cmp = BT_CMP(elem, node->elems + mid);
-        if      (cmp > 0) left  = mid + 1;
-        else if (cmp < 0) right = mid;
-    }
-    while (cmp && left < right);
+// Adds the slots of every element in the subtree of `node`.
+BT_MKFN(void, bt_hindex_fill, struct BT_MKID(bt_hindex)* hx, struct BT_MKID(bnode)* node);
+#endif
 
-    // Found the element, return it.
-    if (!cmp) return (ssize_t)mid;
+#ifdef BT_INTERVAL
+// Called by `bt_interval_overlaps` with each overlapping element, stops the
+// query when it returns `false`.
+typedef bool (*BT_MKID(bt_interval_fn))(BT_ELEM* elem, void* ctx);
 
-    assert(left == right);
-    return -(ssize_t)left - 1;
-}
+// Calls `fn` on every element whose interval, from its key to
+// `BT_INTERVAL_END`, overlaps `[a, b]`, in order of their keys. Subtrees whose
+// maximum end is below `a` are skipped, and the query stops at the first key
+// above `b`.
+BT_MKFN(
+    void,
+    bt_interval_overlaps,
+    struct BT_MKID(bt)* bt, const BT_KEY* a, const BT_KEY* b, BT_MKID(bt_interval_fn) fn, void* ctx
+);
 
-// Returns a pointer to the element if found. `node` and `offset` are set to the
-// last node and child index respectively. When the function returns a valid
-// pointer (not NULL), `node` will point to the last visited leaf node and
-// `offset` will be the index where `elem` could be inserted in that node.
+// Same as `bt_interval_overlaps`, on the subtree of `node`. Returns `false`
+// once the query is over.
 BT_MKFN(
-    BT_ELEM*,
-    bt_lookup_node,
-    const struct BT_MKID(bt)* bt, const BT_ELEM* elem, struct BT_MKID(bnode)** node
-) {
-    struct BT_MKID(bnode)* curr = bt->root;
-    while (curr)
-    {
-        // Assign to `*node`. At the end `*node` will point to the last visited node.
-        if (node) *node = curr;
-        ssize_t idx = BT_MKID(bt_node_bsearch)(curr, elem);
-        if (idx >= 0) return curr->elems + idx;
-        curr = curr->children[-idx - 1];
-    }
-    return NULL;
-}
+    bool,
+    bt_interval_node,
+    struct BT_MKID(bnode)* node, const BT_KEY* a, const BT_KEY* b, BT_MKID(bt_interval_fn) fn, void* ctx
+);
+#endif
 
-BT_MKFN(BT_ELEM*, bt_lookup, const struct BT_MKID(bt)* bt, const BT_ELEM* elem)
-{
-    return BT_MKID(bt_lookup_node)(bt, elem, NULL);
-}
+#ifdef BT_TTL
+// Removes (and frees) up to `budget` elements that expired by `now`, that is
+// whose `BT_TTL_EXPIRY` is not greater than it. Returns how many were removed,
+// less than `budget` only if no expired element is left.
+BT_MKFN(size_t, bt_expire, struct BT_MKID(bt)* bt, BT_TTL_TYPE now, size_t budget);
 
-// Splits the child node at `idx` of `parent` and modifies the `parent`s
-// children array to fit the newly created node. This function will not look at
-// any of the elements in the `elems` array of `parent`. Assumes that the child
-// beeing split is full (has 2 * BT_FACTOR + 1 elements). Returns the promoted
-// element.
-BT_MKFN(BT_ELEM, bt_split_node, struct BT_MKID(bnode)* parent, size_t idx)
+// Returns an element of the subtree of `node` that expired by `now`, or `NULL`
+// if there is none.
+BT_MKFN(BT_ELEM*, bt_ttl_find, struct BT_MKID(bnode)* node, BT_TTL_TYPE now);
+#endif
+
+BT_MKFN(struct BT_MKID(bt_iter_dfs), bt_iter_dfs_mk, struct BT_MKID(bt)* btree);
+
+// Creates an iterator that starts at the first element whose key is not less
+// than `key`.
+BT_MKFN(struct BT_MKID(bt_iter_dfs), bt_iter_dfs_seek, struct BT_MKID(bt)* btree, const BT_KEY* key);
+
+// Returns the next element in order, or `NULL` when there are no more.
+BT_MKFN(BT_ELEM*, bt_iter_dfs_next, struct BT_MKID(bt_iter_dfs)* iter);
+
+#ifdef BT_RADIX
+
+// Directory of `2^bits` trees. Keys below `2^span` go to the tree of their
+// top `bits` bits, which partitions them by ranges.
+struct BT_MKID(bt_radix)
+{
+    unsigned span;
+    unsigned bits;
+    size_t size;
+    struct BT_MKID(bt)* parts;
+};
+
+// In-order iterator over every partition.
+struct BT_MKID(bt_radix_iter)
+{
+    struct BT_MKID(bt_radix)* radix;
+    size_t part;
+    struct BT_MKID(bt_iter_dfs) iter;
+};
+
+BT_MKFN(struct BT_MKID(bt_radix), bt_radix_mk,);
+BT_MKFN(void, bt_radix_free, struct BT_MKID(bt_radix) radix);
+
+// Index of the partition of `key`, which must be below `2^span`.
+BT_MKFN(size_t, bt_radix_part, const struct BT_MKID(bt_radix)* radix, uint64_t key);
+
+// Moves every element to `2^bits` new partitions covering keys below
+// `2^span`.
+BT_MKFN(void, bt_radix_repartition, struct BT_MKID(bt_radix)* radix, unsigned span, unsigned bits);
+
+// Same as `bt_lookup`, `bt_insert` and `bt_remove`, on the partition of the
+// key.
+BT_MKFN(BT_ELEM*, bt_radix_lookup, const struct BT_MKID(bt_radix)* radix, const BT_KEY* key);
+BT_MKFN(bool, bt_radix_insert, struct BT_MKID(bt_radix)* radix, BT_ELEM elem, BT_ELEM* prev);
+BT_MKFN(bool, bt_radix_remove, struct BT_MKID(bt_radix)* radix, const BT_KEY* key, BT_ELEM* removed);
+
+BT_MKFN(struct BT_MKID(bt_radix_iter), bt_radix_iter_mk, struct BT_MKID(bt_radix)* radix);
+
+// Creates an iterator that starts at the first element whose key is not less
+// than `key`.
+BT_MKFN(struct BT_MKID(bt_radix_iter), bt_radix_iter_seek, struct BT_MKID(bt_radix)* radix, const BT_KEY* key);
+
+// Returns the next element in order, or `NULL` when there are no more.
+BT_MKFN(BT_ELEM*, bt_radix_iter_next, struct BT_MKID(bt_radix_iter)* iter);
+
+#endif
+
+#ifdef BT_SHARDS
+
+struct BT_MKID(bt_shard)
+{
+    pthread_mutex_t lock;
+    struct BT_MKID(bt) tree;
+    // Copy of `tree.size` that can be read without the lock.
+    atomic_size_t size;
+};
+
+// Shard `i` holds the keys in `[lows[i], lows[i + 1])`, the first and last
+// ones are unbounded. Every operation holds `lock` for reading and the lock of
+// the shard it works on, splits and merges hold `lock` for writing.
+struct BT_MKID(bt_shards)
+{
+    pthread_rwlock_t lock;
+    size_t target;
+    size_t count;
+    BT_KEY* lows;
+    struct BT_MKID(bt_shard)** shards;
+    atomic_size_t size;
+};
+
+// Called by `bt_shards_scan` for each element, stops the scan when it returns
+// `false`.
+typedef bool (*BT_MKID(bt_shards_fn))(BT_ELEM* elem, void* ctx);
+
+// Initializes an empty container that aims for `target` shards of the same
+// size.
+BT_MKFN(void, bt_shards_init, struct BT_MKID(bt_shards)* shards, size_t target);
+BT_MKFN(void, bt_shards_destroy, struct BT_MKID(bt_shards)* shards);
+
+// Index of the shard of `key`.
+BT_MKFN(size_t, bt_shards_find, const struct BT_MKID(bt_shards)* shards, const BT_KEY* key);
+
+// Same as `bt_insert` and `bt_remove`. They may split or merge shards
+// afterwards.
+BT_MKFN(bool, bt_shards_insert, struct BT_MKID(bt_shards)* shards, BT_ELEM elem, BT_ELEM* prev);
+BT_MKFN(bool, bt_shards_remove, struct BT_MKID(bt_shards)* shards, const BT_KEY* key, BT_ELEM* removed);
+
+// Copies the element with `key` to `elem`, since it may be removed as soon as
+// the lock is released. Returns whether it was found.
+BT_MKFN(bool, bt_shards_lookup, struct BT_MKID(bt_shards)* shards, const BT_KEY* key, BT_ELEM* elem);
+
+// Calls `fn` on every element with a key in `[lo, hi)`, in order. `NULL`
+// bounds are unbounded. Each shard is locked while it's scanned, so the
+// elements are a consistent view of each shard, not of all of them.
+BT_MKFN(
+    void,
+    bt_shards_scan,
+    struct BT_MKID(bt_shards)* shards, const BT_KEY* lo, const BT_KEY* hi, BT_MKID(bt_shards_fn) fn, void* ctx
+);
+
+// Largest size a shard can reach before being split.
+BT_MKFN(size_t, bt_shards_max, struct BT_MKID(bt_shards)* shards);
+
+// Splits or merges the shard of `key` if its size is too far from the others.
+// Takes the lock for writing.
+BT_MKFN(void, bt_shards_rebalance, struct BT_MKID(bt_shards)* shards, const BT_KEY* key);
+
+#endif
+
+#ifdef BT_RW
+
+// Buffered insertion of `elem`, or removal of `key`. `seq` keeps the order of
+// the operations on the same key once sorted.
+struct BT_MKID(bt_rw_op)
+{
+    bool remove;
+    BT_KEY key;
+    BT_ELEM elem;
+    size_t seq;
+};
+
+// Read lock, aligned and padded to a whole cache line so that each one is in
+// its own.
+struct BT_MKID(bt_rw_slot)
+{
+    _Alignas(64) pthread_rwlock_t lock;
+};
+
+// A thread of a `bt_rw`. Its buffer is owned by the thread until it sets
+// `published`, and by the combiner until it clears it.
+struct BT_MKID(bt_rw_thread)
+{
+    struct BT_MKID(bt_rw)* rw;
+    size_t slot;
+    size_t n;
+    struct BT_MKID(bt_rw_op) ops[BT_RW_BATCH];
+    atomic_bool published;
+    // Whether the current combiner took the buffer.
+    bool taken;
+    struct BT_MKID(bt_rw_thread)* next;
+};
+
+// Aligned to a cache line, for its read locks: allocate it with `aligned_alloc`
+// rather than `malloc`.
+struct BT_MKID(bt_rw)
+{
+    struct BT_MKID(bt) tree;
+    struct BT_MKID(bt_rw_slot) slots[BT_RW_SLOTS];
+    // Held by the combiner, also protects `threads` and `batch`.
+    pthread_mutex_t combiner;
+    struct BT_MKID(bt_rw_thread)* threads;
+    size_t nthreads;
+    struct BT_MKID(bt_rw_op)* batch;
+    size_t batch_cap;
+};
+
+BT_MKFN(void, bt_rw_init, struct BT_MKID(bt_rw)* rw);
+
+// Frees the tree and every thread, which must have flushed their writes.
+BT_MKFN(void, bt_rw_destroy, struct BT_MKID(bt_rw)* rw);
+
+// Registers the calling thread, which passes the result to every other
+// function. It stays valid until `bt_rw_destroy`.
+BT_MKFN(struct BT_MKID(bt_rw_thread)*, bt_rw_register, struct BT_MKID(bt_rw)* rw);
+
+// Buffer an insertion or removal, which is applied (and visible to readers)
+// once the buffer is full or flushed. The replaced or removed elements are
+// freed with `BT_ELEM_FREE`.
+BT_MKFN(void, bt_rw_insert, struct BT_MKID(bt_rw_thread)* thread, BT_ELEM elem);
+BT_MKFN(void, bt_rw_remove, struct BT_MKID(bt_rw_thread)* thread, const BT_KEY* key);
+
+// Applies the buffered operations of `thread`, and waits until they are.
+BT_MKFN(void, bt_rw_flush, struct BT_MKID(bt_rw_thread)* thread);
+
+// Applies every published buffer. Must hold `rw->combiner`.
+BT_MKFN(void, bt_rw_combine, struct BT_MKID(bt_rw)* rw);
+
+// Locks the tree for reading, `rw->tree` can be read with the `bt_*`
+// functions until unlocked.
+BT_MKFN(void, bt_rw_read_lock, struct BT_MKID(bt_rw_thread)* thread);
+BT_MKFN(void, bt_rw_read_unlock, struct BT_MKID(bt_rw_thread)* thread);
+
+// Copies the element with `key` to `elem`. Returns whether it was found.
+BT_MKFN(bool, bt_rw_lookup, struct BT_MKID(bt_rw_thread)* thread, const BT_KEY* key, BT_ELEM* elem);
+
+#endif
+
+#ifdef BT_BLINK
+
+#ifdef BT_MVCC
+// Version of an element written at `ts`, or its removal. Versions are only
+// freed once no snapshot can reach them.
+struct BT_MKID(bt_version)
+{
+    uint64_t ts;
+    bool removed;
+    BT_ELEM elem;
+    _Atomic(struct BT_MKID(bt_version)*) next;
+};
+#endif
+
+// Node of a `bt_blink`, with `BT_FACTOR` to `2 * BT_FACTOR` elements (leaves)
+// or separators (inner nodes, with one more child), except for the root. Child
+// `i` holds the keys in `[keys[i - 1], keys[i])`, and the node the ones below
+// `high`, unless it's the last node of its level.
+struct BT_MKID(bt_blnode)
+{
+    // Odd while a writer holds the latch, and incremented when it's released,
+    // so readers can tell if the node changed while they read it.
+    atomic_uint_fast64_t version;
+    uint32_t n;
+    // Leaves are level 0.
+    uint32_t level;
+    bool has_high;
+    BT_KEY high;
+    struct BT_MKID(bt_blnode)* link;
+    union
+    {
+        struct
+        {
+            BT_ELEM elems[2 * BT_FACTOR + 1];
+#ifdef BT_MVCC
+            // Versions of each element, `elems` only holds its key.
+            _Atomic(struct BT_MKID(bt_version)*) versions[2 * BT_FACTOR + 1];
+#endif
+        };
+        struct
+        {
+            BT_KEY keys[2 * BT_FACTOR + 1];
+            struct BT_MKID(bt_blnode)* children[2 * BT_FACTOR + 2];
+        };
+    };
+};
+
+struct BT_MKID(bt_blink)
+{
+    // The first node of the top level.
+    _Atomic(struct BT_MKID(bt_blnode)*) root;
+    // Held to add a level.
+    pthread_mutex_t root_lock;
+    atomic_size_t size;
+};
+
+// Called by `bt_blink_scan` with a copy of each element, stops the scan when
+// it returns `false`.
+typedef bool (*BT_MKID(bt_blink_fn))(BT_ELEM* elem, void* ctx);
+
+BT_MKFN(void, bt_blink_init, struct BT_MKID(bt_blink)* tree);
+BT_MKFN(void, bt_blink_destroy, struct BT_MKID(bt_blink)* tree);
+
+// Waits until `node` isn't latched and returns its version.
+BT_MKFN(uint_fast64_t, bt_blnode_read_begin, struct BT_MKID(bt_blnode)* node);
+
+// Whether `node` is still at `version`, so what was read from it is valid.
+BT_MKFN(bool, bt_blnode_read_check, struct BT_MKID(bt_blnode)* node, uint_fast64_t version);
+
+BT_MKFN(void, bt_blnode_lock, struct BT_MKID(bt_blnode)* node);
+BT_MKFN(void, bt_blnode_unlock, struct BT_MKID(bt_blnode)* node);
+
+// Index of the first element of a leaf whose key is not less than `key`, or of
+// the child of an inner node where `key` belongs.
+BT_MKFN(size_t, bt_blnode_search, const struct BT_MKID(bt_blnode)* node, const BT_KEY* key);
+
+// Whether `key` belongs to a node to the right of `node`.
+BT_MKFN(bool, bt_blnode_past, const struct BT_MKID(bt_blnode)* node, const BT_KEY* key);
+
+// Returns the node at `level` where `key` belongs, without latching it. If
+// `path` is not `NULL`, the nodes visited above that level are stored at the
+// index of their level.
+BT_MKFN(
+    struct BT_MKID(bt_blnode)*,
+    bt_blink_descend,
+    struct BT_MKID(bt_blink)* tree, const BT_KEY* key, uint32_t level, struct BT_MKID(bt_blnode)** path
+);
+
+// Latches the node where `key` belongs, starting from `node` at the same level.
+BT_MKFN(struct BT_MKID(bt_blnode)*, bt_blink_lock_for, struct BT_MKID(bt_blnode)* node, const BT_KEY* key);
+
+// Returns the node at `level` where `key` belongs, adding a level to the tree
+// if needed. `path` is checked first.
+BT_MKFN(
+    struct BT_MKID(bt_blnode)*,
+    bt_blink_parent,
+    struct BT_MKID(bt_blink)* tree, const BT_KEY* key, uint32_t level, struct BT_MKID(bt_blnode)** path
+);
+
+// Splits the latched `node` and adds the new sibling to the level above, as
+// long as they overflow, then unlocks the last node latched.
+BT_MKFN(
+    void,
+    bt_blink_split,
+    struct BT_MKID(bt_blink)* tree, struct BT_MKID(bt_blnode)* node, struct BT_MKID(bt_blnode)** path
+);
+
+// Copies the element with `key` to `elem`. Returns whether it was found.
+BT_MKFN(bool, bt_blink_lookup, struct BT_MKID(bt_blink)* tree, const BT_KEY* key, BT_ELEM* elem);
+
+// Same as `bt_insert` and `bt_remove`. Nodes left with too few elements by
+// removals aren't merged.
+BT_MKFN(bool, bt_blink_insert, struct BT_MKID(bt_blink)* tree, BT_ELEM elem, BT_ELEM* prev);
+BT_MKFN(bool, bt_blink_remove, struct BT_MKID(bt_blink)* tree, const BT_KEY* key, BT_ELEM* removed);
+
+// Calls `fn` on a copy of every element with a key not less than `lo` (or
+// every element if `NULL`), in order, following the links between leaves.
+// Each leaf is copied at once, but concurrent writes to later leaves may be
+// seen.
+BT_MKFN(void, bt_blink_scan, struct BT_MKID(bt_blink)* tree, const BT_KEY* lo, BT_MKID(bt_blink_fn) fn, void* ctx);
+
+#endif
+
+#ifdef BT_EPOCH
+
+// Pointer that was retired during `epoch`, freed with `free_fn`.
+struct BT_MKID(bt_epoch_retired)
+{
+    void* ptr;
+    void (*free_fn)(void* ptr);
+    uint_fast64_t epoch;
+};
+
+// A thread of a `bt_epoch`. Its limbo list is in retirement order, so the
+// pointers that can be freed are at the front.
+struct BT_MKID(bt_epoch_thread)
+{
+    struct BT_MKID(bt_epoch)* epoch;
+    // Twice the epoch the thread is pinned to plus one, or 0 when unpinned.
+    atomic_uint_fast64_t local;
+    size_t depth;
+    struct BT_MKID(bt_epoch_retired)* limbo;
+    size_t n;
+    size_t cap;
+    // Size of the limbo list at which it's collected again.
+    size_t threshold;
+    struct BT_MKID(bt_epoch_thread)* next;
+};
+
+struct BT_MKID(bt_epoch)
+{
+    atomic_uint_fast64_t global;
+    // Protects `threads` and `orphans`, held to advance the epoch.
+    pthread_mutex_t lock;
+    struct BT_MKID(bt_epoch_thread)* threads;
+    // Limbo lists of the threads that were unregistered.
+    struct BT_MKID(bt_epoch_retired)* orphans;
+    size_t norphans;
+    size_t orphans_cap;
+};
+
+BT_MKFN(void, bt_epoch_init, struct BT_MKID(bt_epoch)* epoch);
+
+// Frees every retired pointer, and the threads that are still registered,
+// none of which may be pinned.
+BT_MKFN(void, bt_epoch_destroy, struct BT_MKID(bt_epoch)* epoch);
+
+// Registers the calling thread, which passes the result to every other
+// function until `bt_epoch_unregister`.
+BT_MKFN(struct BT_MKID(bt_epoch_thread)*, bt_epoch_register, struct BT_MKID(bt_epoch)* epoch);
+
+// Unregisters an unpinned thread. Its retired pointers are freed by the other
+// threads once safe, or by `bt_epoch_destroy`.
+BT_MKFN(void, bt_epoch_unregister, struct BT_MKID(bt_epoch_thread)* thread);
+
+// Pins the current epoch: nothing retired from now on is freed until unpinned.
+// Pins nest.
+BT_MKFN(void, bt_epoch_pin, struct BT_MKID(bt_epoch_thread)* thread);
+BT_MKFN(void, bt_epoch_unpin, struct BT_MKID(bt_epoch_thread)* thread);
+
+// Frees `ptr` with `free_fn` (`free` if `NULL`) once no thread can hold it,
+// which must have been unlinked already.
+BT_MKFN(void, bt_epoch_retire, struct BT_MKID(bt_epoch_thread)* thread, void* ptr, void (*free_fn)(void* ptr));
+
+// Advances the epoch if every pinned thread has seen the current one. Returns
+// the epoch.
+BT_MKFN(uint_fast64_t, bt_epoch_advance, struct BT_MKID(bt_epoch)* epoch);
+
+// Tries to advance the epoch, then frees the retired pointers of `thread`
+// that are safe. Returns how many are left.
+BT_MKFN(size_t, bt_epoch_collect, struct BT_MKID(bt_epoch_thread)* thread);
+
+// Frees the pointers of `list` retired two epochs before `global`, and returns
+// how many are left, moved to the front.
+BT_MKFN(size_t, bt_epoch_free, struct BT_MKID(bt_epoch_retired)* list, size_t n, uint_fast64_t global);
+
+#endif
+
+#ifdef BT_MVCC
+
+// A thread of a `bt_mvcc`.
+struct BT_MKID(bt_mvcc_thread)
+{
+    struct BT_MKID(bt_mvcc)* mvcc;
+    struct BT_MKID(bt_epoch_thread)* epoch;
+    // Timestamp of the current snapshot, 0 if none.
+    atomic_uint_fast64_t snapshot;
+    struct BT_MKID(bt_mvcc_thread)* next;
+};
+
+struct BT_MKID(bt_mvcc)
+{
+    struct BT_MKID(bt_blink) tree;
+    struct BT_MKID(bt_epoch) epoch;
+    // Last timestamp given to a write, and the last one up to which every
+    // write is visible, which is what snapshots take.
+    atomic_uint_fast64_t clock;
+    atomic_uint_fast64_t stable;
+    // Versions older than the one visible at `horizon` may be freed, no
+    // snapshot can be taken before it.
+    atomic_uint_fast64_t horizon;
+    // Protects `threads`, held by `bt_mvcc_gc`.
+    pthread_mutex_t lock;
+    struct BT_MKID(bt_mvcc_thread)* threads;
+};
+
+// Iterator over the elements as of a timestamp, in order.
+struct BT_MKID(bt_mvcc_iter)
+{
+    uint64_t ts;
+    bool has_lo;
+    BT_KEY lo;
+    // Copy of the current leaf.
+    size_t n;
+    size_t i;
+    BT_ELEM keys[2 * BT_FACTOR + 1];
+    struct BT_MKID(bt_version)* versions[2 * BT_FACTOR + 1];
+    struct BT_MKID(bt_blnode)* next;
+    // Key of the last element returned, leaves may have been split since.
+    bool has_last;
+    BT_KEY last;
+    BT_ELEM elem;
+};
+
+BT_MKFN(void, bt_mvcc_init, struct BT_MKID(bt_mvcc)* mvcc);
+
+// Frees every version, and the threads that are still registered.
+BT_MKFN(void, bt_mvcc_destroy, struct BT_MKID(bt_mvcc)* mvcc);
+
+// Registers the calling thread, which passes the result to every other
+// function until `bt_mvcc_unregister`.
+BT_MKFN(struct BT_MKID(bt_mvcc_thread)*, bt_mvcc_register, struct BT_MKID(bt_mvcc)* mvcc);
+BT_MKFN(void, bt_mvcc_unregister, struct BT_MKID(bt_mvcc_thread)* thread);
+
+// Takes a snapshot and returns its timestamp. Until `bt_mvcc_end`, the
+// elements as of any timestamp since can be read, and elements copied out of
+// the tree stay valid.
+BT_MKFN(uint64_t, bt_mvcc_begin, struct BT_MKID(bt_mvcc_thread)* thread);
+BT_MKFN(void, bt_mvcc_end, struct BT_MKID(bt_mvcc_thread)* thread);
+
+// Frees a `bt_version` and its element, if any. Takes a `void*` so that it
+// can be retired to the `bt_epoch`.
+BT_MKFN(void, bt_version_free, void* ptr);
+
+// Version of a chain visible at `ts`, `NULL` if none.
+BT_MKFN(struct BT_MKID(bt_version)*, bt_version_at, struct BT_MKID(bt_version)* v, uint64_t ts);
+
+// Copies the element with `key` as of `ts` to `elem`, between the timestamp of
+// the current snapshot of `thread` and now. Returns whether it was found.
+BT_MKFN(
+    bool,
+    bt_mvcc_lookup_at,
+    struct BT_MKID(bt_mvcc_thread)* thread, const BT_KEY* key, uint64_t ts, BT_ELEM* elem
+);
+
+// Iterates over the elements as of `ts` with a key not less than `lo` (or all
+// of them if `NULL`), with the same constraints as `bt_mvcc_lookup_at`.
+BT_MKFN(
+    struct BT_MKID(bt_mvcc_iter),
+    bt_mvcc_iter_at,
+    struct BT_MKID(bt_mvcc_thread)* thread, const BT_KEY* lo, uint64_t ts
+);
+
+// Returns the next element, `NULL` when done. It's overwritten by the next
+// call.
+BT_MKFN(BT_ELEM*, bt_mvcc_iter_next, struct BT_MKID(bt_mvcc_iter)* iter);
+
+// Adds a version of `elem`, or the removal of `key`, once it's visible to new
+// snapshots. Returns its timestamp, or 0 if there was nothing to remove.
+BT_MKFN(uint64_t, bt_mvcc_put, struct BT_MKID(bt_mvcc_thread)* thread, BT_ELEM elem);
+BT_MKFN(uint64_t, bt_mvcc_remove, struct BT_MKID(bt_mvcc_thread)* thread, const BT_KEY* key);
+
+// Adds a version to the leaf where `key` belongs. Returns its timestamp.
+BT_MKFN(
+    uint64_t,
+    bt_mvcc_write,
+    struct BT_MKID(bt_mvcc_thread)* thread, const BT_KEY* key, BT_ELEM elem, bool removed
+);
+
+// Frees the versions older than the ones visible to the oldest snapshot, and
+// the elements whose visible version is a removal. Meant to be called
+// periodically, by a background thread for example. Returns how many
+// versions were retired.
+BT_MKFN(size_t, bt_mvcc_gc, struct BT_MKID(bt_mvcc_thread)* thread);
+
+#endif
+
+#ifdef BT_TXN
+
+// Staged insertion of `elem`, or removal of `key`.
+struct BT_MKID(bt_txn_op)
+{
+    bool remove;
+    BT_KEY key;
+    BT_ELEM elem;
+};
+
+// Changes staged for `bt`. The first `sorted` are sorted by key, with at most
+// one per key, the others are appended as they come and merged when needed.
+struct BT_MKID(bt_txn)
+{
+    struct BT_MKID(bt)* bt;
+    size_t n;
+    size_t sorted;
+    size_t cap;
+    struct BT_MKID(bt_txn_op)* ops;
+};
+
+BT_MKFN(struct BT_MKID(bt_txn), bt_txn_begin, struct BT_MKID(bt)* bt);
+
+// Stage the insertion of `elem` or the removal of `key`, replacing what was
+// staged for the same key. A replaced insertion frees its element with
+// `BT_ELEM_FREE`.
+BT_MKFN(void, bt_txn_put, struct BT_MKID(bt_txn)* txn, BT_ELEM elem);
+BT_MKFN(void, bt_txn_remove, struct BT_MKID(bt_txn)* txn, const BT_KEY* key);
+
+// Appends a change to the unsorted part of `txn`.
+BT_MKFN(struct BT_MKID(bt_txn_op)*, bt_txn_append, struct BT_MKID(bt_txn)* txn);
+
+// Merges the sorted `a` and `b` into `out`, keeping their order on ties, and
+// the elements of `a` first.
+BT_MKFN(
+    void,
+    bt_txn_merge,
+    struct BT_MKID(bt_txn_op)* out,
+    const struct BT_MKID(bt_txn_op)* a, size_t na, const struct BT_MKID(bt_txn_op)* b, size_t nb
+);
+
+// Sorts the appended changes and merges them with the sorted ones, keeping the
+// last change to each key.
+BT_MKFN(void, bt_txn_sort, struct BT_MKID(bt_txn)* txn);
+
+// Same as `bt_lookup`, as if the transaction was committed. The pointer is
+// only valid until the next change to the transaction or the tree.
+BT_MKFN(BT_ELEM*, bt_txn_lookup, struct BT_MKID(bt_txn)* txn, const BT_KEY* key);
+
+// Applies every staged change to the tree, as `bt_insert` and `bt_remove` with
+// a `NULL` output would, and ends the transaction.
+BT_MKFN(void, bt_txn_commit, struct BT_MKID(bt_txn)* txn);
+
+// Ends the transaction without applying anything, freeing the staged elements.
+BT_MKFN(void, bt_txn_abort, struct BT_MKID(bt_txn)* txn);
+
+// Applies the first of the `n` sorted changes in `ops`, and the following ones
+// that fall in the same leaf, until one splits it or would need it to be
+// rebalanced. Returns how many were applied.
+BT_MKFN(size_t, bt_txn_apply, struct BT_MKID(bt)* bt, struct BT_MKID(bt_txn_op)* ops, size_t n);
+
+#endif
+
+#ifdef BT_LRU
+
+// A cache of at most `budget` bytes of elements, as counted by `BT_LRU_BYTES`,
+// evicted with the CLOCK algorithm. The hand sweeps the tree in key order:
+// elements used since it last passed get their bit cleared, the others are
+// evicted.
+struct BT_MKID(bt_lru)
+{
+    // Can be iterated, or searched, without counting as a use.
+    struct BT_MKID(bt) tree;
+    size_t bytes;
+    size_t budget;
+    // The sweep resumes at the first key not less than `hand`, or at the
+    // first key if there is no `hand`.
+    bool has_hand;
+    BT_KEY hand;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+};
+
+BT_MKFN(void, bt_lru_init, struct BT_MKID(bt_lru)* lru, size_t budget);
+BT_MKFN(void, bt_lru_destroy, struct BT_MKID(bt_lru)* lru);
+
+// Returns the element with `key`, or `NULL` if it isn't cached, and counts a
+// hit or a miss. The pointer is valid until the cache is changed.
+BT_MKFN(BT_ELEM*, bt_lru_get, struct BT_MKID(bt_lru)* lru, const BT_KEY* key);
+
+// Caches `elem`, freeing the element it replaces if any, then evicts while the
+// cache is over its budget.
+BT_MKFN(void, bt_lru_put, struct BT_MKID(bt_lru)* lru, BT_ELEM elem);
+
+// Same as `bt_remove`.
+BT_MKFN(bool, bt_lru_remove, struct BT_MKID(bt_lru)* lru, const BT_KEY* key, BT_ELEM* removed);
+
+// Moves the hand until it finds `BT_LRU_BATCH` elements to evict, or went
+// around twice, and evicts them. Returns how many were evicted.
+BT_MKFN(size_t, bt_lru_evict, struct BT_MKID(bt_lru)* lru);
+
+#endif
+
+#ifdef BT_SLOTTED
+
+// Page of a `bt_slotted`, `BT_SLOTTED_PAGE` bytes. Leaves hold the entries,
+// inner pages separators, each with the child holding the keys not less than
+// it, and `first`, the child with the keys below the first separator.
+struct BT_MKID(bt_spage)
+{
+    uint16_t n;
+    // Cells take `[top, BT_SLOTTED_DATA)` of `data`, `dead` bytes of them
+    // removed ones, reclaimed when the page is compacted.
+    uint16_t top;
+    uint16_t dead;
+    bool leaf;
+    struct BT_MKID(bt_spage)* first;
+    // The offsets of the `n` cells in key order, from the start, and the cells
+    // from the end. A cell is the length of the key and of the value (16 bits
+    // each), the key and the value, a child pointer in inner pages.
+    union
+    {
+        uint16_t slots[BT_SLOTTED_DATA / 2];
+        unsigned char data[BT_SLOTTED_DATA];
+    };
+};
+
+// Tree of byte string keys and values of any length, stored in the pages
+// instead of behind pointers. Keys are ordered as by `memcmp`, shorter ones
+// first on ties, which is the order of keys encoded with `mk_bt_key.h`.
+struct BT_MKID(bt_slotted)
+{
+    struct BT_MKID(bt_spage)* root;
+    size_t size;
+    size_t pages;
+};
+
+struct BT_MKID(bt_slotted_frame)
+{
+    // Index of the next entry of a leaf, or of the child being visited of an
+    // inner page.
+    size_t i;
+    struct BT_MKID(bt_spage)* page;
+};
+
+struct BT_MKID(bt_slotted_iter)
+{
+    size_t top;
+    struct BT_MKID(bt_slotted_frame) stack[BT_ITER_STACK_SIZE];
+};
+
+BT_MKFN(struct BT_MKID(bt_slotted), bt_slotted_mk,);
+BT_MKFN(void, bt_slotted_free, struct BT_MKID(bt_slotted) tree);
+
+// Returns whether the entry with `key` was found, and if so points `value` to
+// its value, valid until the tree is changed.
+BT_MKFN(
+    bool,
+    bt_slotted_get,
+    const struct BT_MKID(bt_slotted)* tree, const void* key, size_t klen, const void** value, size_t* vlen
+);
+
+// Adds an entry, or replaces the value of the one with the same key, in which
+// case it returns `true`. Keys and values must take at most `BT_SLOTTED_PAGE /
+// 4 - 16` bytes together.
+BT_MKFN(
+    bool,
+    bt_slotted_put,
+    struct BT_MKID(bt_slotted)* tree, const void* key, size_t klen, const void* value, size_t vlen
+);
+
+// Removes the entry with `key`. Returns whether it was there. Pages are freed
+// once empty, not merged, so removed space is reused by the keys around it.
+BT_MKFN(bool, bt_slotted_remove, struct BT_MKID(bt_slotted)* tree, const void* key, size_t klen);
+
+// Iterates over the entries from the first with a key not less than `key`.
+BT_MKFN(struct BT_MKID(bt_slotted_iter), bt_slotted_iter_seek, const struct BT_MKID(bt_slotted)* tree, const void* key, size_t klen);
+BT_MKFN(struct BT_MKID(bt_slotted_iter), bt_slotted_iter_mk, const struct BT_MKID(bt_slotted)* tree);
+
+// Returns `false` past the last entry, otherwise points `key` and `value` to
+// the next one.
+BT_MKFN(
+    bool,
+    bt_slotted_iter_next,
+    struct BT_MKID(bt_slotted_iter)* iter, const void** key, size_t* klen, const void** value, size_t* vlen
+);
+
+BT_MKFN(struct BT_MKID(bt_spage)*, bt_spage_mk, bool leaf);
+BT_MKFN(void, bt_spage_free, struct BT_MKID(bt_spage)* page);
+
+// Orders byte strings as `memcmp`, then by length.
+BT_MKFN(int, bt_slotted_cmp, const void* a, size_t alen, const void* b, size_t blen);
+
+// Key and value of the cell of slot `i`.
+BT_MKFN(const unsigned char*, bt_spage_key, const struct BT_MKID(bt_spage)* page, size_t i, size_t* klen);
+BT_MKFN(const unsigned char*, bt_spage_value, const struct BT_MKID(bt_spage)* page, size_t i, size_t* vlen);
+
+// Child `i` of an inner page, `first` being child 0.
+BT_MKFN(struct BT_MKID(bt_spage)*, bt_spage_child, const struct BT_MKID(bt_spage)* page, size_t i);
+
+// Same as `bt_node_bsearch`, over the keys the slots point to.
+BT_MKFN(ssize_t, bt_spage_bsearch, const struct BT_MKID(bt_spage)* page, const void* key, size_t klen);
+
+// Adds a cell at slot `i`, which must fit in the free space.
+BT_MKFN(
+    void,
+    bt_spage_insert_at,
+    struct BT_MKID(bt_spage)* page, size_t i, const void* key, size_t klen, const void* value, size_t vlen
+);
+
+// Removes slot `i`, leaving its cell dead.
+BT_MKFN(void, bt_spage_erase, struct BT_MKID(bt_spage)* page, size_t i);
+
+// Whether a cell of `size` bytes, and its slot, fit in `page`, compacting it if
+// that's what it takes.
+BT_MKFN(bool, bt_spage_room, struct BT_MKID(bt_spage)* page, size_t size);
+
+// Splits the entries of `page`, with a new one at slot `i`, in two halves of
+// about as many bytes. Returns the page of the upper half and stores the key
+// that separates them in `sep`. A new last entry of the last leaf goes alone to
+// the new page instead, so keys added in order leave full pages behind.
+BT_MKFN(
+    struct BT_MKID(bt_spage)*,
+    bt_spage_split,
+    struct BT_MKID(bt_spage)* page, size_t i, const void* key, size_t klen, const void* value, size_t vlen,
+    bool last, unsigned char* sep, size_t* seplen
+);
+
+// Puts an entry in the subtree of `page`, `last` if it's the last page of its
+// level. If `page` splits, returns the new page and its separator, as
+// `bt_spage_split` does.
+BT_MKFN(
+    struct BT_MKID(bt_spage)*,
+    bt_spage_put,
+    struct BT_MKID(bt_slotted)* tree, struct BT_MKID(bt_spage)* page, bool last,
+    const void* key, size_t klen, const void* value, size_t vlen,
+    unsigned char* sep, size_t* seplen, bool* replaced
+);
+
+// Removes the entry with `key` from the subtree of `page`. Sets `empty` if that
+// left `page` without entries or children, for the caller to free it.
+BT_MKFN(
+    bool,
+    bt_spage_remove,
+    struct BT_MKID(bt_slotted)* tree, struct BT_MKID(bt_spage)* page, const void* key, size_t klen, bool* empty
+);
+
+#endif
+
+#ifdef BT_ARENA
+
+// Nodes of the trees of a thread, carved out of chunks of `BT_ARENA_CHUNK`
+// bytes mapped on 2MB boundaries and backed by huge pages when the system
+// allows it. Freed nodes are kept for the next allocations of the thread that
+// freed them, and the excess goes to a pool shared by every thread. Chunks are
+// never unmapped.
+struct BT_MKID(bt_arena)
+{
+    // Unused part of the last chunk.
+    char* next;
+    char* end;
+    // Freed nodes, each pointing to the next one.
+    void* free;
+    size_t nfree;
+    size_t chunks;
+    // Chunks backed by hugetlbfs, or that `madvise(MADV_HUGEPAGE)` accepted.
+    size_t huge;
+    // Nodes allocated with `calloc` since no chunk could be mapped.
+    size_t fallbacks;
+};
+
+// Returns a zeroed node of `size` bytes, always the size of a node.
+BT_MKFN(void*, bt_arena_alloc, size_t size);
+BT_MKFN(void, bt_arena_free, void* node);
+
+// Maps a new chunk. Returns whether it could.
+BT_MKFN(bool, bt_arena_grow, struct BT_MKID(bt_arena)* arena);
+
+// The arena of the calling thread.
+BT_MKFN(struct BT_MKID(bt_arena)*, bt_arena_get,);
+
+// Gives the freed nodes and the rest of the chunk of the calling thread to the
+// shared pool. Call it before a thread that allocated or freed nodes exits.
+BT_MKFN(void, bt_arena_release,);
+
+// Gives the first `count` freed nodes of `arena` to the shared pool.
+BT_MKFN(void, bt_arena_give, struct BT_MKID(bt_arena)* arena, size_t count);
+
+// Takes freed nodes, or else the rest of a chunk, from the shared pool.
+// Returns whether there were any.
+BT_MKFN(bool, bt_arena_take, struct BT_MKID(bt_arena)* arena);
+
+#endif
+
+#ifdef BT_NUMA
+
+// Copy of the top levels of the tree of a `bt_numa` in the memory of a NUMA
+// node, and the read lock of the threads on that node, aligned and padded so
+// that each one is in its own cache lines.
+struct BT_MKID(bt_numa_replica)
+{
+    _Alignas(64) pthread_rwlock_t lock;
+    // Root of the copy, whose lowest level points to the nodes of the tree, or
+    // NULL while it's stale.
+    struct BT_MKID(bnode)* root;
+    // Mapping that holds the copy.
+    void* mem;
+    size_t bytes;
+};
+
+struct BT_MKID(bt_numa)
+{
+    struct BT_MKID(bt) tree;
+    struct BT_MKID(bt_numa_replica)* replicas;
+    size_t nodes;
+    // Whether the copies were dropped by a write, and lookups since then.
+    bool stale;
+    atomic_size_t lookups;
+};
+
+// Initializes an empty tree with a copy for each of `nodes` NUMA nodes, or
+// for each node of the system if `nodes` is 0.
+BT_MKFN(void, bt_numa_init, struct BT_MKID(bt_numa)* numa, size_t nodes);
+BT_MKFN(void, bt_numa_destroy, struct BT_MKID(bt_numa)* numa);
+
+// Copies the element with `key` to `elem`, if there's one. Returns whether
+// there was.
+BT_MKFN(bool, bt_numa_lookup, struct BT_MKID(bt_numa)* numa, const BT_KEY* key, BT_ELEM* elem);
+
+// Same as `bt_insert` and `bt_remove`.
+BT_MKFN(bool, bt_numa_insert, struct BT_MKID(bt_numa)* numa, BT_ELEM elem, BT_ELEM* prev);
+BT_MKFN(bool, bt_numa_remove, struct BT_MKID(bt_numa)* numa, const BT_KEY* key, BT_ELEM* removed);
+
+// Rebuilds the copies now, rather than after `BT_NUMA_REFRESH` lookups. Call it
+// after a burst of writes, or after writing to `numa.tree` directly, which
+// must only be done while no other thread uses the tree.
+BT_MKFN(void, bt_numa_sync, struct BT_MKID(bt_numa)* numa);
+
+// Takes and releases every read lock, in order, for writing.
+BT_MKFN(void, bt_numa_write_lock, struct BT_MKID(bt_numa)* numa);
+BT_MKFN(void, bt_numa_write_unlock, struct BT_MKID(bt_numa)* numa);
+
+// Accounts for a write, with every lock held: drops the copies, if they weren't
+// already.
+BT_MKFN(void, bt_numa_wrote, struct BT_MKID(bt_numa)* numa);
+
+// Unmaps the copies and copies the top levels of the tree again, for each node.
+BT_MKFN(void, bt_numa_drop, struct BT_MKID(bt_numa)* numa);
+BT_MKFN(void, bt_numa_rebuild, struct BT_MKID(bt_numa)* numa);
+
+// Number of nodes in the top `levels` levels of the subtree of `node`.
+BT_MKFN(size_t, bt_numa_count, const struct BT_MKID(bnode)* node, size_t levels);
+
+// Copies the top `levels` levels of the subtree of `node` to consecutive nodes
+// from `*next`, which it advances. Returns the copy of `node`.
+BT_MKFN(
+    struct BT_MKID(bnode)*,
+    bt_numa_copy,
+    const struct BT_MKID(bnode)* node, size_t levels, struct BT_MKID(bnode)** next
+);
+
+// Number of NUMA nodes of the system, 1 if it can't be told.
+BT_MKFN(size_t, bt_numa_nodes,);
+
+// NUMA node of the calling thread, 0 if it can't be told.
+BT_MKFN(size_t, bt_numa_node,);
+
+// Asks for the pages of `bytes` from `mem`, which must be page aligned and not
+// touched yet, to be on `node`. Does nothing if it can't.
+BT_MKFN(void, bt_numa_bind, void* mem, size_t bytes, size_t node);
+
+#endif
+
+#endif
+
+#ifndef BT_DECL_ONLY
+
+// Definitions
+
+#ifndef BT_CMP
+#define BT_CMP BT_MKID(bt_default_cmp)
+
+#ifdef BT_LESS
+
+BT_MKFN(int, bt_default_cmp, const BT_KEY* a, const BT_KEY* b)
+{
+    if (BT_LESS(b, a)) return  1;
+    if (BT_LESS(a, b)) return -1;
+    return 0;
+}
+
+#elif defined(BT_KEY_BYTES)
+
+// Compares the first `BT_KEY_BYTES` bytes of the keys 8 at a time, as big
+// endian integers, which orders them as `memcmp` does. The loads are written
+// out so that compilers turn them into a load and a byte swap.
+BT_MKFN(int, bt_default_cmp, const BT_KEY* a, const BT_KEY* b)
+{
+    const unsigned char* x = (const unsigned char*)a;
+    const unsigned char* y = (const unsigned char*)b;
+    size_t i = 0;
+    for (; i + 8 <= BT_KEY_BYTES; i += 8, x += 8, y += 8)
+    {
+        uint64_t u = (uint64_t)x[0] << 56 | (uint64_t)x[1] << 48 | (uint64_t)x[2] << 40 | (uint64_t)x[3] << 32
+                   | (uint64_t)x[4] << 24 | (uint64_t)x[5] << 16 | (uint64_t)x[6] << 8  | (uint64_t)x[7];
+        uint64_t v = (uint64_t)y[0] << 56 | (uint64_t)y[1] << 48 | (uint64_t)y[2] << 40 | (uint64_t)y[3] << 32
+                   | (uint64_t)y[4] << 24 | (uint64_t)y[5] << 16 | (uint64_t)y[6] << 8  | (uint64_t)y[7];
+        if (u != v) return u < v ? -1 : 1;
+    }
+    return i < BT_KEY_BYTES ? memcmp(x, y, BT_KEY_BYTES - i) : 0;
+}
+
+#else
+
+BT_MKFN(int, bt_default_cmp, const BT_KEY* a, const BT_KEY* b)
+{
+    if (*a > *b) return  1;
+    if (*a < *b) return -1;
+    return 0;
+}
+
+#endif
+#endif
+
+#ifndef BT_HASH
+#define BT_HASH BT_MKID(bt_default_hash)
+
+// Hashes the bytes of the key, 8 at a time.
+BT_MKFN(uint64_t, bt_default_hash, const BT_KEY* key)
+{
+    const unsigned char* p = (const unsigned char*)key;
+    size_t len = sizeof(BT_KEY);
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ len;
+    uint64_t w;
+    while (len)
+    {
+        size_t k = len < 8 ? len : 8;
+        w = 0;
+        memcpy(&w, p, k);
+        h = (h ^ w) * 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 31;
+        p   += k;
+        len -= k;
+    }
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
+#endif
+
+BT_MKFN(struct BT_MKID(bt), bt_mk,)
+{
+    struct BT_MKID(bt) bt = { .root = NULL };
+#ifdef BT_CACHE
+    // Entries start out with epoch 0, which is never valid.
+    bt.cache       = calloc(BT_CACHE_SIZE, sizeof(struct BT_MKID(bt_cache_entry)));
+    bt.cache_epoch = 1;
+#endif
+#ifdef BT_HASH_INDEX
+    bt.hindex = calloc(1, sizeof(struct BT_MKID(bt_hindex)));
+#endif
+    return bt;
+}
+
+BT_MKFN(void, bt_node_free, struct BT_MKID(bnode)* node)
+{
+    if (!node) return;
+    for (size_t i = 0; i < node->n; i++)
+    {
+        BT_ELEM_FREE(node->elems[i]);
+        BT_MKID(bt_node_free)(node->children[i]);
+    }
+    BT_MKID(bt_node_free)(node->children[node->n]);
+    BT_NODE_FREE(node);
+}
+
+BT_MKFN(void, bt_free, struct BT_MKID(bt) bt)
+{
+    BT_MKID(bt_node_free)(bt.root);
+    bt.root = NULL;
+    BT_MKID(bt_release)(bt);
+}
+
+BT_MKFN(void, bt_node_release, struct BT_MKID(bnode)* node)
+{
+    if (!node) return;
+    for (size_t i = 0; i <= node->n; i++)
+        BT_MKID(bt_node_release)(node->children[i]);
+    BT_NODE_FREE(node);
+}
+
+BT_MKFN(void, bt_collect, struct BT_MKID(bt)* bt, BT_ELEM* out)
+{
+    struct BT_MKID(bt_iter_dfs) iter = BT_MKID(bt_iter_dfs_mk)(bt);
+    BT_ELEM* elem;
+    while ((elem = BT_MKID(bt_iter_dfs_next)(&iter))) *out++ = *elem;
+}
+
+BT_MKFN(void, bt_release, struct BT_MKID(bt) bt)
+{
+    BT_MKID(bt_node_release)(bt.root);
+#ifdef BT_BLOOM
+    free(bt.bloom);
+#endif
+#ifdef BT_CACHE
+    free(bt.cache);
+#endif
+#ifdef BT_LEARNED
+    free(bt.learned.leaves);
+    free(bt.learned.fences);
+    free(bt.learned.knot);
+#endif
+#ifdef BT_HASH_INDEX
+    free(bt.hindex->slots);
+    free(bt.hindex);
+#endif
+}
+
+BT_MKFN(ssize_t, bt_node_bsearch, const struct BT_MKID(bnode)* node, const BT_KEY* key)
+{
+#ifdef BT_NORMALIZE
+    // Compare the normalized keys first, and only call `BT_CMP` on ties.
+    BT_NORM_TYPE norm = BT_NORMALIZE(key);
+#define CMP_AT(i)                                                       \
+    (norm != node->norms[i] ? (norm < node->norms[i] ? -1 : 1)          \
+                            : BT_CMP(key, BT_KEY_OF(node->elems + (i))))
+#else
+#define CMP_AT(i) BT_CMP(key, BT_KEY_OF(node->elems + (i)))
+#endif
+
+#ifdef BT_LINEAR_SEARCH
+    // Linear search for the element in the current node. For small factors
+    // this is usually faster than the binary search since it has no
+    // unpredictable branches.
+    size_t i = 0;
+    int cmp = 1;
+    while (i < node->n && (cmp = CMP_AT(i)) > 0) i++;
+
+    if (!cmp) return (ssize_t)i;
+    return -(ssize_t)i - 1;
+#else
+    // Binary search for the element in the current node.
+    // NOTE: `curr->n` can't bet 0 because of the btree invariants.
+    size_t left = 0;
+    size_t right = node->n;
+    size_t mid;
+    int cmp;
+    do
+    {
+        mid = left + (right - left) / 2;
+        cmp = CMP_AT(mid);
+        if      (cmp > 0) left  = mid + 1;
+        else if (cmp < 0) right = mid;
+    }
+    while (cmp && left < right);
+
+    // Found the element, return it.
+    if (!cmp) return (ssize_t)mid;
+
+    assert(left == right);
+    return -(ssize_t)left - 1;
+#endif
+
+#undef CMP_AT
+}
+
+#ifdef BT_PREFETCH
+BT_MKFN(void, bt_node_prefetch, const struct BT_MKID(bnode)* node)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    // From the line the node starts in, as nodes may not be aligned on one.
+    const char* end = (const char*)(node + 1);
+    for (const char* line = (const char*)((uintptr_t)node & ~(uintptr_t)63); line < end; line += 64)
+        __builtin_prefetch(line);
+#else
+    (void)node;
+#endif
+}
+#endif
+
+// Returns a pointer to the element if found. `node` and `offset` are set to the
+// last node and child index respectively. When the function returns a valid
+// pointer (not NULL), `node` will point to the last visited leaf node and
+// `offset` will be the index where `key` could be inserted in that node.
+BT_MKFN(
+    BT_ELEM*,
+    bt_lookup_node,
+    const struct BT_MKID(bt)* bt, const BT_KEY* key, struct BT_MKID(bnode)** node
+) {
+    struct BT_MKID(bnode)* curr = bt->root;
+#ifdef BT_PREFETCH
+    if (curr) BT_MKID(bt_node_prefetch)(curr);
+#endif
+    while (curr)
+    {
+        // Assign to `*node`. At the end `*node` will point to the last visited node.
+        if (node) *node = curr;
+        ssize_t idx = BT_MKID(bt_node_bsearch)(curr, key);
+        if (idx >= 0) return curr->elems + idx;
+        curr = curr->children[-idx - 1];
+#ifdef BT_PREFETCH
+        if (curr) BT_MKID(bt_node_prefetch)(curr);
+#endif
+    }
+    return NULL;
+}
+
+BT_MKFN(BT_ELEM*, bt_lookup, const struct BT_MKID(bt)* bt, const BT_KEY* key)
+{
+#ifdef BT_CACHE
+    struct BT_MKID(bt_cache_entry)* entry = bt->cache + (BT_HASH(key) & (BT_CACHE_SIZE - 1));
+    if (entry->epoch == bt->cache_epoch
+        && entry->i < entry->node->n
+        && !BT_CMP(key, BT_KEY_OF(entry->node->elems + entry->i)))
+        return entry->node->elems + entry->i;
+#endif
+
+    struct BT_MKID(bnode)* node;
+    BT_ELEM* elem;
+#ifdef BT_HASH_INDEX
+    // The index answers misses too, there's no need for anything else.
+    elem = BT_MKID(bt_hindex_lookup)(bt->hindex, key, &node);
+#else
+#ifdef BT_BLOOM
+    if (bt->bloom && !BT_MKID(bt_bloom_test)(bt, key)) return NULL;
+#endif
+
+#ifdef BT_LEARNED
+    if (!BT_MKID(bt_learned_lookup)(bt, key, &elem, &node))
+#endif
+    elem = BT_MKID(bt_lookup_node)(bt, key, &node);
+#endif
+
+#ifdef BT_CACHE
+    if (elem)
+    {
+        entry->node  = node;
+        entry->i     = elem - node->elems;
+        entry->epoch = bt->cache_epoch;
+    }
+#endif
+    return elem;
+}
+
+BT_MKFN(
+    void,
+    bt_node_move,
+    struct BT_MKID(bnode)* dst, size_t di, const struct BT_MKID(bnode)* src, size_t si, size_t count
+) {
+    memmove(dst->elems + di, src->elems + si, count * sizeof(BT_ELEM));
+#ifdef BT_NORMALIZE
+    memmove(dst->norms + di, src->norms + si, count * sizeof(BT_NORM_TYPE));
+#endif
+#ifdef BT_LRU
+    memmove(dst->used + di, src->used + si, count * sizeof(bool));
+#endif
+#ifdef BT_HASH_INDEX
+    if (dst != src)
+    {
+        for (size_t i = 0; i < count; i++)
+            BT_MKID(bt_hindex_move)(dst->hindex, BT_HASH(BT_KEY_OF(dst->elems + di + i)), src, dst);
+    }
+#endif
+}
+
+BT_MKFN(void, bt_node_put, struct BT_MKID(bnode)* node, size_t i, BT_ELEM elem)
+{
+    node->elems[i] = elem;
+#ifdef BT_NORMALIZE
+    node->norms[i] = BT_NORMALIZE(BT_KEY_OF(node->elems + i));
+#endif
+}
+
+#ifdef BT_AUGMENT
+BT_MKFN(void, bt_node_augment, struct BT_MKID(bnode)* node)
+{
+    // A leaf emptied by a removal is about to be freed.
+    if (!node->n && !node->children[0]) return;
+
+    BT_AUG_TYPE aug = node->children[0] ? node->children[0]->aug : BT_AUG_OF(node->elems);
+    for (size_t i = 0; i < node->n; i++)
+    {
+        BT_AUG_TYPE x = BT_AUG_OF(node->elems + i);
+        aug = BT_AUG_MERGE(aug, x);
+        if (node->children[i + 1])
+        {
+            x   = node->children[i + 1]->aug;
+            aug = BT_AUG_MERGE(aug, x);
+        }
+    }
+    node->aug = aug;
+}
+#endif
+
+// Splits the child node at `idx` of `parent` and modifies the `parent`s
+// children array to fit the newly created node. This function will not look at
+// any of the elements in the `elems` array of `parent`. Assumes that the child
+// beeing split is full (has 2 * BT_FACTOR + 1 elements). Returns the promoted
+// element.
+BT_MKFN(BT_ELEM, bt_split_node, struct BT_MKID(bnode)* parent, size_t idx)
+{
+#define SIZEOF_PTR sizeof(void*)
+
+    struct BT_MKID(bnode)* child = parent->children[idx];
+
+    // Points to right sibling of `child`.
+    struct BT_MKID(bnode)** rchild = parent->children + idx + 1;
+
+    // Move rest of children to the right to make space for the new child.
+    memmove(rchild + 1, rchild, (parent->n - idx) * SIZEOF_PTR);
+
+    // Allocate the split node sibling.
+    *rchild = BT_NODE_ALLOC(sizeof(struct BT_MKID(bnode)));
+#ifdef BT_HASH_INDEX
+    (*rchild)->hindex = child->hindex;
+#endif
+
+    // Move half of the elements to the sibling.
+    BT_MKID(bt_node_move)(*rchild, 0, child, BT_FACTOR + 1, BT_FACTOR);
+
+    // If `child` is not a leaf (any of its children are not NULL), copy half of
+    // its children to the new node.
+    if (child->children[0])
+        memcpy((*rchild)->children, child->children + BT_FACTOR + 1, (BT_FACTOR + 1) * SIZEOF_PTR);
+
+    (*rchild)->n = BT_FACTOR;
+    child->n     = BT_FACTOR;
+#ifdef BT_LEARNED
+    child->dirty = true;
+#endif
+#ifdef BT_AUGMENT
+    BT_MKID(bt_node_augment)(child);
+    BT_MKID(bt_node_augment)(*rchild);
+#endif
+#ifdef BT_HASH_INDEX
+    // The caller puts the promoted element in `parent`.
+    BT_MKID(bt_hindex_move)(child->hindex, BT_HASH(BT_KEY_OF(child->elems + BT_FACTOR)), child, parent);
+#endif
+
+    return child->elems[BT_FACTOR];
+
+#undef SIZEOF_PTR
+}
+
+// Inserts `elem` into a btree of root `node`. Returns `true` if `elem` was
+// already present in the tree and, in that case, `prev` will be overwritten
+// with the replaced element from the tree.
+BT_MKFN(bool, bt_node_insert, struct BT_MKID(bnode)* node, BT_ELEM elem, BT_ELEM* prev)
+{
+    ssize_t idx = BT_MKID(bt_node_bsearch)(node, BT_KEY_OF(&elem));
+#ifdef BT_AUGMENT
+    // Adding an element only merges its `aug` into the subtrees above it,
+    // replacing one needs them to be recomputed.
+    BT_AUG_TYPE aug = BT_AUG_OF(&elem);
+#endif
+
+    if (idx >= 0)
+    {
+        if (prev) *prev = node->elems[idx];
+        else BT_ELEM_FREE(node->elems[idx]);
+        BT_MKID(bt_node_put)(node, idx, elem);
+#ifdef BT_LRU
+        node->used[idx] = true;
+#endif
+#ifdef BT_AUGMENT
+        BT_MKID(bt_node_augment)(node);
+#endif
+        return true;
+    }
+
+    idx = -idx - 1;
+    struct BT_MKID(bnode)* child = node->children[idx];
+
+    // Check if `node` is a leaf
+    if (child)
+    {
+        bool replaced = BT_MKID(bt_node_insert)(child, elem, prev);
+        // The insertion did not overflow the child, it's ok to return.
+        if (child->n <= 2 * BT_FACTOR)
+        {
+#ifdef BT_AUGMENT
+            if (replaced) BT_MKID(bt_node_augment)(node);
+            else          node->aug = BT_AUG_MERGE(node->aug, aug);
+#endif
+            return replaced;
+        }
+
+        // The promoted element is what we want to insert in this node (since
+        // it's not a leaf).
+        elem = BT_MKID(bt_split_node)(node, idx);
+    }
+
+    // Make space for the new element, and insert.
+    BT_MKID(bt_node_move)(node, idx + 1, node, idx, node->n - idx);
+
+    // Just insert the element (may be the original element beeing inserted or
+    // the result of a promotion).
+    BT_MKID(bt_node_put)(node, idx, elem);
+    node->n++;
+#ifdef BT_LRU
+    // A promoted element keeps its bit, left behind in the split child.
+    node->used[idx] = child ? child->used[BT_FACTOR] : true;
+#endif
+#ifdef BT_HASH_INDEX
+    if (!child) BT_MKID(bt_hindex_add)(node->hindex, BT_HASH(BT_KEY_OF(&elem)), node);
+#endif
+#ifdef BT_AUGMENT
+    node->aug = BT_AUG_MERGE(node->aug, aug);
+#endif
+
+    return false;
+}
+
+BT_MKFN(bool, bt_insert, struct BT_MKID(bt)* bt, BT_ELEM elem, BT_ELEM* prev)
+{
+    bool replaced = bt->root ? BT_MKID(bt_node_insert)(bt->root, elem, prev) : false;
+    if (!bt->root || bt->root->n > 2 * BT_FACTOR)
+    {
+        struct BT_MKID(bnode) *new_root = BT_NODE_ALLOC(sizeof(struct BT_MKID(bnode)));
+        new_root->n            = 1;
+        new_root->children[0]  = bt->root;
+#ifdef BT_HASH_INDEX
+        new_root->hindex = bt->hindex;
+        if (!bt->root) BT_MKID(bt_hindex_add)(bt->hindex, BT_HASH(BT_KEY_OF(&elem)), new_root);
+#endif
+        BT_MKID(bt_node_put)(new_root, 0, bt->root ? BT_MKID(bt_split_node)(new_root, 0) : elem);
+#ifdef BT_LRU
+        new_root->used[0] = bt->root ? bt->root->used[BT_FACTOR] : true;
+#endif
+#ifdef BT_AUGMENT
+        BT_MKID(bt_node_augment)(new_root);
+#endif
+        bt->root = new_root;
+    }
+    if (!replaced) BT_MKID(bt_added)(bt, BT_KEY_OF(&elem));
+
+    return replaced;
+}
+
+BT_MKFN(void, bt_added, struct BT_MKID(bt)* bt, const BT_KEY* key)
+{
+    bt->size++;
+
+#ifdef BT_LEARNED
+    BT_MKID(bt_learned_changed)(bt);
+#endif
+
+#ifdef BT_BLOOM
+    // Grow the filter once it's holding more keys than it was sized for.
+    if (bt->size * BT_BLOOM_BITS_PER_KEY > bt->bloom_blocks * 512)
+        BT_MKID(bt_bloom_rebuild)(bt);
+    else
+        BT_MKID(bt_bloom_add)(bt, key);
+#else
+    (void)key;
+#endif
+}
+
+BT_MKFN(
+    struct BT_MKID(bnode)*,
+    bt_node_build,
+    const BT_ELEM* elems, size_t n, size_t height, size_t min_children
+) {
+    struct BT_MKID(bnode)* node = BT_NODE_ALLOC(sizeof(struct BT_MKID(bnode)));
+
+    if (height == 1)
+    {
+        for (size_t i = 0; i < n; i++)
+            BT_MKID(bt_node_put)(node, i, elems[i]);
+        node->n = n;
+#ifdef BT_AUGMENT
+        BT_MKID(bt_node_augment)(node);
+#endif
+        return node;
+    }
+
+    // Number of elements in a full subtree of `height - 1` levels.
+    size_t sub = 1;
+    for (size_t h = 1; h < height; h++) sub *= 2 * BT_FACTOR + 1;
+    sub--;
+
+    // Use as few children as possible, so they are as full as possible, and
+    // spread the elements evenly between them. With the fewest children that
+    // fit, every child gets at least the minimum number of elements.
+    size_t k = (n + 1 + sub) / (sub + 1);
+    if (k < min_children) k = min_children;
+    assert(k <= 2 * BT_FACTOR + 1);
+
+    size_t per   = (n - (k - 1)) / k;
+    size_t extra = (n - (k - 1)) % k;
+    for (size_t i = 0; i < k; i++)
+    {
+        size_t m = per + (i < extra);
+        node->children[i] = BT_MKID(bt_node_build)(elems, m, height - 1, BT_FACTOR + 1);
+        elems += m;
+        if (i + 1 < k) BT_MKID(bt_node_put)(node, i, *elems++);
+    }
+    node->n = k - 1;
+#ifdef BT_AUGMENT
+    BT_MKID(bt_node_augment)(node);
+#endif
+    return node;
+}
+
+BT_MKFN(void, bt_bulk_load, struct BT_MKID(bt)* bt, const BT_ELEM* elems, size_t n)
+{
+    assert(!bt->root);
+    if (!n) return;
+
+    // The smallest height that can hold all elements.
+    size_t height = 1;
+    size_t full   = 2 * BT_FACTOR;
+    while (full < n)
+    {
+        full = full * (2 * BT_FACTOR + 1) + 2 * BT_FACTOR;
+        height++;
+    }
+
+    bt->root = BT_MKID(bt_node_build)(elems, n, height, 2);
+    bt->size = n;
+
+#ifdef BT_BLOOM
+    BT_MKID(bt_bloom_rebuild)(bt);
+#endif
+#ifdef BT_LEARNED
+    BT_MKID(bt_learned_build)(bt);
+#endif
+#ifdef BT_HASH_INDEX
+    BT_MKID(bt_hindex_fill)(bt->hindex, bt->root);
+#endif
+}
+
+// Fixes the child at `idx` of `parent` after it was left with `BT_FACTOR - 1`
+// elements, either by borrowing an element from one of its siblings or by
+// merging it with one of them. In the latter case `parent` loses an element,
+// and may be left with too few elements itself.
+BT_MKFN(void, bt_rebalance_node, struct BT_MKID(bnode)* parent, size_t idx)
+{
+#define SIZEOF_PTR sizeof(void*)
+
+    struct BT_MKID(bnode)* child = parent->children[idx];
+    struct BT_MKID(bnode)* left  = idx > 0         ? parent->children[idx - 1] : NULL;
+    struct BT_MKID(bnode)* right = idx < parent->n ? parent->children[idx + 1] : NULL;
+
+    if (left && left->n > BT_FACTOR)
+    {
+        // Rotate right: the separator goes down to `child` and the last
+        // element of `left` takes its place. The last child of `left` goes
+        // along with it (all of them are NULL if these are leaves).
+        BT_MKID(bt_node_move)(child, 1, child, 0, child->n);
+        memmove(child->children + 1, child->children, (child->n + 1) * SIZEOF_PTR);
+        BT_MKID(bt_node_move)(child, 0, parent, idx - 1, 1);
+        BT_MKID(bt_node_move)(parent, idx - 1, left, left->n - 1, 1);
+        child->children[0] = left->children[left->n];
+        child->n++;
+        left->n--;
+#ifdef BT_AUGMENT
+        BT_MKID(bt_node_augment)(left);
+        BT_MKID(bt_node_augment)(child);
+#endif
+    }
+    else if (right && right->n > BT_FACTOR)
+    {
+        // Rotate left: the mirror of the above.
+        BT_MKID(bt_node_move)(child, child->n, parent, idx, 1);
+        BT_MKID(bt_node_move)(parent, idx, right, 0, 1);
+        BT_MKID(bt_node_move)(right, 0, right, 1, right->n - 1);
+        child->children[child->n + 1] = right->children[0];
+        memmove(right->children, right->children + 1, right->n * SIZEOF_PTR);
+        child->n++;
+        right->n--;
+#ifdef BT_AUGMENT
+        BT_MKID(bt_node_augment)(right);
+        BT_MKID(bt_node_augment)(child);
+#endif
+    }
+    else
+    {
+        // Neither sibling can spare an element, so merge `child` with one of
+        // them and the separator between them. That's at most
+        // (BT_FACTOR - 1) + 1 + BT_FACTOR elements, which fits.
+        if (left)
+        {
+            right = child;
+            idx--;
+        }
+        else
+        {
+            left = child;
+        }
+
+        BT_MKID(bt_node_move)(left, left->n, parent, idx, 1);
+        BT_MKID(bt_node_move)(left, left->n + 1, right, 0, right->n);
+        memcpy(left->children + left->n + 1, right->children, (right->n + 1) * SIZEOF_PTR);
+        left->n += right->n + 1;
+        BT_NODE_FREE(right);
+#ifdef BT_AUGMENT
+        BT_MKID(bt_node_augment)(left);
+#endif
+
+        BT_MKID(bt_node_move)(parent, idx, parent, idx + 1, parent->n - idx - 1);
+        memmove(parent->children + idx + 1, parent->children + idx + 2, (parent->n - idx - 1) * SIZEOF_PTR);
+        parent->n--;
+    }
+
+#undef SIZEOF_PTR
+}
+
+BT_MKFN(bool, bt_node_remove_max, struct BT_MKID(bnode)* node, BT_ELEM* removed)
+{
+    struct BT_MKID(bnode)* child = node->children[node->n];
+    if (!child)
+    {
+        *removed = node->elems[--node->n];
+#ifdef BT_HASH_INDEX
+        // The caller puts it back in another node.
+        BT_MKID(bt_hindex_move)(node->hindex, BT_HASH(BT_KEY_OF(removed)), node, NULL);
+#endif
+#ifdef BT_AUGMENT
+        BT_MKID(bt_node_augment)(node);
+#endif
+#ifdef BT_LRU
+        return node->used[node->n];
+#else
+        return false;
+#endif
+    }
+
+    bool used = BT_MKID(bt_node_remove_max)(child, removed);
+    if (child->n < BT_FACTOR) BT_MKID(bt_rebalance_node)(node, node->n);
+#ifdef BT_AUGMENT
+    BT_MKID(bt_node_augment)(node);
+#endif
+    return used;
+}
+
+// Removes the element with `key` from the btree of root `node`. Returns `true`
+// if it was found and, in that case, `removed` will be overwritten with the
+// removed element.
+BT_MKFN(bool, bt_node_remove, struct BT_MKID(bnode)* node, const BT_KEY* key, BT_ELEM* removed)
+{
+    ssize_t idx = BT_MKID(bt_node_bsearch)(node, key);
+    size_t  i   = idx >= 0 ? (size_t)idx : (size_t)(-idx - 1);
+    struct BT_MKID(bnode)* child = node->children[i];
+
+    if (idx >= 0)
+    {
+        *removed = node->elems[i];
+#ifdef BT_HASH_INDEX
+        BT_MKID(bt_hindex_move)(node->hindex, BT_HASH(key), node, NULL);
+#endif
+
+        // In a leaf, just close the gap.
+        if (!child)
+        {
+            BT_MKID(bt_node_move)(node, i, node, i + 1, node->n - i - 1);
+            node->n--;
+#ifdef BT_AUGMENT
+            BT_MKID(bt_node_augment)(node);
+#endif
+            return true;
+        }
+
+        // Otherwise, the predecessor takes the place of the removed element.
+        BT_ELEM pred;
+        bool used = BT_MKID(bt_node_remove_max)(child, &pred);
+        BT_MKID(bt_node_put)(node, i, pred);
+#ifdef BT_LRU
+        node->used[i] = used;
+#else
+        (void)used;
+#endif
+#ifdef BT_HASH_INDEX
+        BT_MKID(bt_hindex_add)(node->hindex, BT_HASH(BT_KEY_OF(&pred)), node);
+#endif
+    }
+    else
+    {
+        // Reached a leaf without finding it.
+        if (!child) return false;
+        if (!BT_MKID(bt_node_remove)(child, key, removed)) return false;
+    }
+
+    if (child->n < BT_FACTOR) BT_MKID(bt_rebalance_node)(node, i);
+#ifdef BT_AUGMENT
+    BT_MKID(bt_node_augment)(node);
+#endif
+    return true;
+}
+
+BT_MKFN(bool, bt_remove, struct BT_MKID(bt)* bt, const BT_KEY* key, BT_ELEM* removed)
+{
+    BT_ELEM elem;
+    if (!bt->root || !BT_MKID(bt_node_remove)(bt->root, key, &elem)) return false;
+
+    // The root may be left empty after a merge of its last two children, the
+    // merged node becomes the new root. If it was a leaf, the tree is empty.
+    if (!bt->root->n)
+    {
+        struct BT_MKID(bnode)* old_root = bt->root;
+        bt->root = old_root->children[0];
+        BT_NODE_FREE(old_root);
+    }
+
+    if (removed) *removed = elem;
+    else BT_ELEM_FREE(elem);
+
+#ifdef BT_CACHE
+    // Merges may have freed nodes the cache points to. On the unlikely
+    // wraparound, entries of old epochs must be cleared by hand.
+    if (!++bt->cache_epoch)
+    {
+        memset(bt->cache, 0, BT_CACHE_SIZE * sizeof(struct BT_MKID(bt_cache_entry)));
+        bt->cache_epoch = 1;
+    }
+#endif
+
+    bt->size--;
+
+#ifdef BT_LEARNED
+    // Rotations and merges move elements between leaves and free them.
+    bt->learned.valid = false;
+    BT_MKID(bt_learned_changed)(bt);
+#endif
+
+    return true;
+}
+
+#ifdef BT_BLOOM
+
+// Each key sets one bit in each of the 8 words of its block. The bit in each
+// word is picked by multiplying the low half of the hash by a different odd
+// constant, as in split block bloom filters.
+static const uint32_t BT_MKID(bt_bloom_salt)[8] = {
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+    0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u,
+};
+
+BT_MKFN(bool, bt_bloom_test, const struct BT_MKID(bt)* bt, const BT_KEY* key)
+{
+    uint64_t h = BT_HASH(key);
+    const uint64_t* block = bt->bloom + 8 * (((h >> 32) * bt->bloom_blocks) >> 32);
+    for (size_t i = 0; i < 8; i++)
+        if (!(block[i] >> (((uint32_t)h * BT_MKID(bt_bloom_salt)[i]) >> 26) & 1))
+            return false;
+    return true;
+}
+
+BT_MKFN(void, bt_bloom_add, struct BT_MKID(bt)* bt, const BT_KEY* key)
+{
+    uint64_t h = BT_HASH(key);
+    uint64_t* block = bt->bloom + 8 * (((h >> 32) * bt->bloom_blocks) >> 32);
+    for (size_t i = 0; i < 8; i++)
+        block[i] |= 1ull << (((uint32_t)h * BT_MKID(bt_bloom_salt)[i]) >> 26);
+}
+
+BT_MKFN(void, bt_bloom_rebuild, struct BT_MKID(bt)* bt)
+{
+    size_t bits = 2 * (bt->size > 64 ? bt->size : 64) * BT_BLOOM_BITS_PER_KEY;
+    free(bt->bloom);
+    bt->bloom_blocks = (bits + 511) / 512;
+    bt->bloom = aligned_alloc(64, bt->bloom_blocks * 64);
+    memset(bt->bloom, 0, bt->bloom_blocks * 64);
+
+    struct BT_MKID(bt_iter_dfs) iter = BT_MKID(bt_iter_dfs_mk)(bt);
+    BT_ELEM* elem;
+    while ((elem = BT_MKID(bt_iter_dfs_next)(&iter)))
+        BT_MKID(bt_bloom_add)(bt, BT_KEY_OF(elem));
+}
+
+#endif
+
+#ifdef BT_LEARNED
+
+BT_MKFN(
+    bool,
+    bt_learned_lookup,
+    const struct BT_MKID(bt)* bt, const BT_KEY* key, BT_ELEM** elem, struct BT_MKID(bnode)** node
+) {
+    const struct BT_MKID(bt_learned)* l = &bt->learned;
+    if (!l->valid) return false;
+
+    // Index of the leaf, the number of separators less than `key`.
+    size_t j = 0;
+    if (l->m > 1)
+    {
+        // Find the segment of the spline and interpolate.
+        double x = BT_LEARNED_POS(key);
+        size_t left  = 0;
+        size_t right = l->knots - 1;
+        while (right - left > 1)
+        {
+            size_t mid = left + (right - left) / 2;
+            if (l->knot[mid].x <= x) left  = mid;
+            else                     right = mid;
+        }
+        const struct BT_MKID(bt_knot)* a = l->knot + left;
+        const struct BT_MKID(bt_knot)* b = l->knot + right;
+        double y = a->y;
+        if (x >= b->x)     y = b->y;
+        else if (x > a->x) y = a->y + (x - a->x) * (b->y - a->y) / (b->x - a->x);
+
+        // The model is off by at most `BT_LEARNED_ERROR` for the separators,
+        // and a key between two separators is predicted between them.
+        double lo = y - BT_LEARNED_ERROR - 1;
+        double hi = y + BT_LEARNED_ERROR + 2;
+        size_t nfences = l->m - 1;
+        size_t wlo = lo < 0 ? 0 : lo > nfences ? nfences : (size_t)lo;
+        size_t whi = hi < 0 ? 0 : hi > nfences ? nfences : (size_t)hi;
+
+        left  = wlo;
+        right = whi;
+        while (left < right)
+        {
+            size_t mid = left + (right - left) / 2;
+            if (BT_CMP(key, l->fences + mid) > 0) left  = mid + 1;
+            else                                  right = mid;
+        }
+        j = left;
+
+        // Make sure the answer wasn't cut short by the window, which can happen
+        // if `BT_LEARNED_POS` isn't precise enough.
+        if (j == wlo && wlo > 0 && BT_CMP(key, l->fences + wlo - 1) <= 0) return false;
+        if (j == whi && whi < nfences && BT_CMP(key, l->fences + whi) > 0) return false;
+
+        // Separators live in inner nodes.
+        if (j < nfences && !BT_CMP(key, l->fences + j)) return false;
+    }
+
+    struct BT_MKID(bnode)* leaf = l->leaves[j];
+    ssize_t idx = BT_MKID(bt_node_bsearch)(leaf, key);
+    if (idx < 0 && leaf->dirty) return false;
+
+    *elem = idx >= 0 ? leaf->elems + idx : NULL;
+    *node = leaf;
+    return true;
+}
+
+BT_MKFN(void, bt_learned_collect, struct BT_MKID(bt_learned)* l, struct BT_MKID(bnode)* node)
+{
+    if (!node->children[0])
+    {
+        node->dirty = false;
+        l->leaves[l->m++] = node;
+        return;
+    }
+
+    for (size_t i = 0; i <= node->n; i++)
+    {
+        BT_MKID(bt_learned_collect)(l, node->children[i]);
+        if (i < node->n) l->fences[l->m - 1] = *BT_KEY_OF(node->elems + i);
+    }
+}
+
+BT_MKFN(void, bt_learned_build, struct BT_MKID(bt)* bt)
+{
+    struct BT_MKID(bt_learned)* l = &bt->learned;
+    free(l->leaves);
+    free(l->fences);
+    free(l->knot);
+    memset(l, 0, sizeof(*l));
+    if (!bt->root) return;
+
+    // Every leaf has at least `BT_FACTOR` elements, and the root at least 1.
+    size_t max_leaves = bt->size / BT_FACTOR + 1;
+    l->leaves = malloc(max_leaves * sizeof(*l->leaves));
+    l->fences = malloc(max_leaves * sizeof(*l->fences));
+    BT_MKID(bt_learned_collect)(l, bt->root);
+
+    // Greedy spline corridor (Neumann and Michel, "Smooth Interpolating
+    // Histograms with Error Guarantees"): extend the current segment while
+    // some line from its first knot passes within `BT_LEARNED_ERROR` of every
+    // point, otherwise start a new segment at the previous point.
+    size_t n = l->m - 1;
+    l->knot = malloc((n + 2) * sizeof(*l->knot));
+    if (n)
+    {
+        struct BT_MKID(bt_knot) knot = { BT_LEARNED_POS(l->fences), 0 };
+        struct BT_MKID(bt_knot) prev = knot;
+        double hi = 0, lo = 0;
+        bool open = false;
+        l->knot[l->knots++] = knot;
+
+        for (size_t i = 1; i < n; i++)
+        {
+            struct BT_MKID(bt_knot) p = { BT_LEARNED_POS(l->fences + i), (double)i };
+            // Positions that didn't advance (imprecise `BT_LEARNED_POS`) are
+            // left for the window checks in `bt_learned_lookup`.
+            if (p.x <= prev.x) continue;
+
+            double dx    = p.x - knot.x;
+            double slope = (p.y - knot.y) / dx;
+            if (open && (slope > hi || slope < lo))
+            {
+                knot = prev;
+                l->knot[l->knots++] = knot;
+                dx    = p.x - knot.x;
+                open  = false;
+            }
+
+            double up   = (p.y + BT_LEARNED_ERROR - knot.y) / dx;
+            double down = (p.y - BT_LEARNED_ERROR - knot.y) / dx;
+            if (!open || up   < hi) hi = up;
+            if (!open || down > lo) lo = down;
+            open = true;
+            prev = p;
+        }
+
+        if (prev.x > knot.x) l->knot[l->knots++] = prev;
+    }
+    if (l->knots < 2)
+    {
+        // A single point, make it a flat segment.
+        l->knot[1] = l->knots ? l->knot[0] : (struct BT_MKID(bt_knot)) { 0, 0 };
+        l->knot[0] = l->knot[1];
+        l->knots   = 2;
+    }
+
+    l->valid = true;
+}
+
+BT_MKFN(void, bt_learned_changed, struct BT_MKID(bt)* bt)
+{
+    if (++bt->learned.changes > bt->size / BT_LEARNED_REFRESH)
+        BT_MKID(bt_learned_build)(bt);
+}
+
+#endif
+
+#ifdef BT_HASH_INDEX
+
+BT_MKFN(
+    BT_ELEM*,
+    bt_hindex_lookup,
+    const struct BT_MKID(bt_hindex)* hx, const BT_KEY* key, struct BT_MKID(bnode)** node
+) {
+    if (!hx->slots) return NULL;
+
+    // Different keys may have the same hash, so keep probing until the key is
+    // found in the node of a slot.
+    uint64_t hash = BT_HASH(key);
+    for (size_t i = hash & hx->mask; hx->slots[i].node; i = (i + 1) & hx->mask)
+    {
+        if (hx->slots[i].hash != hash) continue;
+        ssize_t idx = BT_MKID(bt_node_bsearch)(hx->slots[i].node, key);
+        if (idx >= 0)
+        {
+            *node = hx->slots[i].node;
+            return (*node)->elems + idx;
+        }
+    }
+    return NULL;
+}
+
+BT_MKFN(void, bt_hindex_add, struct BT_MKID(bt_hindex)* hx, uint64_t hash, struct BT_MKID(bnode)* node)
+{
+    if (2 * (hx->count + 1) > (hx->slots ? hx->mask + 1 : 0))
+    {
+        // Double the table, slots keep their hash so there's no need to
+        // hash the keys again.
+        size_t old = hx->slots ? hx->mask + 1 : 0;
+        struct BT_MKID(bt_hindex_slot)* slots = hx->slots;
+        size_t capacity = old ? 2 * old : 16;
+        hx->slots = calloc(capacity, sizeof(struct BT_MKID(bt_hindex_slot)));
+        hx->mask  = capacity - 1;
+        hx->count = 0;
+        for (size_t i = 0; i < old; i++)
+            if (slots[i].node) BT_MKID(bt_hindex_add)(hx, slots[i].hash, slots[i].node);
+        free(slots);
+    }
+
+    size_t i = hash & hx->mask;
+    while (hx->slots[i].node) i = (i + 1) & hx->mask;
+    hx->slots[i].hash = hash;
+    hx->slots[i].node = node;
+    hx->count++;
+}
+
+BT_MKFN(
+    void,
+    bt_hindex_move,
+    struct BT_MKID(bt_hindex)* hx, uint64_t hash, const struct BT_MKID(bnode)* from, struct BT_MKID(bnode)* to
+) {
+    // Slots with the same hash and node are interchangeable, any of them will
+    // do.
+    size_t i = hash & hx->mask;
+    while (hx->slots[i].hash != hash || hx->slots[i].node != from)
+    {
+        assert(hx->slots[i].node);
+        i = (i + 1) & hx->mask;
+    }
+
+    if (to)
+    {
+        hx->slots[i].node = to;
+        return;
+    }
+
+    // Remove without tombstones: shift back the following slots of the
+    // cluster that can't be reached from their home slot anymore.
+    for (size_t j = (i + 1) & hx->mask; hx->slots[j].node; j = (j + 1) & hx->mask)
+    {
+        size_t home = hx->slots[j].hash & hx->mask;
+        if (((j - home) & hx->mask) >= ((j - i) & hx->mask))
+        {
+            hx->slots[i] = hx->slots[j];
+            i = j;
+        }
+    }
+    hx->slots[i].node = NULL;
+    hx->count--;
+}
+
+BT_MKFN(void, bt_hindex_fill, struct BT_MKID(bt_hindex)* hx, struct BT_MKID(bnode)* node)
+{
+    if (!node) return;
+    node->hindex = hx;
+    for (size_t i = 0; i < node->n; i++)
+    {
+        BT_MKID(bt_hindex_add)(hx, BT_HASH(BT_KEY_OF(node->elems + i)), node);
+        BT_MKID(bt_hindex_fill)(hx, node->children[i]);
+    }
+    BT_MKID(bt_hindex_fill)(hx, node->children[node->n]);
+}
+
+#endif
+
+#ifdef BT_INTERVAL
+
+BT_MKFN(
+    void,
+    bt_interval_overlaps,
+    struct BT_MKID(bt)* bt, const BT_KEY* a, const BT_KEY* b, BT_MKID(bt_interval_fn) fn, void* ctx
+) {
+    if (bt->root) BT_MKID(bt_interval_node)(bt->root, a, b, fn, ctx);
+}
+
+BT_MKFN(
+    bool,
+    bt_interval_node,
+    struct BT_MKID(bnode)* node, const BT_KEY* a, const BT_KEY* b, BT_MKID(bt_interval_fn) fn, void* ctx
+) {
+    // Every interval in this subtree ends before `a`.
+    if (BT_CMP(&node->aug, a) < 0) return true;
+
+    for (size_t i = 0; i < node->n; i++)
+    {
+        if (node->children[i] && !BT_MKID(bt_interval_node)(node->children[i], a, b, fn, ctx))
+            return false;
+
+        // Keys only grow from here, none of them overlaps anymore.
+        BT_ELEM* elem = node->elems + i;
+        if (BT_CMP(BT_KEY_OF(elem), b) > 0) return false;
+        if (BT_CMP(BT_INTERVAL_END(elem), a) >= 0 && !fn(elem, ctx)) return false;
+    }
+
+    return !node->children[node->n] || BT_MKID(bt_interval_node)(node->children[node->n], a, b, fn, ctx);
+}
+
+#endif
+
+#ifdef BT_TTL
+
+BT_MKFN(size_t, bt_expire, struct BT_MKID(bt)* bt, BT_TTL_TYPE now, size_t budget)
+{
+    size_t removed = 0;
+    while (removed < budget && bt->root)
+    {
+        BT_ELEM* elem = BT_MKID(bt_ttl_find)(bt->root, now);
+        if (!elem) break;
+
+        // Removals rebalance the tree, so find each element from the root.
+        BT_KEY key = *BT_KEY_OF(elem);
+        BT_MKID(bt_remove)(bt, &key, NULL);
+        removed++;
+    }
+    return removed;
+}
+
+BT_MKFN(BT_ELEM*, bt_ttl_find, struct BT_MKID(bnode)* node, BT_TTL_TYPE now)
+{
+    // Only descend into subtrees where something expired.
+    while (!(now < node->aug))
+    {
+        struct BT_MKID(bnode)* next = NULL;
+        for (size_t i = 0; i < node->n; i++)
+        {
+            if (!(now < BT_AUG_OF(node->elems + i))) return node->elems + i;
+            if (!next && node->children[i] && !(now < node->children[i]->aug)) next = node->children[i];
+        }
+        if (!next) next = node->children[node->n];
+        if (!next) return NULL;
+        node = next;
+    }
+    return NULL;
+}
+
+#endif
+
+BT_MKFN(struct BT_MKID(bt_iter_dfs), bt_iter_dfs_mk, struct BT_MKID(bt)* btree)
+{
+    return (struct BT_MKID(bt_iter_dfs)) {
+        .top = 1,
+        .stack = {
+            [0] = {
+                .i = 0,
+                .node = btree->root
+            }
+        },
+    };
+}
+
+BT_MKFN(struct BT_MKID(bt_iter_dfs), bt_iter_dfs_seek, struct BT_MKID(bt)* btree, const BT_KEY* key)
+{
+    struct BT_MKID(bt_iter_dfs) iter = BT_MKID(bt_iter_dfs_mk)(btree);
+    struct BT_MKID(bt_iter_frame)* fp = iter.stack;
+    while (fp->node)
+    {
+        ssize_t idx = BT_MKID(bt_node_bsearch)(fp->node, key);
+        if (idx >= 0)
+        {
+            fp->i = idx;
+            // The next element is this one, but `bt_iter_dfs_next` would
+            // first visit its left subtree. Push that subtree as a frame that
+            // was already fully visited.
+            struct BT_MKID(bnode)* child = fp->node->children[idx];
+            if (child)
+            {
+                fp++;
+                fp->node = child;
+                fp->i    = child->n + 1;
+                iter.top++;
+            }
+            return iter;
+        }
+
+        // Frames of inner nodes point to the child that is being visited, so
+        // once it's done, the element to its right comes next.
+        fp->i = -idx - 1;
+        struct BT_MKID(bnode)* child = fp->node->children[fp->i];
+        if (!child) break;
+
+        fp++;
+        fp->node = child;
+        fp->i    = 0;
+        iter.top++;
+    }
+    return iter;
+}
+
+BT_MKFN(BT_ELEM*, bt_iter_dfs_next, struct BT_MKID(bt_iter_dfs)* iter)
+{
+    // The frame pointer.
+    struct BT_MKID(bt_iter_frame)* fp = iter->stack + iter->top - 1;
+    bool visited_child = false;
+    while (true)
+    {
+        if (!fp->node) return NULL;
+
+        if (fp->i > fp->node->n)
+        {
+            // If already at the bottom of the stack, we're done! We don't want
+            // to make the stack empty because in successive calls the caller
+            // may expect to receive `NULL` every time.
+            if (iter->top == 1) return NULL;
+
+            // Pops a frame from the stack and yields a value if it can.
+            iter->top--;
+            fp--;
+
+            // Mark that we just came back from visiting the ith child.
+            visited_child = true;
+        }
+        else if (fp->node->children[fp->i] && !visited_child)
+        {
+            // Pushes a frame in the stack.
+            struct BT_MKID(bt_iter_frame)* new_fp = fp + 1;
+            iter->top++;
+            new_fp->i = 0;
+            new_fp->node = fp->node->children[fp->i];
+            fp = new_fp;
+        }
+        else if (fp->i < fp->node->n)
+        {
+            return fp->node->elems + fp->i++;
+        }
+        else
+        {
+            fp->i++;
+        }
+    }
+}
+
+#ifdef BT_RADIX
+
+BT_MKFN(struct BT_MKID(bt_radix), bt_radix_mk,)
+{
+    struct BT_MKID(bt_radix) radix = { .span = 0, .bits = 0, .size = 0 };
+    radix.parts    = malloc(sizeof(struct BT_MKID(bt)));
+    radix.parts[0] = BT_MKID(bt_mk)();
+    return radix;
+}
+
+BT_MKFN(void, bt_radix_free, struct BT_MKID(bt_radix) radix)
+{
+    for (size_t i = 0; i < (size_t)1 << radix.bits; i++)
+        BT_MKID(bt_free)(radix.parts[i]);
+    free(radix.parts);
+}
+
+BT_MKFN(size_t, bt_radix_part, const struct BT_MKID(bt_radix)* radix, uint64_t key)
+{
+    return radix->bits ? key >> (radix->span - radix->bits) : 0;
+}
+
+BT_MKFN(void, bt_radix_repartition, struct BT_MKID(bt_radix)* radix, unsigned span, unsigned bits)
+{
+    // Gather every element in order, then bulk load each range of them that
+    // falls in the same new partition.
+    BT_ELEM* elems = malloc(radix->size * sizeof(BT_ELEM));
+    size_t n = 0;
+    for (size_t i = 0; i < (size_t)1 << radix->bits; i++)
+    {
+        BT_MKID(bt_collect)(radix->parts + i, elems + n);
+        n += radix->parts[i].size;
+        BT_MKID(bt_release)(radix->parts[i]);
+    }
+    free(radix->parts);
+
+    radix->span  = span;
+    radix->bits  = bits;
+    radix->parts = malloc(((size_t)1 << bits) * sizeof(struct BT_MKID(bt)));
+
+    size_t start = 0;
+    for (size_t i = 0; i < (size_t)1 << bits; i++)
+    {
+        size_t end = start;
+        while (end < n && BT_MKID(bt_radix_part)(radix, BT_RADIX_KEY(BT_KEY_OF(elems + end))) == i) end++;
+        radix->parts[i] = BT_MKID(bt_mk)();
+        BT_MKID(bt_bulk_load)(radix->parts + i, elems + start, end - start);
+        start = end;
+    }
+    // Partitions are loaded in order, so a key whose partition goes backwards
+    // would stop the loop before the rest of the elements.
+    assert(start == n);
+
+    free(elems);
+}
+
+BT_MKFN(BT_ELEM*, bt_radix_lookup, const struct BT_MKID(bt_radix)* radix, const BT_KEY* key)
+{
+    uint64_t k = BT_RADIX_KEY(key);
+    if (radix->span < 64 && k >> radix->span) return NULL;
+    return BT_MKID(bt_lookup)(radix->parts + BT_MKID(bt_radix_part)(radix, k), key);
+}
+
+BT_MKFN(bool, bt_radix_insert, struct BT_MKID(bt_radix)* radix, BT_ELEM elem, BT_ELEM* prev)
+{
+    uint64_t k = BT_RADIX_KEY(BT_KEY_OF(&elem));
+    if (radix->span < 64 && k >> radix->span)
+    {
+        // Widen the range of every partition to fit the key.
+        unsigned span = radix->span;
+        while (span < 64 && k >> span) span++;
+        BT_MKID(bt_radix_repartition)(radix, span, radix->bits);
+    }
+
+    bool replaced = BT_MKID(bt_insert)(radix->parts + BT_MKID(bt_radix_part)(radix, k), elem, prev);
+    if (replaced) return true;
+
+    radix->size++;
+    if (radix->size > (size_t)BT_RADIX_FILL << radix->bits
+        && radix->bits < radix->span
+        && radix->bits < BT_RADIX_MAX_BITS)
+        BT_MKID(bt_radix_repartition)(radix, radix->span, radix->bits + 1);
+
+    return false;
+}
+
+BT_MKFN(bool, bt_radix_remove, struct BT_MKID(bt_radix)* radix, const BT_KEY* key, BT_ELEM* removed)
+{
+    uint64_t k = BT_RADIX_KEY(key);
+    if (radix->span < 64 && k >> radix->span) return false;
+    if (!BT_MKID(bt_remove)(radix->parts + BT_MKID(bt_radix_part)(radix, k), key, removed)) return false;
+    radix->size--;
+    return true;
+}
+
+BT_MKFN(struct BT_MKID(bt_radix_iter), bt_radix_iter_mk, struct BT_MKID(bt_radix)* radix)
+{
+    return (struct BT_MKID(bt_radix_iter)) {
+        .radix = radix,
+        .part  = 0,
+        .iter  = BT_MKID(bt_iter_dfs_mk)(radix->parts),
+    };
+}
+
+BT_MKFN(struct BT_MKID(bt_radix_iter), bt_radix_iter_seek, struct BT_MKID(bt_radix)* radix, const BT_KEY* key)
+{
+    uint64_t k = BT_RADIX_KEY(key);
+    size_t last = ((size_t)1 << radix->bits) - 1;
+
+    // Past every key, seek in the last partition, which will find nothing.
+    size_t part = radix->span < 64 && k >> radix->span ? last : BT_MKID(bt_radix_part)(radix, k);
+    return (struct BT_MKID(bt_radix_iter)) {
+        .radix = radix,
+        .part  = part,
+        .iter  = BT_MKID(bt_iter_dfs_seek)(radix->parts + part, key),
+    };
+}
+
+BT_MKFN(BT_ELEM*, bt_radix_iter_next, struct BT_MKID(bt_radix_iter)* iter)
+{
+    size_t parts = (size_t)1 << iter->radix->bits;
+    while (true)
+    {
+        BT_ELEM* elem = BT_MKID(bt_iter_dfs_next)(&iter->iter);
+        if (elem || iter->part + 1 >= parts) return elem;
+        iter->part++;
+        iter->iter = BT_MKID(bt_iter_dfs_mk)(iter->radix->parts + iter->part);
+    }
+}
+
+#endif
+
+#ifdef BT_SHARDS
+
+BT_MKFN(void, bt_shards_init, struct BT_MKID(bt_shards)* shards, size_t target)
+{
+    pthread_rwlock_init(&shards->lock, NULL);
+    shards->target    = target ? target : 1;
+    shards->count     = 1;
+    shards->lows      = malloc(sizeof(BT_KEY));
+    shards->shards    = malloc(sizeof(struct BT_MKID(bt_shard)*));
+    shards->shards[0] = malloc(sizeof(struct BT_MKID(bt_shard)));
+    pthread_mutex_init(&shards->shards[0]->lock, NULL);
+    shards->shards[0]->tree = BT_MKID(bt_mk)();
+    atomic_init(&shards->shards[0]->size, 0);
+    atomic_init(&shards->size, 0);
+}
+
+BT_MKFN(void, bt_shards_destroy, struct BT_MKID(bt_shards)* shards)
+{
+    for (size_t i = 0; i < shards->count; i++)
+    {
+        pthread_mutex_destroy(&shards->shards[i]->lock);
+        BT_MKID(bt_free)(shards->shards[i]->tree);
+        free(shards->shards[i]);
+    }
+    free(shards->shards);
+    free(shards->lows);
+    pthread_rwlock_destroy(&shards->lock);
+}
+
+BT_MKFN(size_t, bt_shards_find, const struct BT_MKID(bt_shards)* shards, const BT_KEY* key)
+{
+    // The last shard whose low bound is not greater than `key`.
+    size_t left  = 1;
+    size_t right = shards->count;
+    while (left < right)
+    {
+        size_t mid = left + (right - left) / 2;
+        if (BT_CMP(key, shards->lows + mid) >= 0) left  = mid + 1;
+        else                                      right = mid;
+    }
+    return left - 1;
+}
+
+BT_MKFN(size_t, bt_shards_max, struct BT_MKID(bt_shards)* shards)
+{
+    size_t fair = 2 * atomic_load(&shards->size) / shards->target;
+    return fair > BT_SHARDS_MIN ? fair : BT_SHARDS_MIN;
+}
+
+BT_MKFN(bool, bt_shards_insert, struct BT_MKID(bt_shards)* shards, BT_ELEM elem, BT_ELEM* prev)
+{
+    pthread_rwlock_rdlock(&shards->lock);
+    struct BT_MKID(bt_shard)* shard = shards->shards[BT_MKID(bt_shards_find)(shards, BT_KEY_OF(&elem))];
+
+    pthread_mutex_lock(&shard->lock);
+    bool replaced = BT_MKID(bt_insert)(&shard->tree, elem, prev);
+    size_t size   = shard->tree.size;
+    atomic_store_explicit(&shard->size, size, memory_order_relaxed);
+    pthread_mutex_unlock(&shard->lock);
+
+    if (!replaced) atomic_fetch_add(&shards->size, 1);
+    bool split = size > BT_MKID(bt_shards_max)(shards);
+    pthread_rwlock_unlock(&shards->lock);
+
+    if (split) BT_MKID(bt_shards_rebalance)(shards, BT_KEY_OF(&elem));
+    return replaced;
+}
+
+BT_MKFN(bool, bt_shards_remove, struct BT_MKID(bt_shards)* shards, const BT_KEY* key, BT_ELEM* removed)
+{
+    pthread_rwlock_rdlock(&shards->lock);
+    size_t i = BT_MKID(bt_shards_find)(shards, key);
+    struct BT_MKID(bt_shard)* shard = shards->shards[i];
+
+    pthread_mutex_lock(&shard->lock);
+    bool found  = BT_MKID(bt_remove)(&shard->tree, key, removed);
+    size_t size = shard->tree.size;
+    atomic_store_explicit(&shard->size, size, memory_order_relaxed);
+    pthread_mutex_unlock(&shard->lock);
+
+    // Sizes of the neighbours may be stale, it's only a hint.
+    bool merge = false;
+    if (found)
+    {
+        atomic_fetch_sub(&shards->size, 1);
+        size_t limit = BT_MKID(bt_shards_max)(shards) / 4;
+        merge = (i > 0 && size + atomic_load_explicit(&shards->shards[i - 1]->size, memory_order_relaxed) < limit)
+             || (i + 1 < shards->count
+                 && size + atomic_load_explicit(&shards->shards[i + 1]->size, memory_order_relaxed) < limit);
+    }
+    pthread_rwlock_unlock(&shards->lock);
+
+    if (merge) BT_MKID(bt_shards_rebalance)(shards, key);
+    return found;
+}
+
+BT_MKFN(bool, bt_shards_lookup, struct BT_MKID(bt_shards)* shards, const BT_KEY* key, BT_ELEM* elem)
+{
+    pthread_rwlock_rdlock(&shards->lock);
+    struct BT_MKID(bt_shard)* shard = shards->shards[BT_MKID(bt_shards_find)(shards, key)];
+
+    pthread_mutex_lock(&shard->lock);
+    BT_ELEM* found = BT_MKID(bt_lookup)(&shard->tree, key);
+    if (found) *elem = *found;
+    pthread_mutex_unlock(&shard->lock);
+
+    pthread_rwlock_unlock(&shards->lock);
+    return found;
+}
+
+BT_MKFN(
+    void,
+    bt_shards_scan,
+    struct BT_MKID(bt_shards)* shards, const BT_KEY* lo, const BT_KEY* hi, BT_MKID(bt_shards_fn) fn, void* ctx
+) {
+    pthread_rwlock_rdlock(&shards->lock);
+
+    bool done = false;
+    for (size_t i = lo ? BT_MKID(bt_shards_find)(shards, lo) : 0; !done && i < shards->count; i++)
+    {
+        if (hi && i > 0 && BT_CMP(shards->lows + i, hi) >= 0) break;
+
+        struct BT_MKID(bt_shard)* shard = shards->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        struct BT_MKID(bt_iter_dfs) iter = lo ? BT_MKID(bt_iter_dfs_seek)(&shard->tree, lo)
+                                              : BT_MKID(bt_iter_dfs_mk)(&shard->tree);
+        BT_ELEM* elem;
+        while (!done && (elem = BT_MKID(bt_iter_dfs_next)(&iter)))
+            done = (hi && BT_CMP(BT_KEY_OF(elem), hi) >= 0) || !fn(elem, ctx);
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    pthread_rwlock_unlock(&shards->lock);
+}
+
+BT_MKFN(void, bt_shards_rebalance, struct BT_MKID(bt_shards)* shards, const BT_KEY* key)
+{
+    pthread_rwlock_wrlock(&shards->lock);
+
+    // Other writers may have rebalanced it already.
+    size_t i   = BT_MKID(bt_shards_find)(shards, key);
+    size_t max = BT_MKID(bt_shards_max)(shards);
+    struct BT_MKID(bt_shard)* shard = shards->shards[i];
+    size_t size = shard->tree.size;
+
+    if (size > max)
+    {
+        // Split it in halves, the first key of the right one is its low bound.
+        BT_ELEM* elems = malloc(size * sizeof(BT_ELEM));
+        BT_MKID(bt_collect)(&shard->tree, elems);
+        BT_MKID(bt_release)(shard->tree);
+
+        struct BT_MKID(bt_shard)* right = malloc(sizeof(struct BT_MKID(bt_shard)));
+        pthread_mutex_init(&right->lock, NULL);
+        shard->tree = BT_MKID(bt_mk)();
+        right->tree = BT_MKID(bt_mk)();
+        BT_MKID(bt_bulk_load)(&shard->tree, elems, size / 2);
+        BT_MKID(bt_bulk_load)(&right->tree, elems + size / 2, size - size / 2);
+        atomic_store(&shard->size, shard->tree.size);
+        atomic_store(&right->size, right->tree.size);
+
+        shards->lows   = realloc(shards->lows, (shards->count + 1) * sizeof(BT_KEY));
+        shards->shards = realloc(shards->shards, (shards->count + 1) * sizeof(struct BT_MKID(bt_shard)*));
+        memmove(shards->lows + i + 2, shards->lows + i + 1, (shards->count - i - 1) * sizeof(BT_KEY));
+        memmove(shards->shards + i + 2, shards->shards + i + 1, (shards->count - i - 1) * sizeof(struct BT_MKID(bt_shard)*));
+        shards->lows[i + 1]   = *BT_KEY_OF(elems + size / 2);
+        shards->shards[i + 1] = right;
+        shards->count++;
+        free(elems);
+    }
+    else if (shards->count > 1)
+    {
+        // Merge it with its smallest neighbour, if they're small enough.
+        if (i + 1 == shards->count
+            || (i > 0 && shards->shards[i - 1]->tree.size < shards->shards[i + 1]->tree.size))
+            i--;
+
+        struct BT_MKID(bt_shard)* left  = shards->shards[i];
+        struct BT_MKID(bt_shard)* right = shards->shards[i + 1];
+        size = left->tree.size + right->tree.size;
+        if (size < max / 4)
+        {
+            BT_ELEM* elems = malloc(size * sizeof(BT_ELEM));
+            BT_MKID(bt_collect)(&left->tree, elems);
+            BT_MKID(bt_collect)(&right->tree, elems + left->tree.size);
+            BT_MKID(bt_release)(left->tree);
+            BT_MKID(bt_release)(right->tree);
+            left->tree = BT_MKID(bt_mk)();
+            BT_MKID(bt_bulk_load)(&left->tree, elems, size);
+            atomic_store(&left->size, size);
+            free(elems);
+
+            pthread_mutex_destroy(&right->lock);
+            free(right);
+            memmove(shards->lows + i + 1, shards->lows + i + 2, (shards->count - i - 2) * sizeof(BT_KEY));
+            memmove(shards->shards + i + 1, shards->shards + i + 2, (shards->count - i - 2) * sizeof(struct BT_MKID(bt_shard)*));
+            shards->count--;
+        }
+    }
+
+    pthread_rwlock_unlock(&shards->lock);
+}
+
+#endif
+
+#ifdef BT_RW
+
+BT_MKFN(void, bt_rw_init, struct BT_MKID(bt_rw)* rw)
+{
+    rw->tree = BT_MKID(bt_mk)();
+    for (size_t i = 0; i < BT_RW_SLOTS; i++)
+        pthread_rwlock_init(&rw->slots[i].lock, NULL);
+    pthread_mutex_init(&rw->combiner, NULL);
+    rw->threads   = NULL;
+    rw->nthreads  = 0;
+    rw->batch     = NULL;
+    rw->batch_cap = 0;
+}
+
+BT_MKFN(void, bt_rw_destroy, struct BT_MKID(bt_rw)* rw)
+{
+    while (rw->threads)
+    {
+        struct BT_MKID(bt_rw_thread)* next = rw->threads->next;
+        assert(!rw->threads->n);
+        free(rw->threads);
+        rw->threads = next;
+    }
+    free(rw->batch);
+    pthread_mutex_destroy(&rw->combiner);
+    for (size_t i = 0; i < BT_RW_SLOTS; i++)
+        pthread_rwlock_destroy(&rw->slots[i].lock);
+    BT_MKID(bt_free)(rw->tree);
+}
+
+BT_MKFN(struct BT_MKID(bt_rw_thread)*, bt_rw_register, struct BT_MKID(bt_rw)* rw)
+{
+    struct BT_MKID(bt_rw_thread)* thread = malloc(sizeof(struct BT_MKID(bt_rw_thread)));
+    thread->rw = rw;
+    thread->n     = 0;
+    thread->taken = false;
+    atomic_init(&thread->published, false);
+
+    pthread_mutex_lock(&rw->combiner);
+    thread->slot = rw->nthreads++ % BT_RW_SLOTS;
+    thread->next = rw->threads;
+    rw->threads  = thread;
+    pthread_mutex_unlock(&rw->combiner);
+    return thread;
+}
+
+BT_MKFN(void, bt_rw_insert, struct BT_MKID(bt_rw_thread)* thread, BT_ELEM elem)
+{
+    struct BT_MKID(bt_rw_op)* op = thread->ops + thread->n++;
+    op->remove = false;
+    op->key    = *BT_KEY_OF(&elem);
+    op->elem   = elem;
+    if (thread->n == BT_RW_BATCH) BT_MKID(bt_rw_flush)(thread);
+}
+
+BT_MKFN(void, bt_rw_remove, struct BT_MKID(bt_rw_thread)* thread, const BT_KEY* key)
+{
+    struct BT_MKID(bt_rw_op)* op = thread->ops + thread->n++;
+    op->remove = true;
+    op->key    = *key;
+    if (thread->n == BT_RW_BATCH) BT_MKID(bt_rw_flush)(thread);
+}
+
+BT_MKFN(void, bt_rw_flush, struct BT_MKID(bt_rw_thread)* thread)
+{
+    if (!thread->n) return;
+    struct BT_MKID(bt_rw)* rw = thread->rw;
+
+    // Either become the combiner, or wait for the current one to pick up the
+    // buffer.
+    atomic_store_explicit(&thread->published, true, memory_order_release);
+    while (atomic_load_explicit(&thread->published, memory_order_acquire))
+    {
+        if (!pthread_mutex_trylock(&rw->combiner))
+        {
+            BT_MKID(bt_rw_combine)(rw);
+            pthread_mutex_unlock(&rw->combiner);
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    thread->n = 0;
+}
+
+// Orders operations by key, and then by the order they were buffered in.
+BT_MKFN(int, bt_rw_op_cmp, const void* a, const void* b)
+{
+    const struct BT_MKID(bt_rw_op)* x = a;
+    const struct BT_MKID(bt_rw_op)* y = b;
+    int cmp = BT_CMP(&x->key, &y->key);
+    if (cmp) return cmp;
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+BT_MKFN(void, bt_rw_combine, struct BT_MKID(bt_rw)* rw)
+{
+    size_t n = 0;
+    for (struct BT_MKID(bt_rw_thread)* t = rw->threads; t; t = t->next)
+    {
+        t->taken = atomic_load_explicit(&t->published, memory_order_acquire);
+        if (!t->taken) continue;
+        if (n + t->n > rw->batch_cap)
+        {
+            rw->batch_cap = 2 * (n + t->n);
+            rw->batch     = realloc(rw->batch, rw->batch_cap * sizeof(struct BT_MKID(bt_rw_op)));
+        }
+        for (size_t i = 0; i < t->n; i++)
+        {
+            rw->batch[n] = t->ops[i];
+            rw->batch[n].seq = n;
+            n++;
+        }
+    }
+    if (!n) return;
+
+    // In key order, consecutive descents visit mostly the same nodes.
+    qsort(rw->batch, n, sizeof(struct BT_MKID(bt_rw_op)), BT_MKID(bt_rw_op_cmp));
+
+    for (size_t i = 0; i < BT_RW_SLOTS; i++) pthread_rwlock_wrlock(&rw->slots[i].lock);
+    for (size_t i = 0; i < n; i++)
+    {
+        struct BT_MKID(bt_rw_op)* op = rw->batch + i;
+        if (op->remove) BT_MKID(bt_remove)(&rw->tree, &op->key, NULL);
+        else            BT_MKID(bt_insert)(&rw->tree, op->elem, NULL);
+    }
+    for (size_t i = 0; i < BT_RW_SLOTS; i++) pthread_rwlock_unlock(&rw->slots[i].lock);
+
+    // Only now the threads can reuse their buffers. Others may have been
+    // published meanwhile, they're left for the next combiner.
+    for (struct BT_MKID(bt_rw_thread)* t = rw->threads; t; t = t->next)
+        if (t->taken) atomic_store_explicit(&t->published, false, memory_order_release);
+}
+
+BT_MKFN(void, bt_rw_read_lock, struct BT_MKID(bt_rw_thread)* thread)
+{
+    pthread_rwlock_rdlock(&thread->rw->slots[thread->slot].lock);
+}
+
+BT_MKFN(void, bt_rw_read_unlock, struct BT_MKID(bt_rw_thread)* thread)
+{
+    pthread_rwlock_unlock(&thread->rw->slots[thread->slot].lock);
+}
+
+BT_MKFN(bool, bt_rw_lookup, struct BT_MKID(bt_rw_thread)* thread, const BT_KEY* key, BT_ELEM* elem)
+{
+    BT_MKID(bt_rw_read_lock)(thread);
+    BT_ELEM* found = BT_MKID(bt_lookup)(&thread->rw->tree, key);
+    if (found) *elem = *found;
+    BT_MKID(bt_rw_read_unlock)(thread);
+    return found;
+}
+
+#endif
+
+#ifdef BT_BLINK
+
+BT_MKFN(void, bt_blink_init, struct BT_MKID(bt_blink)* tree)
+{
+    atomic_init(&tree->root, calloc(1, sizeof(struct BT_MKID(bt_blnode))));
+    pthread_mutex_init(&tree->root_lock, NULL);
+    atomic_init(&tree->size, 0);
+}
+
+BT_MKFN(void, bt_blink_destroy, struct BT_MKID(bt_blink)* tree)
+{
+    // Free each level from its first node, following the links.
+    struct BT_MKID(bt_blnode)* first = atomic_load(&tree->root);
+    while (first)
+    {
+        struct BT_MKID(bt_blnode)* below = first->level ? first->children[0] : NULL;
+        while (first)
+        {
+            struct BT_MKID(bt_blnode)* next = first->link;
+            if (!first->level)
+            {
+#ifdef BT_MVCC
+                for (size_t i = 0; i < first->n; i++)
+                {
+                    struct BT_MKID(bt_version)* v = atomic_load(first->versions + i);
+                    while (v)
+                    {
+                        struct BT_MKID(bt_version)* next = atomic_load(&v->next);
+                        BT_MKID(bt_version_free)(v);
+                        v = next;
+                    }
+                }
+#else
+                for (size_t i = 0; i < first->n; i++) BT_ELEM_FREE(first->elems[i]);
+#endif
+            }
+            free(first);
+            first = next;
+        }
+        first = below;
+    }
+    pthread_mutex_destroy(&tree->root_lock);
+}
+
+BT_MKFN(uint_fast64_t, bt_blnode_read_begin, struct BT_MKID(bt_blnode)* node)
+{
+    uint_fast64_t version;
+    while ((version = atomic_load_explicit(&node->version, memory_order_acquire)) & 1) sched_yield();
+    return version;
+}
+
+BT_MKFN(bool, bt_blnode_read_check, struct BT_MKID(bt_blnode)* node, uint_fast64_t version)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&node->version, memory_order_relaxed) == version;
+}
+
+BT_MKFN(void, bt_blnode_lock, struct BT_MKID(bt_blnode)* node)
+{
+    while (true)
+    {
+        uint_fast64_t version = BT_MKID(bt_blnode_read_begin)(node);
+        if (atomic_compare_exchange_weak_explicit(
+                &node->version, &version, version + 1, memory_order_acquire, memory_order_relaxed))
+            return;
+    }
+}
+
+BT_MKFN(void, bt_blnode_unlock, struct BT_MKID(bt_blnode)* node)
+{
+    atomic_fetch_add_explicit(&node->version, 1, memory_order_release);
+}
+
+BT_MKFN(size_t, bt_blnode_search, const struct BT_MKID(bt_blnode)* node, const BT_KEY* key)
+{
+    // Readers may see a torn `n`, keep it in bounds.
+    size_t left  = 0;
+    size_t right = node->n < 2 * BT_FACTOR + 1 ? node->n : 2 * BT_FACTOR + 1;
+    while (left < right)
+    {
+        size_t mid = left + (right - left) / 2;
+        bool go_right = node->level ? BT_CMP(key, node->keys + mid) >= 0
+                                    : BT_CMP(key, BT_KEY_OF(node->elems + mid)) > 0;
+        if (go_right) left  = mid + 1;
+        else          right = mid;
+    }
+    return left;
+}
+
+BT_MKFN(bool, bt_blnode_past, const struct BT_MKID(bt_blnode)* node, const BT_KEY* key)
+{
+    return node->has_high && BT_CMP(key, &node->high) >= 0;
+}
+
+BT_MKFN(
+    struct BT_MKID(bt_blnode)*,
+    bt_blink_descend,
+    struct BT_MKID(bt_blink)* tree, const BT_KEY* key, uint32_t level, struct BT_MKID(bt_blnode)** path
+) {
+    struct BT_MKID(bt_blnode)* node = atomic_load_explicit(&tree->root, memory_order_acquire);
+    while (true)
+    {
+        uint_fast64_t version = BT_MKID(bt_blnode_read_begin)(node);
+        struct BT_MKID(bt_blnode)* next;
+        if (BT_MKID(bt_blnode_past)(node, key))   next = node->link;
+        else if (node->level == level)            next = NULL;
+        else                                      next = node->children[BT_MKID(bt_blnode_search)(node, key)];
+
+        // Read again if it changed meanwhile.
+        if (!BT_MKID(bt_blnode_read_check)(node, version)) continue;
+        if (!next) return node;
+        if (path && next->level < node->level) path[node->level] = node;
+        node = next;
+    }
+}
+
+BT_MKFN(struct BT_MKID(bt_blnode)*, bt_blink_lock_for, struct BT_MKID(bt_blnode)* node, const BT_KEY* key)
+{
+    BT_MKID(bt_blnode_lock)(node);
+    while (BT_MKID(bt_blnode_past)(node, key))
+    {
+        struct BT_MKID(bt_blnode)* next = node->link;
+        BT_MKID(bt_blnode_unlock)(node);
+        BT_MKID(bt_blnode_lock)(next);
+        node = next;
+    }
+    return node;
+}
+
+BT_MKFN(
+    struct BT_MKID(bt_blnode)*,
+    bt_blink_parent,
+    struct BT_MKID(bt_blink)* tree, const BT_KEY* key, uint32_t level, struct BT_MKID(bt_blnode)** path
+) {
+    if (level < BT_ITER_STACK_SIZE && path[level]) return path[level];
+
+    pthread_mutex_lock(&tree->root_lock);
+    struct BT_MKID(bt_blnode)* root = atomic_load_explicit(&tree->root, memory_order_acquire);
+    if (root->level < level)
+    {
+        // The root was split, so it's the first of at least two nodes in its
+        // level. The new root starts with those two, the splits of any others
+        // will add them as usual.
+        struct BT_MKID(bt_blnode)* new_root = calloc(1, sizeof(struct BT_MKID(bt_blnode)));
+        BT_MKID(bt_blnode_lock)(root);
+        new_root->level       = level;
+        new_root->n           = 1;
+        new_root->keys[0]     = root->high;
+        new_root->children[0] = root;
+        new_root->children[1] = root->link;
+        BT_MKID(bt_blnode_unlock)(root);
+        atomic_store_explicit(&tree->root, new_root, memory_order_release);
+    }
+    pthread_mutex_unlock(&tree->root_lock);
+
+    return BT_MKID(bt_blink_descend)(tree, key, level, NULL);
+}
+
+BT_MKFN(bool, bt_blink_lookup, struct BT_MKID(bt_blink)* tree, const BT_KEY* key, BT_ELEM* elem)
+{
+    struct BT_MKID(bt_blnode)* leaf = BT_MKID(bt_blink_descend)(tree, key, 0, NULL);
+    while (true)
+    {
+        uint_fast64_t version = BT_MKID(bt_blnode_read_begin)(leaf);
+        if (BT_MKID(bt_blnode_past)(leaf, key))
+        {
+            struct BT_MKID(bt_blnode)* next = leaf->link;
+            if (BT_MKID(bt_blnode_read_check)(leaf, version)) leaf = next;
+            continue;
+        }
+
+        size_t i = BT_MKID(bt_blnode_search)(leaf, key);
+        if (i >= leaf->n || BT_CMP(key, BT_KEY_OF(leaf->elems + i)))
+        {
+            if (!BT_MKID(bt_blnode_read_check)(leaf, version)) continue;
+            return false;
+        }
+
+        BT_ELEM copy = leaf->elems[i];
+        if (!BT_MKID(bt_blnode_read_check)(leaf, version)) continue;
+        if (elem) *elem = copy;
+        return true;
+    }
+}
+
+BT_MKFN(bool, bt_blink_insert, struct BT_MKID(bt_blink)* tree, BT_ELEM elem, BT_ELEM* prev)
+{
+    const BT_KEY* key = BT_KEY_OF(&elem);
+    struct BT_MKID(bt_blnode)* path[BT_ITER_STACK_SIZE] = { NULL };
+    struct BT_MKID(bt_blnode)* node = BT_MKID(bt_blink_descend)(tree, key, 0, path);
+    node = BT_MKID(bt_blink_lock_for)(node, key);
+
+    size_t i = BT_MKID(bt_blnode_search)(node, key);
+    if (i < node->n && !BT_CMP(key, BT_KEY_OF(node->elems + i)))
+    {
+        if (prev) *prev = node->elems[i];
+        else BT_ELEM_FREE(node->elems[i]);
+        node->elems[i] = elem;
+        BT_MKID(bt_blnode_unlock)(node);
+        return true;
+    }
+
+    memmove(node->elems + i + 1, node->elems + i, (node->n - i) * sizeof(BT_ELEM));
+    node->elems[i] = elem;
+    node->n++;
+    atomic_fetch_add(&tree->size, 1);
+
+    BT_MKID(bt_blink_split)(tree, node, path);
+    return false;
+}
+
+BT_MKFN(
+    void,
+    bt_blink_split,
+    struct BT_MKID(bt_blink)* tree, struct BT_MKID(bt_blnode)* node, struct BT_MKID(bt_blnode)** path
+) {
+    while (node->n > 2 * BT_FACTOR)
+    {
+        struct BT_MKID(bt_blnode)* right = calloc(1, sizeof(struct BT_MKID(bt_blnode)));
+        BT_KEY sep;
+        right->level = node->level;
+        if (!node->level)
+        {
+            memcpy(right->elems, node->elems + BT_FACTOR, (BT_FACTOR + 1) * sizeof(BT_ELEM));
+#ifdef BT_MVCC
+            memcpy(right->versions, node->versions + BT_FACTOR, (BT_FACTOR + 1) * sizeof(void*));
+#endif
+            right->n = BT_FACTOR + 1;
+            sep      = *BT_KEY_OF(right->elems);
+        }
+        else
+        {
+            sep = node->keys[BT_FACTOR];
+            memcpy(right->keys, node->keys + BT_FACTOR + 1, BT_FACTOR * sizeof(BT_KEY));
+            memcpy(right->children, node->children + BT_FACTOR + 1, (BT_FACTOR + 1) * sizeof(void*));
+            right->n = BT_FACTOR;
+        }
+        right->has_high = node->has_high;
+        right->high     = node->high;
+        right->link     = node->link;
+
+        // Releasing the latch publishes `right` through the link.
+        node->n        = BT_FACTOR;
+        node->has_high = true;
+        node->high     = sep;
+        node->link     = right;
+        uint32_t level = node->level;
+        BT_MKID(bt_blnode_unlock)(node);
+
+        node = BT_MKID(bt_blink_parent)(tree, &sep, level + 1, path);
+        node = BT_MKID(bt_blink_lock_for)(node, &sep);
+
+        // Adding a level may have added it already.
+        size_t i = BT_MKID(bt_blnode_search)(node, &sep);
+        if (i > 0 && node->children[i] == right) break;
+
+        memmove(node->keys + i + 1, node->keys + i, (node->n - i) * sizeof(BT_KEY));
+        memmove(node->children + i + 2, node->children + i + 1, (node->n - i) * sizeof(void*));
+        node->keys[i]         = sep;
+        node->children[i + 1] = right;
+        node->n++;
+    }
+
+    BT_MKID(bt_blnode_unlock)(node);
+}
+
+BT_MKFN(bool, bt_blink_remove, struct BT_MKID(bt_blink)* tree, const BT_KEY* key, BT_ELEM* removed)
+{
+    struct BT_MKID(bt_blnode)* node = BT_MKID(bt_blink_descend)(tree, key, 0, NULL);
+    node = BT_MKID(bt_blink_lock_for)(node, key);
+
+    size_t i   = BT_MKID(bt_blnode_search)(node, key);
+    bool found = i < node->n && !BT_CMP(key, BT_KEY_OF(node->elems + i));
+    if (found)
+    {
+        if (removed) *removed = node->elems[i];
+        else BT_ELEM_FREE(node->elems[i]);
+        memmove(node->elems + i, node->elems + i + 1, (node->n - i - 1) * sizeof(BT_ELEM));
+        node->n--;
+        atomic_fetch_sub(&tree->size, 1);
+    }
+
+    BT_MKID(bt_blnode_unlock)(node);
+    return found;
+}
+
+BT_MKFN(void, bt_blink_scan, struct BT_MKID(bt_blink)* tree, const BT_KEY* lo, BT_MKID(bt_blink_fn) fn, void* ctx)
+{
+    struct BT_MKID(bt_blnode)* leaf;
+    if (lo)
+    {
+        leaf = BT_MKID(bt_blink_descend)(tree, lo, 0, NULL);
+    }
+    else
+    {
+        // The first leaf, children of the first nodes never change.
+        leaf = atomic_load_explicit(&tree->root, memory_order_acquire);
+        while (leaf->level) leaf = leaf->children[0];
+    }
+
+    BT_ELEM copy[2 * BT_FACTOR + 1];
+    BT_KEY last;
+    bool has_last = false;
+    while (leaf)
+    {
+        uint_fast64_t version = BT_MKID(bt_blnode_read_begin)(leaf);
+        size_t n = leaf->n < 2 * BT_FACTOR + 1 ? leaf->n : 2 * BT_FACTOR + 1;
+        memcpy(copy, leaf->elems, n * sizeof(BT_ELEM));
+        struct BT_MKID(bt_blnode)* next = leaf->link;
+        if (!BT_MKID(bt_blnode_read_check)(leaf, version)) continue;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            const BT_KEY* key = BT_KEY_OF(copy + i);
+            if (lo && BT_CMP(key, lo) < 0) continue;
+            if (has_last && BT_CMP(key, &last) <= 0) continue;
+            if (!fn(copy + i, ctx)) return;
+            last     = *key;
+            has_last = true;
+        }
+        leaf = next;
+    }
+}
+
+#endif
+
+#ifdef BT_EPOCH
+
+BT_MKFN(void, bt_epoch_init, struct BT_MKID(bt_epoch)* epoch)
+{
+    atomic_init(&epoch->global, 0);
+    pthread_mutex_init(&epoch->lock, NULL);
+    epoch->threads     = NULL;
+    epoch->orphans     = NULL;
+    epoch->norphans    = 0;
+    epoch->orphans_cap = 0;
+}
+
+BT_MKFN(void, bt_epoch_destroy, struct BT_MKID(bt_epoch)* epoch)
+{
+    while (epoch->threads)
+    {
+        struct BT_MKID(bt_epoch_thread)* next = epoch->threads->next;
+        assert(!epoch->threads->depth);
+        BT_MKID(bt_epoch_free)(epoch->threads->limbo, epoch->threads->n, UINT_FAST64_MAX);
+        free(epoch->threads->limbo);
+        free(epoch->threads);
+        epoch->threads = next;
+    }
+    BT_MKID(bt_epoch_free)(epoch->orphans, epoch->norphans, UINT_FAST64_MAX);
+    free(epoch->orphans);
+    pthread_mutex_destroy(&epoch->lock);
+}
+
+BT_MKFN(struct BT_MKID(bt_epoch_thread)*, bt_epoch_register, struct BT_MKID(bt_epoch)* epoch)
+{
+    struct BT_MKID(bt_epoch_thread)* thread = malloc(sizeof(struct BT_MKID(bt_epoch_thread)));
+    thread->epoch     = epoch;
+    thread->depth     = 0;
+    thread->limbo     = NULL;
+    thread->n         = 0;
+    thread->cap       = 0;
+    thread->threshold = BT_EPOCH_BATCH;
+    atomic_init(&thread->local, 0);
+
+    pthread_mutex_lock(&epoch->lock);
+    thread->next   = epoch->threads;
+    epoch->threads = thread;
+    pthread_mutex_unlock(&epoch->lock);
+    return thread;
+}
+
+BT_MKFN(void, bt_epoch_unregister, struct BT_MKID(bt_epoch_thread)* thread)
+{
+    struct BT_MKID(bt_epoch)* epoch = thread->epoch;
+    assert(!thread->depth);
+    BT_MKID(bt_epoch_collect)(thread);
+
+    pthread_mutex_lock(&epoch->lock);
+    struct BT_MKID(bt_epoch_thread)** link = &epoch->threads;
+    while (*link != thread) link = &(*link)->next;
+    *link = thread->next;
+
+    if (epoch->norphans + thread->n > epoch->orphans_cap)
+    {
+        epoch->orphans_cap = 2 * (epoch->norphans + thread->n);
+        epoch->orphans     = realloc(epoch->orphans, epoch->orphans_cap * sizeof(struct BT_MKID(bt_epoch_retired)));
+    }
+    if (thread->n)
+        memcpy(epoch->orphans + epoch->norphans, thread->limbo, thread->n * sizeof(struct BT_MKID(bt_epoch_retired)));
+    epoch->norphans += thread->n;
+    pthread_mutex_unlock(&epoch->lock);
+
+    free(thread->limbo);
+    free(thread);
+}
+
+BT_MKFN(void, bt_epoch_pin, struct BT_MKID(bt_epoch_thread)* thread)
+{
+    if (thread->depth++) return;
+
+    // Sequentially consistent, so that either `bt_epoch_advance` sees the
+    // thread pinned, or the thread sees the epoch it advanced to (and nothing
+    // unlinked before).
+    uint_fast64_t global = atomic_load(&thread->epoch->global);
+    atomic_store(&thread->local, 2 * global + 1);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+BT_MKFN(void, bt_epoch_unpin, struct BT_MKID(bt_epoch_thread)* thread)
+{
+    assert(thread->depth);
+    if (--thread->depth) return;
+    atomic_store_explicit(&thread->local, 0, memory_order_release);
+}
+
+BT_MKFN(void, bt_epoch_retire, struct BT_MKID(bt_epoch_thread)* thread, void* ptr, void (*free_fn)(void* ptr))
+{
+    if (thread->n == thread->cap)
+    {
+        thread->cap   = thread->cap ? 2 * thread->cap : BT_EPOCH_BATCH;
+        thread->limbo = realloc(thread->limbo, thread->cap * sizeof(struct BT_MKID(bt_epoch_retired)));
+    }
+    thread->limbo[thread->n++] = (struct BT_MKID(bt_epoch_retired)){
+        .ptr     = ptr,
+        .free_fn = free_fn ? free_fn : free,
+        .epoch   = atomic_load(&thread->epoch->global),
+    };
+
+    // A thread pinned for long keeps everything retired after it from being
+    // freed, don't try again until another batch was retired.
+    if (thread->n >= thread->threshold)
+        thread->threshold = BT_MKID(bt_epoch_collect)(thread) + BT_EPOCH_BATCH;
+}
+
+BT_MKFN(uint_fast64_t, bt_epoch_advance, struct BT_MKID(bt_epoch)* epoch)
+{
+    pthread_mutex_lock(&epoch->lock);
+    uint_fast64_t global = atomic_load(&epoch->global);
+    bool can_advance = true;
+    for (struct BT_MKID(bt_epoch_thread)* thread = epoch->threads; thread && can_advance; thread = thread->next)
+    {
+        uint_fast64_t local = atomic_load(&thread->local);
+        can_advance = !local || local == 2 * global + 1;
+    }
+    if (can_advance) atomic_store(&epoch->global, ++global);
+
+    if (epoch->norphans)
+        epoch->norphans = BT_MKID(bt_epoch_free)(epoch->orphans, epoch->norphans, global);
+    pthread_mutex_unlock(&epoch->lock);
+    return global;
+}
+
+BT_MKFN(size_t, bt_epoch_collect, struct BT_MKID(bt_epoch_thread)* thread)
+{
+    uint_fast64_t global = BT_MKID(bt_epoch_advance)(thread->epoch);
+    thread->n = BT_MKID(bt_epoch_free)(thread->limbo, thread->n, global);
+    return thread->n;
+}
+
+BT_MKFN(size_t, bt_epoch_free, struct BT_MKID(bt_epoch_retired)* list, size_t n, uint_fast64_t global)
+{
+    // Threads pinned to the epoch before the one a pointer was retired in may
+    // still hold it, only threads pinned later can't.
+    size_t freed = 0;
+    while (freed < n && (global == UINT_FAST64_MAX || list[freed].epoch + 2 <= global))
+    {
+        list[freed].free_fn(list[freed].ptr);
+        freed++;
+    }
+    if (freed && freed < n)
+        memmove(list, list + freed, (n - freed) * sizeof(struct BT_MKID(bt_epoch_retired)));
+    return n - freed;
+}
+
+#endif
+
+#ifdef BT_MVCC
+
+BT_MKFN(void, bt_mvcc_init, struct BT_MKID(bt_mvcc)* mvcc)
+{
+    BT_MKID(bt_blink_init)(&mvcc->tree);
+    BT_MKID(bt_epoch_init)(&mvcc->epoch);
+    atomic_init(&mvcc->clock, 1);
+    atomic_init(&mvcc->stable, 1);
+    atomic_init(&mvcc->horizon, 1);
+    pthread_mutex_init(&mvcc->lock, NULL);
+    mvcc->threads = NULL;
+}
+
+BT_MKFN(void, bt_mvcc_destroy, struct BT_MKID(bt_mvcc)* mvcc)
+{
+    while (mvcc->threads) BT_MKID(bt_mvcc_unregister)(mvcc->threads);
+    BT_MKID(bt_epoch_destroy)(&mvcc->epoch);
+    BT_MKID(bt_blink_destroy)(&mvcc->tree);
+    pthread_mutex_destroy(&mvcc->lock);
+}
+
+BT_MKFN(struct BT_MKID(bt_mvcc_thread)*, bt_mvcc_register, struct BT_MKID(bt_mvcc)* mvcc)
+{
+    struct BT_MKID(bt_mvcc_thread)* thread = malloc(sizeof(struct BT_MKID(bt_mvcc_thread)));
+    thread->mvcc  = mvcc;
+    thread->epoch = BT_MKID(bt_epoch_register)(&mvcc->epoch);
+    atomic_init(&thread->snapshot, 0);
+
+    pthread_mutex_lock(&mvcc->lock);
+    thread->next  = mvcc->threads;
+    mvcc->threads = thread;
+    pthread_mutex_unlock(&mvcc->lock);
+    return thread;
+}
+
+BT_MKFN(void, bt_mvcc_unregister, struct BT_MKID(bt_mvcc_thread)* thread)
+{
+    struct BT_MKID(bt_mvcc)* mvcc = thread->mvcc;
+    assert(!atomic_load(&thread->snapshot));
+
+    pthread_mutex_lock(&mvcc->lock);
+    struct BT_MKID(bt_mvcc_thread)** link = &mvcc->threads;
+    while (*link != thread) link = &(*link)->next;
+    *link = thread->next;
+    pthread_mutex_unlock(&mvcc->lock);
+
+    BT_MKID(bt_epoch_unregister)(thread->epoch);
+    free(thread);
+}
+
+BT_MKFN(uint64_t, bt_mvcc_begin, struct BT_MKID(bt_mvcc_thread)* thread)
+{
+    struct BT_MKID(bt_mvcc)* mvcc = thread->mvcc;
+    BT_MKID(bt_epoch_pin)(thread->epoch);
+
+    // Either `bt_mvcc_gc` sees the snapshot, or the snapshot sees the horizon
+    // it raised and is taken again.
+    uint64_t ts;
+    do
+    {
+        ts = atomic_load(&mvcc->stable);
+        atomic_store(&thread->snapshot, ts);
+    } while (ts < atomic_load(&mvcc->horizon));
+    return ts;
+}
+
+BT_MKFN(void, bt_mvcc_end, struct BT_MKID(bt_mvcc_thread)* thread)
+{
+    atomic_store_explicit(&thread->snapshot, 0, memory_order_release);
+    BT_MKID(bt_epoch_unpin)(thread->epoch);
+}
+
+BT_MKFN(void, bt_version_free, void* ptr)
+{
+    struct BT_MKID(bt_version)* v = ptr;
+    if (!v->removed) BT_ELEM_FREE(v->elem);
+    free(v);
+}
+
+BT_MKFN(struct BT_MKID(bt_version)*, bt_version_at, struct BT_MKID(bt_version)* v, uint64_t ts)
+{
+    while (v && v->ts > ts) v = atomic_load_explicit(&v->next, memory_order_acquire);
+    return v;
+}
+
+BT_MKFN(
+    bool,
+    bt_mvcc_lookup_at,
+    struct BT_MKID(bt_mvcc_thread)* thread, const BT_KEY* key, uint64_t ts, BT_ELEM* elem
+) {
+    assert(atomic_load_explicit(&thread->snapshot, memory_order_relaxed));
+    struct BT_MKID(bt_blnode)* leaf = BT_MKID(bt_blink_descend)(&thread->mvcc->tree, key, 0, NULL);
+    struct BT_MKID(bt_version)* head;
+    while (true)
+    {
+        uint_fast64_t version = BT_MKID(bt_blnode_read_begin)(leaf);
+        if (BT_MKID(bt_blnode_past)(leaf, key))
+        {
+            struct BT_MKID(bt_blnode)* next = leaf->link;
+            if (BT_MKID(bt_blnode_read_check)(leaf, version)) leaf = next;
+            continue;
+        }
+
+        size_t i = BT_MKID(bt_blnode_search)(leaf, key);
+        head     = i < leaf->n && !BT_CMP(key, BT_KEY_OF(leaf->elems + i))
+                 ? atomic_load_explicit(leaf->versions + i, memory_order_acquire)
+                 : NULL;
+        if (BT_MKID(bt_blnode_read_check)(leaf, version)) break;
+    }
+
+    // The versions stay allocated while the snapshot is pinned.
+    struct BT_MKID(bt_version)* v = BT_MKID(bt_version_at)(head, ts);
+    if (!v || v->removed) return false;
+    if (elem) *elem = v->elem;
+    return true;
+}
+
+BT_MKFN(
+    struct BT_MKID(bt_mvcc_iter),
+    bt_mvcc_iter_at,
+    struct BT_MKID(bt_mvcc_thread)* thread, const BT_KEY* lo, uint64_t ts
+) {
+    assert(atomic_load_explicit(&thread->snapshot, memory_order_relaxed));
+    struct BT_MKID(bt_mvcc_iter) iter;
+    iter.ts       = ts;
+    iter.has_lo   = lo != NULL;
+    iter.n        = 0;
+    iter.i        = 0;
+    iter.has_last = false;
+    if (lo)
+    {
+        iter.lo   = *lo;
+        iter.next = BT_MKID(bt_blink_descend)(&thread->mvcc->tree, lo, 0, NULL);
+    }
+    else
+    {
+        iter.next = atomic_load_explicit(&thread->mvcc->tree.root, memory_order_acquire);
+        while (iter.next->level) iter.next = iter.next->children[0];
+    }
+    return iter;
+}
+
+BT_MKFN(BT_ELEM*, bt_mvcc_iter_next, struct BT_MKID(bt_mvcc_iter)* iter)
+{
+    while (true)
+    {
+        while (iter->i < iter->n)
+        {
+            size_t i = iter->i++;
+            const BT_KEY* key = BT_KEY_OF(iter->keys + i);
+            if (iter->has_lo && BT_CMP(key, &iter->lo) < 0) continue;
+            if (iter->has_last && BT_CMP(key, &iter->last) <= 0) continue;
+            struct BT_MKID(bt_version)* v = BT_MKID(bt_version_at)(iter->versions[i], iter->ts);
+            if (!v || v->removed) continue;
+
+            iter->has_last = true;
+            iter->last     = *key;
+            iter->elem     = v->elem;
+            return &iter->elem;
+        }
+        if (!iter->next) return NULL;
+
+        // Copy the next leaf.
+        struct BT_MKID(bt_blnode)* leaf = iter->next;
+        uint_fast64_t version = BT_MKID(bt_blnode_read_begin)(leaf);
+        size_t n = leaf->n < 2 * BT_FACTOR + 1 ? leaf->n : 2 * BT_FACTOR + 1;
+        memcpy(iter->keys, leaf->elems, n * sizeof(BT_ELEM));
+        for (size_t i = 0; i < n; i++)
+            iter->versions[i] = atomic_load_explicit(leaf->versions + i, memory_order_acquire);
+        iter->next = leaf->link;
+        if (!BT_MKID(bt_blnode_read_check)(leaf, version))
+        {
+            iter->next = leaf;
+            continue;
+        }
+        iter->n    = n;
+        iter->i    = 0;
+    }
+}
+
+BT_MKFN(uint64_t, bt_mvcc_put, struct BT_MKID(bt_mvcc_thread)* thread, BT_ELEM elem)
 {
-#define SIZEOF_PTR sizeof(void*)
+    return BT_MKID(bt_mvcc_write)(thread, BT_KEY_OF(&elem), elem, false);
+}
+
+BT_MKFN(uint64_t, bt_mvcc_remove, struct BT_MKID(bt_mvcc_thread)* thread, const BT_KEY* key)
+{
+    BT_ELEM none;
+    memset(&none, 0, sizeof(BT_ELEM));
+    return BT_MKID(bt_mvcc_write)(thread, key, none, true);
+}
+
+BT_MKFN(
+    uint64_t,
+    bt_mvcc_write,
+    struct BT_MKID(bt_mvcc_thread)* thread, const BT_KEY* key, BT_ELEM elem, bool removed
+) {
+    struct BT_MKID(bt_mvcc)* mvcc = thread->mvcc;
+    struct BT_MKID(bt_blnode)* path[BT_ITER_STACK_SIZE] = { NULL };
+    struct BT_MKID(bt_blnode)* node = BT_MKID(bt_blink_descend)(&mvcc->tree, key, 0, path);
+    node = BT_MKID(bt_blink_lock_for)(node, key);
+
+    size_t i    = BT_MKID(bt_blnode_search)(node, key);
+    bool exists = i < node->n && !BT_CMP(key, BT_KEY_OF(node->elems + i));
+    struct BT_MKID(bt_version)* head = exists ? atomic_load(node->versions + i) : NULL;
+    if (removed && (!head || head->removed))
+    {
+        BT_MKID(bt_blnode_unlock)(node);
+        return 0;
+    }
+
+    // Taken with the latch, so versions of a key are in timestamp order.
+    struct BT_MKID(bt_version)* v = malloc(sizeof(struct BT_MKID(bt_version)));
+    v->ts      = atomic_fetch_add(&mvcc->clock, 1) + 1;
+    v->removed = removed;
+    v->elem    = elem;
+    atomic_init(&v->next, head);
+
+    if (exists)
+    {
+        if (!removed) node->elems[i] = elem;
+        atomic_store_explicit(node->versions + i, v, memory_order_release);
+        BT_MKID(bt_blnode_unlock)(node);
+    }
+    else
+    {
+        memmove(node->elems + i + 1, node->elems + i, (node->n - i) * sizeof(BT_ELEM));
+        memmove(node->versions + i + 1, node->versions + i, (node->n - i) * sizeof(void*));
+        node->elems[i] = elem;
+        atomic_store_explicit(node->versions + i, v, memory_order_release);
+        node->n++;
+        atomic_fetch_add(&mvcc->tree.size, 1);
+        BT_MKID(bt_blink_split)(&mvcc->tree, node, path);
+    }
+
+    // Writes become visible in timestamp order, once the earlier ones are.
+    uint_fast64_t expected = v->ts - 1;
+    while (!atomic_compare_exchange_weak(&mvcc->stable, &expected, v->ts))
+    {
+        expected = v->ts - 1;
+        sched_yield();
+    }
+    return v->ts;
+}
+
+BT_MKFN(size_t, bt_mvcc_gc, struct BT_MKID(bt_mvcc_thread)* thread)
+{
+    struct BT_MKID(bt_mvcc)* mvcc = thread->mvcc;
+    pthread_mutex_lock(&mvcc->lock);
+
+    // Raise the horizon first, snapshots taken after it see it.
+    uint64_t horizon = atomic_load(&mvcc->stable);
+    if (horizon > atomic_load(&mvcc->horizon)) atomic_store(&mvcc->horizon, horizon);
+    for (struct BT_MKID(bt_mvcc_thread)* t = mvcc->threads; t; t = t->next)
+    {
+        uint64_t snapshot = atomic_load(&t->snapshot);
+        if (snapshot && snapshot < horizon) horizon = snapshot;
+    }
+
+    struct BT_MKID(bt_blnode)* leaf = atomic_load(&mvcc->tree.root);
+    while (leaf->level) leaf = leaf->children[0];
+
+    size_t retired = 0;
+    for (; leaf; leaf = leaf->link)
+    {
+        BT_MKID(bt_blnode_lock)(leaf);
+        size_t kept = 0;
+        for (size_t i = 0; i < leaf->n; i++)
+        {
+            struct BT_MKID(bt_version)* head = atomic_load(leaf->versions + i);
+            struct BT_MKID(bt_version)* v    = BT_MKID(bt_version_at)(head, horizon);
+
+            // Nothing can see the versions after `v`, nor `v` if it's the
+            // newest and a removal.
+            struct BT_MKID(bt_version)* dead = NULL;
+            if (v)
+            {
+                dead = atomic_load(&v->next);
+                atomic_store(&v->next, NULL);
+                if (v == head && v->removed)
+                {
+                    atomic_store(&v->next, dead);
+                    dead = v;
+                    head = NULL;
+                }
+            }
+            while (dead)
+            {
+                struct BT_MKID(bt_version)* next = atomic_load(&dead->next);
+                BT_MKID(bt_epoch_retire)(thread->epoch, dead, BT_MKID(bt_version_free));
+                retired++;
+                dead = next;
+            }
+
+            if (!head) continue;
+            leaf->elems[kept] = leaf->elems[i];
+            atomic_store(leaf->versions + kept, head);
+            kept++;
+        }
+        atomic_fetch_sub(&mvcc->tree.size, leaf->n - kept);
+        leaf->n = kept;
+        BT_MKID(bt_blnode_unlock)(leaf);
+    }
+
+    pthread_mutex_unlock(&mvcc->lock);
+    return retired;
+}
+
+#endif
+
+#ifdef BT_TXN
+
+BT_MKFN(struct BT_MKID(bt_txn), bt_txn_begin, struct BT_MKID(bt)* bt)
+{
+    return (struct BT_MKID(bt_txn)){ .bt = bt, .n = 0, .sorted = 0, .cap = 0, .ops = NULL };
+}
+
+BT_MKFN(struct BT_MKID(bt_txn_op)*, bt_txn_append, struct BT_MKID(bt_txn)* txn)
+{
+    if (txn->n == txn->cap)
+    {
+        txn->cap = txn->cap ? 2 * txn->cap : 16;
+        txn->ops = realloc(txn->ops, txn->cap * sizeof(struct BT_MKID(bt_txn_op)));
+    }
+    return txn->ops + txn->n++;
+}
+
+BT_MKFN(void, bt_txn_put, struct BT_MKID(bt_txn)* txn, BT_ELEM elem)
+{
+    struct BT_MKID(bt_txn_op)* op = BT_MKID(bt_txn_append)(txn);
+    op->remove = false;
+    op->key    = *BT_KEY_OF(&elem);
+    op->elem   = elem;
+}
+
+BT_MKFN(void, bt_txn_remove, struct BT_MKID(bt_txn)* txn, const BT_KEY* key)
+{
+    struct BT_MKID(bt_txn_op)* op = BT_MKID(bt_txn_append)(txn);
+    op->remove = true;
+    op->key    = *key;
+}
+
+BT_MKFN(
+    void,
+    bt_txn_merge,
+    struct BT_MKID(bt_txn_op)* out,
+    const struct BT_MKID(bt_txn_op)* a, size_t na, const struct BT_MKID(bt_txn_op)* b, size_t nb
+) {
+    size_t i = 0, j = 0;
+    while (i < na && j < nb) *out++ = BT_CMP(&b[j].key, &a[i].key) < 0 ? b[j++] : a[i++];
+    memcpy(out, a + i, (na - i) * sizeof(struct BT_MKID(bt_txn_op)));
+    memcpy(out + na - i, b + j, (nb - j) * sizeof(struct BT_MKID(bt_txn_op)));
+}
+
+BT_MKFN(void, bt_txn_sort, struct BT_MKID(bt_txn)* txn)
+{
+#define RUN 8
+    if (txn->sorted == txn->n) return;
+
+    // A stable merge sort of the appended changes, so the last change to a key
+    // stays last. Unlike `qsort` it inlines the comparisons, which would cost
+    // more than the descents saved otherwise.
+    struct BT_MKID(bt_txn_op)* tail = txn->ops + txn->sorted;
+    struct BT_MKID(bt_txn_op)* tmp  = malloc(txn->cap * sizeof(struct BT_MKID(bt_txn_op)));
+    size_t m = txn->n - txn->sorted;
+    for (size_t lo = 0; lo < m; lo += RUN)
+    {
+        size_t hi = lo + RUN < m ? lo + RUN : m;
+        for (size_t i = lo + 1; i < hi; i++)
+        {
+            struct BT_MKID(bt_txn_op) op = tail[i];
+            size_t j = i;
+            for (; j > lo && BT_CMP(&op.key, &tail[j - 1].key) < 0; j--) tail[j] = tail[j - 1];
+            tail[j] = op;
+        }
+    }
+
+    struct BT_MKID(bt_txn_op)* src = tail;
+    struct BT_MKID(bt_txn_op)* dst = tmp;
+    for (size_t width = RUN; width < m; width *= 2)
+    {
+        for (size_t lo = 0; lo < m; lo += 2 * width)
+        {
+            size_t mid = lo + width < m ? lo + width : m;
+            size_t hi  = lo + 2 * width < m ? lo + 2 * width : m;
+            BT_MKID(bt_txn_merge)(dst + lo, src + lo, mid - lo, src + mid, hi - mid);
+        }
+        struct BT_MKID(bt_txn_op)* swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != tail) memcpy(tail, src, m * sizeof(struct BT_MKID(bt_txn_op)));
+
+    // Then merge both parts, and keep the last change to each key, which is
+    // an appended one if both have it.
+    BT_MKID(bt_txn_merge)(tmp, txn->ops, txn->sorted, tail, m);
+    size_t n = 0;
+    for (size_t i = 0; i < txn->n; i++)
+    {
+        if (n && !BT_CMP(&tmp[n - 1].key, &tmp[i].key))
+        {
+            if (!tmp[n - 1].remove) BT_ELEM_FREE(tmp[n - 1].elem);
+            n--;
+        }
+        tmp[n++] = tmp[i];
+    }
+
+    free(txn->ops);
+    txn->ops    = tmp;
+    txn->n      = n;
+    txn->sorted = n;
+#undef RUN
+}
+
+BT_MKFN(BT_ELEM*, bt_txn_lookup, struct BT_MKID(bt_txn)* txn, const BT_KEY* key)
+{
+    BT_MKID(bt_txn_sort)(txn);
+
+    size_t left  = 0;
+    size_t right = txn->n;
+    while (left < right)
+    {
+        size_t mid = left + (right - left) / 2;
+        if (BT_CMP(key, &txn->ops[mid].key) > 0) left  = mid + 1;
+        else                                     right = mid;
+    }
+
+    if (left < txn->n && !BT_CMP(key, &txn->ops[left].key))
+        return txn->ops[left].remove ? NULL : &txn->ops[left].elem;
+    return BT_MKID(bt_lookup)(txn->bt, key);
+}
+
+BT_MKFN(void, bt_txn_commit, struct BT_MKID(bt_txn)* txn)
+{
+    BT_MKID(bt_txn_sort)(txn);
+    for (size_t i = 0; i < txn->n;)
+        i += BT_MKID(bt_txn_apply)(txn->bt, txn->ops + i, txn->n - i);
+
+    free(txn->ops);
+    txn->ops    = NULL;
+    txn->n      = 0;
+    txn->sorted = 0;
+    txn->cap    = 0;
+}
+
+BT_MKFN(void, bt_txn_abort, struct BT_MKID(bt_txn)* txn)
+{
+    for (size_t i = 0; i < txn->n; i++)
+    {
+        if (!txn->ops[i].remove) BT_ELEM_FREE(txn->ops[i].elem);
+    }
+
+    free(txn->ops);
+    txn->ops    = NULL;
+    txn->n      = 0;
+    txn->sorted = 0;
+    txn->cap    = 0;
+}
+
+BT_MKFN(size_t, bt_txn_apply, struct BT_MKID(bt)* bt, struct BT_MKID(bt_txn_op)* ops, size_t n)
+{
+    // Descend to the leaf where the first key belongs, keeping the separator
+    // above it, every following key below that one belongs to the same leaf.
+    struct BT_MKID(bnode)* path[BT_ITER_STACK_SIZE];
+    size_t idxs[BT_ITER_STACK_SIZE];
+    size_t depth = 0;
+    struct BT_MKID(bnode)* node = bt->root;
+    const BT_KEY* high = NULL;
+    while (node && node->children[0])
+    {
+        ssize_t idx = BT_MKID(bt_node_bsearch)(node, &ops[0].key);
+        if (idx >= 0) break;
+        size_t i = -idx - 1;
+        if (i < node->n) high = BT_KEY_OF(node->elems + i);
+        path[depth]   = node;
+        idxs[depth++] = i;
+        node = node->children[i];
+    }
+
+    size_t done = 0;
+    if (node && !node->children[0])
+    {
+        // Keep the leaf within its bounds, the root may hold a single element.
+        size_t min = node == bt->root ? 1 : BT_FACTOR;
+        for (; done < n; done++)
+        {
+            struct BT_MKID(bt_txn_op)* op = ops + done;
+            if (high && BT_CMP(&op->key, high) >= 0) break;
+
+            ssize_t idx = BT_MKID(bt_node_bsearch)(node, &op->key);
+            if (op->remove)
+            {
+                if (idx < 0) continue;
+                if (node->n <= min) break;
+
+#ifdef BT_HASH_INDEX
+                BT_MKID(bt_hindex_move)(node->hindex, BT_HASH(&op->key), node, NULL);
+#endif
+                BT_ELEM_FREE(node->elems[idx]);
+                BT_MKID(bt_node_move)(node, idx, node, idx + 1, node->n - idx - 1);
+                node->n--;
+                bt->size--;
+#ifdef BT_LEARNED
+                // No element changed leaves, the model is still valid.
+                BT_MKID(bt_learned_changed)(bt);
+#endif
+            }
+            else if (idx >= 0)
+            {
+                BT_ELEM_FREE(node->elems[idx]);
+                BT_MKID(bt_node_put)(node, idx, op->elem);
+#ifdef BT_LRU
+                node->used[idx] = true;
+#endif
+            }
+            else
+            {
+                size_t i = -idx - 1;
+                BT_MKID(bt_node_move)(node, i + 1, node, i, node->n - i);
+                BT_MKID(bt_node_put)(node, i, op->elem);
+                node->n++;
+#ifdef BT_LRU
+                node->used[i] = true;
+#endif
+#ifdef BT_HASH_INDEX
+                BT_MKID(bt_hindex_add)(node->hindex, BT_HASH(&op->key), node);
+#endif
+                BT_MKID(bt_added)(bt, &op->key);
+                if (node->n <= 2 * BT_FACTOR) continue;
+
+                // Split the leaf, and its ancestors while they overflow, as
+                // `bt_node_insert` would on its way back up. The following
+                // changes may now belong to the new sibling.
+                for (size_t up = depth; up--;)
+                {
+                    struct BT_MKID(bnode)* parent = path[up];
+                    size_t at = idxs[up];
+                    if (parent->children[at]->n <= 2 * BT_FACTOR) break;
+
+                    BT_ELEM promoted = BT_MKID(bt_split_node)(parent, at);
+                    BT_MKID(bt_node_move)(parent, at + 1, parent, at, parent->n - at);
+                    BT_MKID(bt_node_put)(parent, at, promoted);
+                    parent->n++;
+#ifdef BT_LRU
+                    parent->used[at] = parent->children[at]->used[BT_FACTOR];
+#endif
+                }
+#ifdef BT_AUGMENT
+                // Splits fixed the nodes they touched, but not their ancestors.
+                while (depth--) BT_MKID(bt_node_augment)(path[depth]);
+#endif
+                if (bt->root->n > 2 * BT_FACTOR)
+                {
+                    struct BT_MKID(bnode)* new_root = BT_NODE_ALLOC(sizeof(struct BT_MKID(bnode)));
+                    new_root->n           = 1;
+                    new_root->children[0] = bt->root;
+#ifdef BT_HASH_INDEX
+                    new_root->hindex = bt->hindex;
+#endif
+                    BT_MKID(bt_node_put)(new_root, 0, BT_MKID(bt_split_node)(new_root, 0));
+#ifdef BT_LRU
+                    new_root->used[0] = bt->root->used[BT_FACTOR];
+#endif
+#ifdef BT_AUGMENT
+                    BT_MKID(bt_node_augment)(new_root);
+#endif
+                    bt->root = new_root;
+                }
+                return done + 1;
+            }
+        }
+    }
+    if (done)
+    {
+#ifdef BT_AUGMENT
+        BT_MKID(bt_node_augment)(node);
+        while (depth--) BT_MKID(bt_node_augment)(path[depth]);
+#endif
+        return done;
+    }
+
+    // The key is in an inner node, or the leaf would need to be rebalanced.
+    if (ops[0].remove) BT_MKID(bt_remove)(bt, &ops[0].key, NULL);
+    else               BT_MKID(bt_insert)(bt, ops[0].elem, NULL);
+    return 1;
+}
+
+#endif
+
+#ifdef BT_LRU
+
+BT_MKFN(void, bt_lru_init, struct BT_MKID(bt_lru)* lru, size_t budget)
+{
+    *lru = (struct BT_MKID(bt_lru)){ .tree = BT_MKID(bt_mk)(), .budget = budget };
+}
+
+BT_MKFN(void, bt_lru_destroy, struct BT_MKID(bt_lru)* lru)
+{
+    BT_MKID(bt_free)(lru->tree);
+}
+
+BT_MKFN(BT_ELEM*, bt_lru_get, struct BT_MKID(bt_lru)* lru, const BT_KEY* key)
+{
+    struct BT_MKID(bnode)* node;
+    BT_ELEM* elem = BT_MKID(bt_lookup_node)(&lru->tree, key, &node);
+    if (!elem)
+    {
+        lru->misses++;
+        return NULL;
+    }
+
+    lru->hits++;
+    node->used[elem - node->elems] = true;
+    return elem;
+}
+
+BT_MKFN(void, bt_lru_put, struct BT_MKID(bt_lru)* lru, BT_ELEM elem)
+{
+    BT_ELEM prev;
+    lru->bytes += BT_LRU_BYTES(&elem);
+    if (BT_MKID(bt_insert)(&lru->tree, elem, &prev))
+    {
+        lru->bytes -= BT_LRU_BYTES(&prev);
+        BT_ELEM_FREE(prev);
+    }
+
+    while (lru->bytes > lru->budget && BT_MKID(bt_lru_evict)(lru));
+}
+
+BT_MKFN(bool, bt_lru_remove, struct BT_MKID(bt_lru)* lru, const BT_KEY* key, BT_ELEM* removed)
+{
+    BT_ELEM elem;
+    if (!BT_MKID(bt_remove)(&lru->tree, key, &elem)) return false;
+
+    lru->bytes -= BT_LRU_BYTES(&elem);
+    if (removed) *removed = elem;
+    else BT_ELEM_FREE(elem);
+    return true;
+}
+
+BT_MKFN(size_t, bt_lru_evict, struct BT_MKID(bt_lru)* lru)
+{
+    // Find a whole batch first, so the tree is swept once for all of them.
+    BT_KEY victims[BT_LRU_BATCH];
+    size_t n = 0;
+
+    struct BT_MKID(bt_iter_dfs) iter = lru->has_hand
+        ? BT_MKID(bt_iter_dfs_seek)(&lru->tree, &lru->hand)
+        : BT_MKID(bt_iter_dfs_mk)(&lru->tree);
+
+    for (size_t seen = 0; n < BT_LRU_BATCH && seen < 2 * lru->tree.size; seen++)
+    {
+        BT_ELEM* elem = BT_MKID(bt_iter_dfs_next)(&iter);
+        if (!elem)
+        {
+            iter = BT_MKID(bt_iter_dfs_mk)(&lru->tree);
+            elem = BT_MKID(bt_iter_dfs_next)(&iter);
+        }
+
+        // The iterator returned an element of the node on top of its stack.
+        struct BT_MKID(bnode)* node = iter.stack[iter.top - 1].node;
+        size_t i = elem - node->elems;
+        if (node->used[i])
+        {
+            node->used[i] = false;
+            continue;
+        }
+
+        // Set the bit of a victim, so the hand skips it if it comes around.
+        node->used[i] = true;
+        victims[n++] = *BT_KEY_OF(elem);
+    }
+
+    BT_ELEM* next = BT_MKID(bt_iter_dfs_next)(&iter);
+    lru->has_hand = next != NULL;
+    if (next) lru->hand = *BT_KEY_OF(next);
+
+    for (size_t i = 0; i < n; i++) BT_MKID(bt_lru_remove)(lru, victims + i, NULL);
+    lru->evictions += n;
+    return n;
+}
+
+#endif
+
+#ifdef BT_SLOTTED
+
+BT_MKFN(struct BT_MKID(bt_slotted), bt_slotted_mk,)
+{
+    return (struct BT_MKID(bt_slotted)){ .root = BT_MKID(bt_spage_mk)(true), .pages = 1 };
+}
+
+BT_MKFN(void, bt_slotted_free, struct BT_MKID(bt_slotted) tree)
+{
+    BT_MKID(bt_spage_free)(tree.root);
+}
+
+BT_MKFN(struct BT_MKID(bt_spage)*, bt_spage_mk, bool leaf)
+{
+    struct BT_MKID(bt_spage)* page = malloc(sizeof(struct BT_MKID(bt_spage)));
+    page->n     = 0;
+    page->top   = BT_SLOTTED_DATA;
+    page->dead  = 0;
+    page->leaf  = leaf;
+    page->first = NULL;
+    return page;
+}
+
+BT_MKFN(void, bt_spage_free, struct BT_MKID(bt_spage)* page)
+{
+    if (!page->leaf)
+    {
+        for (size_t i = 0; i <= page->n; i++) BT_MKID(bt_spage_free)(BT_MKID(bt_spage_child)(page, i));
+    }
+    free(page);
+}
+
+BT_MKFN(int, bt_slotted_cmp, const void* a, size_t alen, const void* b, size_t blen)
+{
+    int cmp = memcmp(a, b, alen < blen ? alen : blen);
+    if (cmp) return cmp;
+    return (alen > blen) - (alen < blen);
+}
+
+BT_MKFN(const unsigned char*, bt_spage_key, const struct BT_MKID(bt_spage)* page, size_t i, size_t* klen)
+{
+    const unsigned char* cell = page->data + page->slots[i];
+    uint16_t len;
+    memcpy(&len, cell, sizeof(len));
+    *klen = len;
+    return cell + 4;
+}
+
+BT_MKFN(const unsigned char*, bt_spage_value, const struct BT_MKID(bt_spage)* page, size_t i, size_t* vlen)
+{
+    const unsigned char* cell = page->data + page->slots[i];
+    uint16_t klen, len;
+    memcpy(&klen, cell, sizeof(klen));
+    memcpy(&len, cell + 2, sizeof(len));
+    *vlen = len;
+    return cell + 4 + klen;
+}
+
+BT_MKFN(struct BT_MKID(bt_spage)*, bt_spage_child, const struct BT_MKID(bt_spage)* page, size_t i)
+{
+    if (!i) return page->first;
+
+    size_t vlen;
+    struct BT_MKID(bt_spage)* child;
+    memcpy(&child, BT_MKID(bt_spage_value)(page, i - 1, &vlen), sizeof(child));
+    return child;
+}
+
+BT_MKFN(ssize_t, bt_spage_bsearch, const struct BT_MKID(bt_spage)* page, const void* key, size_t klen)
+{
+    size_t left  = 0;
+    size_t right = page->n;
+    while (left < right)
+    {
+        size_t mid = left + (right - left) / 2;
+        size_t len;
+        const unsigned char* at = BT_MKID(bt_spage_key)(page, mid, &len);
+        int cmp = BT_MKID(bt_slotted_cmp)(key, klen, at, len);
+        if      (cmp > 0) left  = mid + 1;
+        else if (cmp < 0) right = mid;
+        else              return (ssize_t)mid;
+    }
+    return -(ssize_t)left - 1;
+}
+
+BT_MKFN(
+    void,
+    bt_spage_insert_at,
+    struct BT_MKID(bt_spage)* page, size_t i, const void* key, size_t klen, const void* value, size_t vlen
+) {
+    uint16_t lens[2] = { (uint16_t)klen, (uint16_t)vlen };
+    page->top -= sizeof(lens) + klen + vlen;
+    unsigned char* cell = page->data + page->top;
+    memcpy(cell, lens, sizeof(lens));
+    memcpy(cell + sizeof(lens), key, klen);
+    memcpy(cell + sizeof(lens) + klen, value, vlen);
+
+    memmove(page->slots + i + 1, page->slots + i, (page->n - i) * sizeof(uint16_t));
+    page->slots[i] = page->top;
+    page->n++;
+}
+
+BT_MKFN(void, bt_spage_erase, struct BT_MKID(bt_spage)* page, size_t i)
+{
+    size_t klen, vlen;
+    BT_MKID(bt_spage_value)(page, i, &vlen);
+    BT_MKID(bt_spage_key)(page, i, &klen);
+    page->dead += 4 + klen + vlen;
+
+    page->n--;
+    memmove(page->slots + i, page->slots + i + 1, (page->n - i) * sizeof(uint16_t));
+}
+
+BT_MKFN(bool, bt_spage_room, struct BT_MKID(bt_spage)* page, size_t size)
+{
+    size_t avail = page->top - page->n * sizeof(uint16_t);
+    if (avail >= size + sizeof(uint16_t)) return true;
+    if (avail + page->dead < size + sizeof(uint16_t)) return false;
+
+    // Rewrite the live cells at the end of the page, in slot order.
+    struct BT_MKID(bt_spage) copy;
+    memcpy(copy.data + page->top, page->data + page->top, BT_SLOTTED_DATA - page->top);
+    page->top  = BT_SLOTTED_DATA;
+    page->dead = 0;
+    for (size_t i = 0; i < page->n; i++)
+    {
+        const unsigned char* cell = copy.data + page->slots[i];
+        uint16_t lens[2];
+        memcpy(lens, cell, sizeof(lens));
+        page->top -= sizeof(lens) + lens[0] + lens[1];
+        memcpy(page->data + page->top, cell, sizeof(lens) + lens[0] + lens[1]);
+        page->slots[i] = page->top;
+    }
+    return true;
+}
+
+BT_MKFN(
+    struct BT_MKID(bt_spage)*,
+    bt_spage_split,
+    struct BT_MKID(bt_spage)* page, size_t i, const void* key, size_t klen, const void* value, size_t vlen,
+    bool last, unsigned char* sep, size_t* seplen
+) {
+    struct BT_MKID(bt_spage) copy;
+    memcpy(&copy, page, sizeof(copy));
+    size_t n = copy.n + 1;
+
+    // Entry `j` of the `n`, with the new one at `i`.
+#define ENTRY(j)                                                                            \
+    const void* k = key;                                                                    \
+    const void* v = value;                                                                  \
+    size_t kl = klen, vl = vlen;                                                            \
+    if ((j) != i)                                                                           \
+    {                                                                                       \
+        k = BT_MKID(bt_spage_key)(&copy, (j) - ((j) > i), &kl);                             \
+        v = BT_MKID(bt_spage_value)(&copy, (j) - ((j) > i), &vl);                           \
+    }
+
+    // Leaves keep at least one entry on each side. Inner pages move the entry
+    // at `mid` up, its child becoming the first of the new page.
+    size_t total = 0;
+    for (size_t j = 0; j < n; j++)
+    {
+        ENTRY(j);
+        (void)k, (void)v;
+        total += sizeof(uint16_t) + 4 + kl + vl;
+    }
+    size_t mid   = 0;
+    size_t bytes = 0;
+    while (mid < n - 1 && bytes < total / 2)
+    {
+        ENTRY(mid);
+        (void)k, (void)v;
+        bytes += sizeof(uint16_t) + 4 + kl + vl;
+        mid++;
+    }
+    if (page->leaf && !mid) mid = 1;
+    if (page->leaf && last && i == n - 1) mid = n - 1;
+
+    struct BT_MKID(bt_spage)* right = BT_MKID(bt_spage_mk)(page->leaf);
+    page->n    = 0;
+    page->top  = BT_SLOTTED_DATA;
+    page->dead = 0;
+    for (size_t j = 0; j < n; j++)
+    {
+        ENTRY(j);
+        if (j < mid) BT_MKID(bt_spage_insert_at)(page, page->n, k, kl, v, vl);
+        else if (j > mid || page->leaf) BT_MKID(bt_spage_insert_at)(right, right->n, k, kl, v, vl);
+        else
+        {
+            memcpy(&right->first, v, sizeof(right->first));
+            memcpy(sep, k, kl);
+            *seplen = kl;
+        }
+    }
+#undef ENTRY
+
+    if (page->leaf)
+    {
+        // The shortest prefix of the first key of `right` that is greater
+        // than the last key of `page`, which keeps inner pages small.
+        size_t llen, rlen;
+        const unsigned char* last  = BT_MKID(bt_spage_key)(page, page->n - 1, &llen);
+        const unsigned char* first = BT_MKID(bt_spage_key)(right, 0, &rlen);
+        size_t len = 0;
+        while (len < llen && last[len] == first[len]) len++;
+        *seplen = len + 1;
+        memcpy(sep, first, *seplen);
+    }
+    return right;
+}
+
+BT_MKFN(
+    struct BT_MKID(bt_spage)*,
+    bt_spage_put,
+    struct BT_MKID(bt_slotted)* tree, struct BT_MKID(bt_spage)* page, bool last,
+    const void* key, size_t klen, const void* value, size_t vlen,
+    unsigned char* sep, size_t* seplen, bool* replaced
+) {
+    ssize_t idx = BT_MKID(bt_spage_bsearch)(page, key, klen);
+    if (page->leaf)
+    {
+        size_t i = idx >= 0 ? (size_t)idx : (size_t)(-idx - 1);
+        if (idx >= 0)
+        {
+            *replaced = true;
+            size_t len;
+            unsigned char* at = (unsigned char*)BT_MKID(bt_spage_value)(page, i, &len);
+            if (len == vlen)
+            {
+                memcpy(at, value, vlen);
+                return NULL;
+            }
+            BT_MKID(bt_spage_erase)(page, i);
+        }
 
-    struct BT_MKID(bnode)* child = parent->children[idx];
+        if (BT_MKID(bt_spage_room)(page, 4 + klen + vlen))
+        {
+            BT_MKID(bt_spage_insert_at)(page, i, key, klen, value, vlen);
+            return NULL;
+        }
+        tree->pages++;
+        return BT_MKID(bt_spage_split)(page, i, key, klen, value, vlen, last, sep, seplen);
+    }
 
-    // Points to right sibling of `child`.
-    struct BT_MKID(bnode)** rchild = parent->children + idx + 1;
+    size_t i = idx >= 0 ? (size_t)idx + 1 : (size_t)(-idx - 1);
+    struct BT_MKID(bt_spage)* child = BT_MKID(bt_spage_child)(page, i);
+    struct BT_MKID(bt_spage)* right = BT_MKID(bt_spage_put)(
+        tree, child, last && i == page->n, key, klen, value, vlen, sep, seplen, replaced
+    );
+    if (!right) return NULL;
 
-    // Move rest of children to the right to make space for the new child.
-    memmove(rchild + 1, rchild, (parent->n - idx) * SIZEOF_PTR);
+    // The child split, add its new page after it.
+    if (BT_MKID(bt_spage_room)(page, 4 + *seplen + sizeof(right)))
+    {
+        BT_MKID(bt_spage_insert_at)(page, i, sep, *seplen, &right, sizeof(right));
+        return NULL;
+    }
+    unsigned char below[BT_SLOTTED_MAX];
+    size_t len = *seplen;
+    memcpy(below, sep, len);
+    tree->pages++;
+    return BT_MKID(bt_spage_split)(page, i, below, len, &right, sizeof(right), last, sep, seplen);
+}
 
-    // Allocate the split node sibling.
-    *rchild = calloc(1, sizeof(struct BT_MKID(bnode)));
+BT_MKFN(
+    bool,
+    bt_slotted_put,
+    struct BT_MKID(bt_slotted)* tree, const void* key, size_t klen, const void* value, size_t vlen
+) {
+    assert(klen + vlen <= BT_SLOTTED_MAX);
 
-    // Move half of the elements to the sibling.
-    memcpy((*rchild)->elems, child->elems + BT_FACTOR + 1, BT_FACTOR * sizeof(BT_ELEM));
+    unsigned char sep[BT_SLOTTED_MAX];
+    size_t seplen;
+    bool replaced = false;
+    struct BT_MKID(bt_spage)* right = BT_MKID(bt_spage_put)(
+        tree, tree->root, true, key, klen, value, vlen, sep, &seplen, &replaced
+    );
+    if (right)
+    {
+        struct BT_MKID(bt_spage)* root = BT_MKID(bt_spage_mk)(false);
+        root->first = tree->root;
+        BT_MKID(bt_spage_insert_at)(root, 0, sep, seplen, &right, sizeof(right));
+        tree->root = root;
+        tree->pages++;
+    }
+    if (!replaced) tree->size++;
+    return replaced;
+}
 
-    // If `child` is not a leaf (any of its children are not NULL), copy half of
-    // its children to the new node.
-    if (child->children[0])
-        memcpy((*rchild)->children, child->children + BT_FACTOR + 1, (BT_FACTOR + 1) * SIZEOF_PTR);
+BT_MKFN(
+    bool,
+    bt_slotted_get,
+    const struct BT_MKID(bt_slotted)* tree, const void* key, size_t klen, const void** value, size_t* vlen
+) {
+    const struct BT_MKID(bt_spage)* page = tree->root;
+    ssize_t idx;
+    while (!page->leaf)
+    {
+        idx  = BT_MKID(bt_spage_bsearch)(page, key, klen);
+        page = BT_MKID(bt_spage_child)(page, idx >= 0 ? (size_t)idx + 1 : (size_t)(-idx - 1));
+    }
 
-    (*rchild)->n = BT_FACTOR;
-    child->n     = BT_FACTOR;
+    idx = BT_MKID(bt_spage_bsearch)(page, key, klen);
+    if (idx < 0) return false;
+    *value = BT_MKID(bt_spage_value)(page, idx, vlen);
+    return true;
+}
 
-    return child->elems[BT_FACTOR];
+BT_MKFN(
+    bool,
+    bt_spage_remove,
+    struct BT_MKID(bt_slotted)* tree, struct BT_MKID(bt_spage)* page, const void* key, size_t klen, bool* empty
+) {
+    ssize_t idx = BT_MKID(bt_spage_bsearch)(page, key, klen);
+    if (page->leaf)
+    {
+        if (idx < 0) return false;
+        BT_MKID(bt_spage_erase)(page, idx);
+        *empty = !page->n;
+        return true;
+    }
 
-#undef SIZEOF_PTR
+    size_t i = idx >= 0 ? (size_t)idx + 1 : (size_t)(-idx - 1);
+    struct BT_MKID(bt_spage)* child = BT_MKID(bt_spage_child)(page, i);
+    bool gone = false;
+    if (!BT_MKID(bt_spage_remove)(tree, child, key, klen, &gone)) return false;
+    if (!gone) return true;
+
+    free(child);
+    tree->pages--;
+    if (!page->n)
+    {
+        *empty = true;
+        return true;
+    }
+
+    // Drop the child with the separator before it, or for the first child the
+    // first separator, whose child becomes the first.
+    if (!i) page->first = BT_MKID(bt_spage_child)(page, 1);
+    BT_MKID(bt_spage_erase)(page, i ? i - 1 : 0);
+    return true;
 }
 
-// Inserts `elem` into a btree of root `node`. Returns `true` if `elem` was
-// already present in the tree and, in that case, `prev` will be overwritten
-// with the replaced element from the tree.
-BT_MKFN(bool, bt_node_insert, struct BT_MKID(bnode)* node, BT_ELEM elem, BT_ELEM* prev)
+BT_MKFN(bool, bt_slotted_remove, struct BT_MKID(bt_slotted)* tree, const void* key, size_t klen)
 {
-    ssize_t idx = BT_MKID(bt_node_bsearch)(node, &elem);
+    bool empty = false;
+    if (!BT_MKID(bt_spage_remove)(tree, tree->root, key, klen, &empty)) return false;
+    tree->size--;
 
-    if (idx >= 0)
+    if (empty && !tree->root->leaf)
     {
-        if (prev) *prev = node->elems[idx];
-        else BT_ELEM_FREE(node->elems[idx]);
-        node->elems[idx] = elem;
-        return true;
+        free(tree->root);
+        tree->root = BT_MKID(bt_spage_mk)(true);
     }
+    while (!tree->root->leaf && !tree->root->n)
+    {
+        struct BT_MKID(bt_spage)* root = tree->root;
+        tree->root = root->first;
+        free(root);
+        tree->pages--;
+    }
+    return true;
+}
 
-    idx = -idx - 1;
-    struct BT_MKID(bnode)* child = node->children[idx];
-
-    // Check if `node` is a leaf
-    if (child)
+BT_MKFN(struct BT_MKID(bt_slotted_iter), bt_slotted_iter_seek, const struct BT_MKID(bt_slotted)* tree, const void* key, size_t klen)
+{
+    struct BT_MKID(bt_slotted_iter) iter = { .top = 0 };
+    struct BT_MKID(bt_spage)* page = tree->root;
+    for (;;)
     {
-        bool replaced = BT_MKID(bt_node_insert)(child, elem, prev);
-        // The insertion did not overflow the child, it's ok to return.
-        if (child->n <= 2 * BT_FACTOR) return replaced;
+        ssize_t idx = BT_MKID(bt_spage_bsearch)(page, key, klen);
+        size_t i = idx >= 0 ? (size_t)idx + !page->leaf : (size_t)(-idx - 1);
 
-        // The promoted element is what we want to insert in this node (since
-        // it's not a leaf).
-        elem = BT_MKID(bt_split_node)(node, idx);
+        assert(iter.top < BT_ITER_STACK_SIZE);
+        iter.stack[iter.top++] = (struct BT_MKID(bt_slotted_frame)){ i, page };
+        if (page->leaf) return iter;
+        page = BT_MKID(bt_spage_child)(page, i);
     }
+}
 
-    // Make space for the new element, and insert.
-    BT_ELEM* p = node->elems + idx;
-    memmove(p + 1, p, (node->n - idx) * sizeof(BT_ELEM));
+BT_MKFN(struct BT_MKID(bt_slotted_iter), bt_slotted_iter_mk, const struct BT_MKID(bt_slotted)* tree)
+{
+    return BT_MKID(bt_slotted_iter_seek)(tree, "", 0);
+}
 
-    // Just insert the element (may be the original element beeing inserted or
-    // the result of a promotion).
-    *p = elem;
-    node->n++;
+BT_MKFN(
+    bool,
+    bt_slotted_iter_next,
+    struct BT_MKID(bt_slotted_iter)* iter, const void** key, size_t* klen, const void** value, size_t* vlen
+) {
+    while (iter->top)
+    {
+        struct BT_MKID(bt_slotted_frame)* frame = iter->stack + iter->top - 1;
+        if (frame->page->leaf)
+        {
+            if (frame->i < frame->page->n)
+            {
+                *key   = BT_MKID(bt_spage_key)(frame->page, frame->i, klen);
+                *value = BT_MKID(bt_spage_value)(frame->page, frame->i, vlen);
+                frame->i++;
+                return true;
+            }
+            iter->top--;
+            continue;
+        }
 
+        // Done with the child being visited, go down the first path of the
+        // next one.
+        if (++frame->i > frame->page->n)
+        {
+            iter->top--;
+            continue;
+        }
+        struct BT_MKID(bt_spage)* page = BT_MKID(bt_spage_child)(frame->page, frame->i);
+        for (;;)
+        {
+            assert(iter->top < BT_ITER_STACK_SIZE);
+            iter->stack[iter->top++] = (struct BT_MKID(bt_slotted_frame)){ 0, page };
+            if (page->leaf) break;
+            page = page->first;
+        }
+    }
     return false;
 }
 
-BT_MKFN(bool, bt_insert, struct BT_MKID(bt)* bt, BT_ELEM elem, BT_ELEM* prev)
+#endif
+
+#ifdef BT_ARENA
+
+// Nodes are rounded up to whole cache lines.
+#define BT_ARENA_NODE ((sizeof(struct BT_MKID(bnode)) + 63) & ~(size_t)63)
+#define BT_ARENA_HUGE ((size_t)2 << 20)
+
+static _Thread_local struct BT_MKID(bt_arena) BT_MKID(bt_arena_local);
+
+// The shared pool. Nodes are given back in batches, each a list of nodes whose
+// first one also holds, in its next two words, the next batch and its count.
+// The rest of the chunks of released arenas start with their end and the next
+// one.
+static pthread_mutex_t BT_MKID(bt_arena_lock) = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic(void**) BT_MKID(bt_arena_batches);
+static _Atomic(void**) BT_MKID(bt_arena_spares);
+
+BT_MKFN(struct BT_MKID(bt_arena)*, bt_arena_get,)
 {
-    bool replaced = bt->root ? BT_MKID(bt_node_insert)(bt->root, elem, prev) : false;
-    if (!bt->root || bt->root->n > 2 * BT_FACTOR)
+    return &BT_MKID(bt_arena_local);
+}
+
+BT_MKFN(bool, bt_arena_grow, struct BT_MKID(bt_arena)* arena)
+{
+    void* chunk = MAP_FAILED;
+    bool huge = false;
+
+    // The flags are tested by system rather than by their macros, which
+    // `BT_GENERATE` would evaluate without the system headers.
+#if defined(BT_ARENA_HUGETLB) && defined(__linux__)
+    // Only succeeds if enough huge pages were reserved for hugetlbfs.
+    chunk = mmap(NULL, BT_ARENA_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    huge  = chunk != MAP_FAILED;
+#endif
+
+    if (chunk == MAP_FAILED)
     {
-        struct BT_MKID(bnode) *new_root = calloc(1, sizeof(struct BT_MKID(bnode)));
-        new_root->n            = 1;
-        new_root->children[0]  = bt->root;
-        new_root->elems[0]     = bt->root ? BT_MKID(bt_split_node)(new_root, 0) : elem;
-        bt->root = new_root;
+        // Map one huge page more, to keep only a part aligned on a huge page.
+        char* raw = mmap(NULL, BT_ARENA_CHUNK + BT_ARENA_HUGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) return false;
+
+        char* aligned = (char*)(((uintptr_t)raw + BT_ARENA_HUGE - 1) & ~(uintptr_t)(BT_ARENA_HUGE - 1));
+        if (aligned > raw) munmap(raw, aligned - raw);
+        munmap(aligned + BT_ARENA_CHUNK, raw + BT_ARENA_HUGE - aligned);
+        chunk = aligned;
+
+#ifdef __linux__
+        huge = !madvise(chunk, BT_ARENA_CHUNK, MADV_HUGEPAGE);
+#endif
     }
-    return replaced;
+
+#ifdef BT_NUMA
+    // Before the first write, so that the pages go to the node of this thread.
+    BT_MKID(bt_numa_bind)(chunk, BT_ARENA_CHUNK, BT_NUMA_NODE());
+#endif
+
+    arena->next = chunk;
+    arena->end  = (char*)chunk + BT_ARENA_CHUNK;
+    arena->chunks++;
+    arena->huge += huge;
+    return true;
 }
 
-BT_MKFN(void, bt_print, struct BT_MKID(bnode)* node, int depth)
+BT_MKFN(void*, bt_arena_alloc, size_t size)
 {
-#define INDENT for (int __i = 0; __i < depth; __i++) printf("  ")
-    if (!node)
+    assert(size == sizeof(struct BT_MKID(bnode)));
+    struct BT_MKID(bt_arena)* arena = &BT_MKID(bt_arena_local);
+
+    // Nodes freed by other threads come before the rest of this chunk, so that
+    // they're reused as soon as possible.
+    if (!arena->free) BT_MKID(bt_arena_take)(arena);
+
+    if (arena->free)
     {
-        INDENT;
-        printf("<empty>\n");
-        return;
+        void* node = arena->free;
+        memcpy(&arena->free, node, sizeof(void*));
+        arena->nfree--;
+        return memset(node, 0, size);
     }
 
-    INDENT;
-    printf("elems:");
-    for (int i = 0; i < node->n; i++)
-        printf(" %d", node->elems[i]);
-    printf("\n");
+    // Fresh chunks are zeroed by the kernel.
+    if ((size_t)(arena->end - arena->next) < BT_ARENA_NODE && !BT_MKID(bt_arena_grow)(arena))
+    {
+        arena->fallbacks++;
+        return calloc(1, size);
+    }
+    void* node = arena->next;
+    arena->next += BT_ARENA_NODE;
+    return node;
+}
 
-    if (!node->children[0]) return;
-    for (int i = 0; i <= node->n; i++)
-        BT_MKID(bt_print)(node->children[i], depth + 1);
+BT_MKFN(void, bt_arena_free, void* node)
+{
+    if (!node) return;
+    struct BT_MKID(bt_arena)* arena = &BT_MKID(bt_arena_local);
+    memcpy(node, &arena->free, sizeof(void*));
+    arena->free = node;
 
-#undef IDENT
+    // A thread that frees more than it allocates, like the consumer of a
+    // queue, would keep them all.
+    if (++arena->nfree >= 2 * BT_ARENA_CACHE) BT_MKID(bt_arena_give)(arena, BT_ARENA_CACHE);
 }
 
-#ifndef BT_ITER_STACK_SIZE
-// Allows for (2 * BT_FACTOR)^32 elements max. Even if BT_FACTOR is 1,
-// that's over 4M elements, which should be enough, if not, can always set
-// BT_ITER_STACK_SIZE to something larger.
-#define BT_ITER_STACK_SIZE 32
+BT_MKFN(void, bt_arena_release,)
+{
+    struct BT_MKID(bt_arena)* arena = &BT_MKID(bt_arena_local);
+    if (arena->nfree) BT_MKID(bt_arena_give)(arena, arena->nfree);
+
+    if ((size_t)(arena->end - arena->next) >= BT_ARENA_NODE)
+    {
+        void** spare = (void**)arena->next;
+        spare[0] = arena->end;
+        pthread_mutex_lock(&BT_MKID(bt_arena_lock));
+        spare[1] = atomic_load_explicit(&BT_MKID(bt_arena_spares), memory_order_relaxed);
+        atomic_store_explicit(&BT_MKID(bt_arena_spares), spare, memory_order_relaxed);
+        pthread_mutex_unlock(&BT_MKID(bt_arena_lock));
+    }
+    arena->next = arena->end = NULL;
+}
+
+BT_MKFN(void, bt_arena_give, struct BT_MKID(bt_arena)* arena, size_t count)
+{
+    // Detach the first `count` nodes outside of the lock.
+    void** batch = arena->free;
+    void** last  = batch;
+    for (size_t i = 1; i < count; i++) last = *last;
+    arena->free   = *last;
+    arena->nfree -= count;
+    *last = NULL;
+
+    batch[2] = (void*)(uintptr_t)count;
+    pthread_mutex_lock(&BT_MKID(bt_arena_lock));
+    batch[1] = atomic_load_explicit(&BT_MKID(bt_arena_batches), memory_order_relaxed);
+    atomic_store_explicit(&BT_MKID(bt_arena_batches), batch, memory_order_relaxed);
+    pthread_mutex_unlock(&BT_MKID(bt_arena_lock));
+}
+
+BT_MKFN(bool, bt_arena_take, struct BT_MKID(bt_arena)* arena)
+{
+    // Only a hint, so that allocations don't take the lock while the pool is
+    // empty: at worst a chunk is mapped, or the lock taken, for nothing.
+    bool room = (size_t)(arena->end - arena->next) >= BT_ARENA_NODE;
+    if (!atomic_load_explicit(&BT_MKID(bt_arena_batches), memory_order_relaxed)
+        && (room || !atomic_load_explicit(&BT_MKID(bt_arena_spares), memory_order_relaxed)))
+        return false;
+
+    bool took = false;
+    pthread_mutex_lock(&BT_MKID(bt_arena_lock));
+    void** batch = atomic_load_explicit(&BT_MKID(bt_arena_batches), memory_order_relaxed);
+    void** spare = atomic_load_explicit(&BT_MKID(bt_arena_spares), memory_order_relaxed);
+    if (batch)
+    {
+        atomic_store_explicit(&BT_MKID(bt_arena_batches), batch[1], memory_order_relaxed);
+        arena->free  = batch;
+        arena->nfree = (size_t)(uintptr_t)batch[2];
+        took = true;
+    }
+    else if (spare && !room)
+    {
+        // Whatever is left of this thread's chunk is too small for a node.
+        atomic_store_explicit(&BT_MKID(bt_arena_spares), spare[1], memory_order_relaxed);
+        arena->next = (char*)spare;
+        arena->end  = spare[0];
+        // The rest was never allocated, only these words were written.
+        spare[0] = spare[1] = NULL;
+        took = true;
+    }
+    pthread_mutex_unlock(&BT_MKID(bt_arena_lock));
+    return took;
+}
+
+#undef BT_ARENA_NODE
+#undef BT_ARENA_HUGE
+
 #endif
 
-struct BT_MKID(bt_iter_frame) {
-    size_t i;
-    struct BT_MKID(bnode)* node;
-};
+#ifdef BT_NUMA
 
-// In-Order Depth First Search iterator
-struct BT_MKID(bt_iter_dfs)
+BT_MKFN(void, bt_numa_init, struct BT_MKID(bt_numa)* numa, size_t nodes)
 {
-    size_t top;
-    struct BT_MKID( bt_iter_frame ) stack[BT_ITER_STACK_SIZE];
-};
+    numa->tree     = BT_MKID(bt_mk)();
+    numa->nodes    = nodes ? nodes : BT_MKID(bt_numa_nodes)();
+    numa->replicas = aligned_alloc(64, numa->nodes * sizeof(struct BT_MKID(bt_numa_replica)));
+    memset(numa->replicas, 0, numa->nodes * sizeof(struct BT_MKID(bt_numa_replica)));
+    numa->stale    = false;
+    atomic_init(&numa->lookups, 0);
+    for (size_t i = 0; i < numa->nodes; i++)
+        pthread_rwlock_init(&numa->replicas[i].lock, NULL);
+}
 
-BT_MKFN(struct BT_MKID(bt_iter_dfs), bt_iter_dfs_mk, struct BT_MKID(bt)* btree)
+BT_MKFN(void, bt_numa_destroy, struct BT_MKID(bt_numa)* numa)
 {
-    return (struct BT_MKID(bt_iter_dfs)) {
-        .top = 1,
-        .stack = {
-            [0] = {
-                .i = 0,
-                .node = btree->root
-            }
-        },
-    };
+    BT_MKID(bt_numa_drop)(numa);
+    for (size_t i = 0; i < numa->nodes; i++)
+        pthread_rwlock_destroy(&numa->replicas[i].lock);
+    free(numa->replicas);
+    BT_MKID(bt_free)(numa->tree);
 }
 
-BT_MKFN(BT_ELEM*, bt_iter_dfs_next, struct BT_MKID(bt_iter_dfs)* iter)
+BT_MKFN(bool, bt_numa_lookup, struct BT_MKID(bt_numa)* numa, const BT_KEY* key, BT_ELEM* elem)
 {
-    // The frame pointer.
-    struct BT_MKID(bt_iter_frame)* fp = iter->stack + iter->top - 1;
-    bool visited_child = false;
-    while (true)
+    struct BT_MKID(bt_numa_replica)* replica = numa->replicas + BT_NUMA_NODE() % numa->nodes;
+    pthread_rwlock_rdlock(&replica->lock);
+
+    // Only descends, `bt_lookup` may write to the cache.
+    const struct BT_MKID(bt) view = { .root = replica->root ? replica->root : numa->tree.root };
+    BT_ELEM* found = BT_MKID(bt_lookup_node)(&view, key, NULL);
+    if (found && elem) *elem = *found;
+
+    // Only one of the lookups since the copies were dropped rebuilds them, so
+    // that read mostly trees don't keep using the tree after a write.
+    bool rebuild = numa->stale
+        && atomic_fetch_add_explicit(&numa->lookups, 1, memory_order_relaxed) + 1 == BT_NUMA_REFRESH;
+
+    pthread_rwlock_unlock(&replica->lock);
+    if (rebuild) BT_MKID(bt_numa_sync)(numa);
+    return found != NULL;
+}
+
+BT_MKFN(bool, bt_numa_insert, struct BT_MKID(bt_numa)* numa, BT_ELEM elem, BT_ELEM* prev)
+{
+    BT_MKID(bt_numa_write_lock)(numa);
+    // Even a replaced element may have been copied.
+    bool replaced = BT_MKID(bt_insert)(&numa->tree, elem, prev);
+    BT_MKID(bt_numa_wrote)(numa);
+    BT_MKID(bt_numa_write_unlock)(numa);
+    return replaced;
+}
+
+BT_MKFN(bool, bt_numa_remove, struct BT_MKID(bt_numa)* numa, const BT_KEY* key, BT_ELEM* removed)
+{
+    BT_MKID(bt_numa_write_lock)(numa);
+    bool found = BT_MKID(bt_remove)(&numa->tree, key, removed);
+    if (found) BT_MKID(bt_numa_wrote)(numa);
+    BT_MKID(bt_numa_write_unlock)(numa);
+    return found;
+}
+
+BT_MKFN(void, bt_numa_sync, struct BT_MKID(bt_numa)* numa)
+{
+    BT_MKID(bt_numa_write_lock)(numa);
+    BT_MKID(bt_numa_rebuild)(numa);
+    BT_MKID(bt_numa_write_unlock)(numa);
+}
+
+BT_MKFN(void, bt_numa_write_lock, struct BT_MKID(bt_numa)* numa)
+{
+    for (size_t i = 0; i < numa->nodes; i++)
+        pthread_rwlock_wrlock(&numa->replicas[i].lock);
+}
+
+BT_MKFN(void, bt_numa_write_unlock, struct BT_MKID(bt_numa)* numa)
+{
+    for (size_t i = numa->nodes; i-- > 0;)
+        pthread_rwlock_unlock(&numa->replicas[i].lock);
+}
+
+BT_MKFN(void, bt_numa_wrote, struct BT_MKID(bt_numa)* numa)
+{
+    // The copies point to nodes the write may have freed.
+    if (numa->stale) return;
+    BT_MKID(bt_numa_drop)(numa);
+    numa->stale = true;
+    atomic_store_explicit(&numa->lookups, 0, memory_order_relaxed);
+}
+
+BT_MKFN(void, bt_numa_drop, struct BT_MKID(bt_numa)* numa)
+{
+    for (size_t i = 0; i < numa->nodes; i++)
     {
-        if (!fp->node) return NULL;
+        struct BT_MKID(bt_numa_replica)* replica = numa->replicas + i;
+        if (replica->mem) munmap(replica->mem, replica->bytes);
+        replica->root  = NULL;
+        replica->mem   = NULL;
+        replica->bytes = 0;
+    }
+}
 
-        if (fp->i > fp->node->n)
-        {
-            // If already at the bottom of the stack, we're done! We don't want
-            // to make the stack empty because in successive calls the caller
-            // may expect to receive `NULL` every time.
-            if (iter->top == 1) return NULL;
+BT_MKFN(void, bt_numa_rebuild, struct BT_MKID(bt_numa)* numa)
+{
+    BT_MKID(bt_numa_drop)(numa);
+    numa->stale = false;
 
-            // Pops a frame from the stack and yields a value if it can.
-            iter->top--;
-            fp--;
+    // Leaves are never copied, they're most of the tree and most of the writes.
+    size_t height = 0;
+    for (struct BT_MKID(bnode)* node = numa->tree.root; node; node = node->children[0]) height++;
+    size_t levels = height > BT_NUMA_LEVELS ? BT_NUMA_LEVELS : height ? height - 1 : 0;
+    if (!levels) return;
 
-            // Mark that we just came back from visiting the ith child.
-            visited_child = true;
-        }
-        else if (fp->node->children[fp->i] && !visited_child)
-        {
-            // Pushes a frame in the stack.
-            struct BT_MKID(bt_iter_frame)* new_fp = fp + 1;
-            iter->top++;
-            new_fp->i = 0;
-            new_fp->node = fp->node->children[fp->i];
-            fp = new_fp;
-        }
-        else if (fp->i < fp->node->n)
-        {
-            return fp->node->elems + fp->i++;
-        }
-        else
-        {
-            fp->i++;
-        }
+    size_t bytes = BT_MKID(bt_numa_count)(numa->tree.root, levels) * sizeof(struct BT_MKID(bnode));
+    for (size_t i = 0; i < numa->nodes; i++)
+    {
+        // Lookups on this node use the tree if it can't be mapped.
+        void* mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) continue;
+        BT_MKID(bt_numa_bind)(mem, bytes, i);
+
+        struct BT_MKID(bnode)* next = mem;
+        struct BT_MKID(bt_numa_replica)* replica = numa->replicas + i;
+        replica->root  = BT_MKID(bt_numa_copy)(numa->tree.root, levels, &next);
+        replica->mem   = mem;
+        replica->bytes = bytes;
+    }
+}
+
+BT_MKFN(size_t, bt_numa_count, const struct BT_MKID(bnode)* node, size_t levels)
+{
+    size_t count = 1;
+    if (levels > 1)
+    {
+        for (size_t i = 0; i <= node->n; i++)
+            count += BT_MKID(bt_numa_count)(node->children[i], levels - 1);
+    }
+    return count;
+}
+
+BT_MKFN(
+    struct BT_MKID(bnode)*,
+    bt_numa_copy,
+    const struct BT_MKID(bnode)* node, size_t levels, struct BT_MKID(bnode)** next
+) {
+    struct BT_MKID(bnode)* copy = (*next)++;
+    memcpy(copy, node, sizeof(struct BT_MKID(bnode)));
+    if (levels > 1)
+    {
+        for (size_t i = 0; i <= node->n; i++)
+            copy->children[i] = BT_MKID(bt_numa_copy)(node->children[i], levels - 1, next);
+    }
+    return copy;
+}
+
+BT_MKFN(size_t, bt_numa_nodes,)
+{
+    // A list of ranges, like `0-3` or `0,2-3`.
+    FILE* file = fopen("/sys/devices/system/node/online", "r");
+    if (!file) return 1;
+    unsigned node, last = 0;
+    while (fscanf(file, "%u", &node) == 1)
+    {
+        if (node > last) last = node;
+        int c = fgetc(file);
+        if (c != ',' && c != '-') break;
+    }
+    fclose(file);
+    return (size_t)last + 1;
+}
+
+// Node of the calling thread.
+static _Thread_local size_t BT_MKID(bt_numa_local);
+
+// The system calls are tested by system rather than by their numbers, which
+// `BT_GENERATE` would evaluate without the system headers.
+BT_MKFN(size_t, bt_numa_node,)
+{
+#ifdef __linux__
+    // Threads rarely move to another node, so it's only read once every 1024
+    // calls.
+    static _Thread_local size_t calls;
+    if (!(calls++ & 1023))
+    {
+        unsigned cpu, node;
+        BT_MKID(bt_numa_local) = syscall(SYS_getcpu, &cpu, &node, NULL) ? 0 : node;
     }
+#endif
+    return BT_MKID(bt_numa_local);
+}
+
+BT_MKFN(void, bt_numa_bind, void* mem, size_t bytes, size_t node)
+{
+#ifdef __linux__
+    // `MPOL_PREFERRED`, from <linux/mempolicy.h>: the pages go to `node` while
+    // it has free memory. Fails when there's no such node.
+    unsigned long mask[16] = { 0 };
+    size_t bits = 8 * sizeof(unsigned long);
+    if (node >= 16 * bits) return;
+    mask[node / bits] = 1ul << node % bits;
+    syscall(SYS_mbind, mem, bytes, 1, mask, 16 * bits, 0);
+#else
+    (void)mem;
+    (void)bytes;
+    (void)node;
+#endif
 }
 
 #endif
@@ -464,11 +5434,72 @@ BT_MKFN(BT_ELEM*, bt_iter_dfs_next, struct BT_MKID(bt_iter_dfs)* iter)
 // #endif
 
 #undef BT_ELEM
+#undef BT_KEY
+#undef BT_KEY_OF
 #undef BT_MKID
 #undef BT_CMP
+#undef BT_HASH
 #undef BT_LESS
 #undef BT_MKFN
 #undef BT_FACTOR
+#undef BT_LINEAR_SEARCH
+#undef BT_PREFETCH
+#undef BT_NORMALIZE
+#undef BT_NORM_TYPE
+#undef BT_KEY_BYTES
+#undef BT_KEY_STRUCT
+#undef BT_ELEM_FREE
+#undef BT_BLOOM
+#undef BT_BLOOM_BITS_PER_KEY
+#undef BT_CACHE
+#undef BT_CACHE_SIZE
+#undef BT_LEARNED
+#undef BT_LEARNED_POS
+#undef BT_LEARNED_ERROR
+#undef BT_LEARNED_REFRESH
+#undef BT_HASH_INDEX
+#undef BT_RADIX
+#undef BT_RADIX_KEY
+#undef BT_RADIX_FILL
+#undef BT_RADIX_MAX_BITS
+#undef BT_SHARDS
+#undef BT_SHARDS_MIN
+#undef BT_RW
+#undef BT_RW_SLOTS
+#undef BT_RW_BATCH
+#undef BT_BLINK
+#undef BT_EPOCH
+#undef BT_EPOCH_BATCH
+#undef BT_MVCC
+#undef BT_TXN
+#undef BT_AUGMENT
+#undef BT_AUG_TYPE
+#undef BT_AUG_OF
+#undef BT_AUG_MERGE
+#undef BT_INTERVAL
+#undef BT_INTERVAL_END
+#undef BT_TTL
+#undef BT_TTL_TYPE
+#undef BT_TTL_EXPIRY
+#undef BT_LRU
+#undef BT_LRU_BYTES
+#undef BT_LRU_BATCH
+#undef BT_SLOTTED
+#undef BT_SLOTTED_PAGE
+#undef BT_SLOTTED_DATA
+#undef BT_SLOTTED_MAX
+#undef BT_ARENA
+#undef BT_ARENA_CHUNK
+#undef BT_ARENA_HUGETLB
+#undef BT_ARENA_CACHE
+#undef BT_NUMA
+#undef BT_NUMA_LEVELS
+#undef BT_NUMA_REFRESH
+#undef BT_NUMA_NODE
+#undef BT_NODE_ALLOC
+#undef BT_NODE_FREE
 #undef BT_DECL_ONLY
+#undef BT_IMPL_ONLY
+#undef BT_ITER_STACK_SIZE
 #undef BT_GENERATE
 
@@ -0,0 +1,850 @@
+/**
+ * > BTree - C++ containers built on the same btree as `mk_bt.h`.
+ *
+ * Author: Gabriel Dertoni - https://github.com/GabrielDertoni
+ *
+ * `mk_bt.h` moves elements around with `memcpy` and `memmove`, so its
+ * `BT_ELEM` must be trivially copyable. This header implements the same
+ * algorithms (top down insertion, splitting a child once it overflows to
+ * 2 * factor + 1 elements) as templates, so elements are moved with their move
+ * constructors when they need to be and comparisons are inlined. The
+ * containers mirror `std::set` and `std::map`:
+ *
+ * ```cpp
+ * mk_bt::btree_set<std::string> names;
+ * names.insert("btree");
+ *
+ * mk_bt::btree_map<int, std::string, std::less<int>, 512> by_id;
+ * by_id[42] = "answer";
+ * ```
+ *
+ * The third parameter is the target node size in bytes, from which the
+ * branching factor is derived at compile time (`btree_set<T>::factor`).
+ *
+ * Removal (`erase`) follows `bt_remove`: the predecessor takes the place of an
+ * element removed from an inner node, and a node left with fewer than `factor`
+ * elements borrows from a sibling or is merged with one. Requires C++17.
+ */
+
+#ifndef _MK_BT_HPP_
+#define _MK_BT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace mk_bt {
+
+namespace detail {
+
+// Largest factor for which a node, that holds up to 2 * factor + 1 elements and
+// 2 * factor + 2 children besides its header, fits in `NodeBytes`. Never less
+// than 1.
+template <class Slot, std::size_t NodeBytes>
+constexpr std::size_t factor_for()
+{
+    constexpr std::size_t header = sizeof(std::uint32_t) + sizeof(void*);
+    constexpr std::size_t fixed  = header + sizeof(Slot) + 2 * sizeof(void*);
+    constexpr std::size_t pair   = 2 * (sizeof(Slot) + sizeof(void*));
+    return NodeBytes >= fixed + pair ? (NodeBytes - fixed) / pair : 1;
+}
+
+template <class Compare, class = void>
+struct is_transparent : std::false_type {};
+
+template <class Compare>
+struct is_transparent<Compare, std::void_t<typename Compare::is_transparent>> : std::true_type {};
+
+// Picks the type of the key argument of lookups. It's an alias template rather
+// than `std::conditional_t` so that `K` can still be deduced.
+template <bool Transparent>
+struct key_arg
+{
+    template <class K, class Key>
+    using type = Key;
+};
+
+template <>
+struct key_arg<true>
+{
+    template <class K, class Key>
+    using type = K;
+};
+
+template <class T, class Compare, std::size_t NodeBytes>
+struct set_params
+{
+    using key_type    = T;
+    using value_type  = T;
+    using slot_type   = T;
+    using key_compare = Compare;
+
+    static constexpr std::size_t node_bytes = NodeBytes;
+    static constexpr bool        is_set     = true;
+
+    static const key_type& key(const slot_type& slot) { return slot; }
+    static value_type& value(slot_type& slot) { return slot; }
+};
+
+template <class K, class V, class Compare, std::size_t NodeBytes>
+struct map_params
+{
+    using key_type    = K;
+    using mapped_type = V;
+    using value_type  = std::pair<const K, V>;
+    // Elements are only ever moved by constructing a new one and destroying the
+    // old one, which works with a const key (it's copied, not moved).
+    using slot_type   = value_type;
+    using key_compare = Compare;
+
+    static constexpr std::size_t node_bytes = NodeBytes;
+    static constexpr bool        is_set     = false;
+
+    static const key_type& key(const slot_type& slot) { return slot.first; }
+    static value_type& value(slot_type& slot) { return slot; }
+};
+
+template <class Params>
+class btree
+{
+    using slot_type = typename Params::slot_type;
+
+public:
+    using key_type        = typename Params::key_type;
+    using value_type      = typename Params::value_type;
+    using key_compare     = typename Params::key_compare;
+    using size_type       = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference       = value_type&;
+    using const_reference = const value_type&;
+
+    static constexpr std::size_t factor = factor_for<slot_type, Params::node_bytes>();
+
+private:
+    struct node
+    {
+        std::uint32_t n = 0;
+        node* parent    = nullptr;
+        // One more child and element than allowed in order to facilitate the
+        // split operation, just like `struct bnode`.
+        alignas(slot_type) unsigned char storage[(2 * factor + 1) * sizeof(slot_type)];
+        node* children[2 * factor + 2] = {};
+
+        slot_type* elems() { return reinterpret_cast<slot_type*>(storage); }
+        const slot_type* elems() const { return reinterpret_cast<const slot_type*>(storage); }
+        bool leaf() const { return !children[0]; }
+
+        // Index of `child` in the `children` array.
+        std::size_t index_of(const node* child) const
+        {
+            std::size_t i = 0;
+            while (children[i] != child) i++;
+            return i;
+        }
+    };
+
+    // Lookups with a type other than `key_type` are only allowed when the
+    // comparator is transparent, like in `std::set`.
+    template <class K>
+    using key_arg = typename detail::key_arg<is_transparent<key_compare>::value>::template type<K, key_type>;
+
+public:
+    template <bool Const>
+    class basic_iterator
+    {
+        friend class btree;
+        template <bool> friend class basic_iterator;
+
+        using tree_ptr = std::conditional_t<Const, const btree*, btree*>;
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type        = typename btree::value_type;
+        using difference_type   = std::ptrdiff_t;
+        using reference         = std::conditional_t<Const, const value_type&, value_type&>;
+        using pointer           = std::conditional_t<Const, const value_type*, value_type*>;
+
+        basic_iterator() = default;
+
+        // Allow conversion from `iterator` to `const_iterator`.
+        template <bool C = Const, class = std::enable_if_t<C>>
+        basic_iterator(const basic_iterator<false>& other)
+            : tree_(other.tree_), node_(other.node_), i_(other.i_) {}
+
+        reference operator*() const { return Params::value(node_->elems()[i_]); }
+        pointer operator->() const { return &**this; }
+
+        basic_iterator& operator++()
+        {
+            if (!node_->leaf())
+            {
+                // The successor is the leftmost element of the right subtree.
+                node_ = node_->children[i_ + 1];
+                while (!node_->leaf()) node_ = node_->children[0];
+                i_ = 0;
+                return *this;
+            }
+
+            if (++i_ < node_->n) return *this;
+
+            // Climb until we come from a child that has an element to its right.
+            while (node_->parent)
+            {
+                node* parent = node_->parent;
+                i_    = parent->index_of(node_);
+                node_ = parent;
+                if (i_ < node_->n) return *this;
+            }
+
+            node_ = nullptr;
+            i_    = 0;
+            return *this;
+        }
+
+        basic_iterator& operator--()
+        {
+            if (!node_)
+            {
+                node_ = tree_->root_;
+                while (!node_->leaf()) node_ = node_->children[node_->n];
+                i_ = node_->n - 1;
+                return *this;
+            }
+
+            if (!node_->leaf())
+            {
+                // The predecessor is the rightmost element of the left subtree.
+                node_ = node_->children[i_];
+                while (!node_->leaf()) node_ = node_->children[node_->n];
+                i_ = node_->n - 1;
+                return *this;
+            }
+
+            if (i_ > 0)
+            {
+                i_--;
+                return *this;
+            }
+
+            // Climb until we come from a child that has an element to its left.
+            // Decrementing `begin()` is undefined, as usual.
+            std::size_t j;
+            do
+            {
+                node* parent = node_->parent;
+                j     = parent->index_of(node_);
+                node_ = parent;
+            }
+            while (j == 0);
+
+            i_ = j - 1;
+            return *this;
+        }
+
+        basic_iterator operator++(int) { basic_iterator it = *this; ++*this; return it; }
+        basic_iterator operator--(int) { basic_iterator it = *this; --*this; return it; }
+
+        friend bool operator==(const basic_iterator& a, const basic_iterator& b)
+        {
+            return a.node_ == b.node_ && a.i_ == b.i_;
+        }
+
+        friend bool operator!=(const basic_iterator& a, const basic_iterator& b)
+        {
+            return !(a == b);
+        }
+
+    private:
+        basic_iterator(tree_ptr tree, node* n, std::size_t i) : tree_(tree), node_(n), i_(i) {}
+
+        tree_ptr    tree_ = nullptr;
+        node*       node_ = nullptr;
+        std::size_t i_    = 0;
+    };
+
+    using const_iterator = basic_iterator<true>;
+    // Elements of a set can't be changed through an iterator since that could
+    // break the ordering.
+    using iterator = std::conditional_t<Params::is_set, const_iterator, basic_iterator<false>>;
+
+    btree() = default;
+    explicit btree(const key_compare& comp) : comp_(comp) {}
+
+    btree(const btree& other) : comp_(other.comp_), size_(other.size_)
+    {
+        root_ = clone(other.root_, nullptr);
+    }
+
+    btree(btree&& other) noexcept
+        : root_(std::exchange(other.root_, nullptr)),
+          comp_(std::move(other.comp_)),
+          size_(std::exchange(other.size_, 0)) {}
+
+    btree& operator=(btree other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    ~btree() { destroy(root_); }
+
+    void swap(btree& other) noexcept
+    {
+        using std::swap;
+        swap(root_, other.root_);
+        swap(comp_, other.comp_);
+        swap(size_, other.size_);
+    }
+
+    iterator begin()
+    {
+        if (!root_) return end();
+        node* n = root_;
+        while (!n->leaf()) n = n->children[0];
+        return iterator(this, n, 0);
+    }
+
+    const_iterator begin() const { return const_cast<btree*>(this)->begin(); }
+    const_iterator cbegin() const { return begin(); }
+    iterator end() { return iterator(this, nullptr, 0); }
+    const_iterator end() const { return const_iterator(this, nullptr, 0); }
+    const_iterator cend() const { return end(); }
+
+    size_type size() const { return size_; }
+    bool empty() const { return !size_; }
+    key_compare key_comp() const { return comp_; }
+
+    void clear()
+    {
+        destroy(root_);
+        root_ = nullptr;
+        size_ = 0;
+    }
+
+    // Inserts an element constructed from `args`, unless there already is one
+    // that compares equal. Returns an iterator to the element with that key and
+    // whether the insertion happened.
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        slot_type slot(std::forward<Args>(args)...);
+        return insert_slot(slot);
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value) { return emplace(value); }
+    std::pair<iterator, bool> insert(value_type&& value) { return emplace(std::move(value)); }
+
+    template <class It>
+    void insert(It first, It last)
+    {
+        for (; first != last; ++first) emplace(*first);
+    }
+
+    void insert(std::initializer_list<value_type> values) { insert(values.begin(), values.end()); }
+
+    // Removes the element with `key`, if there's one. Returns how many were
+    // removed.
+    size_type erase(const key_type& key)
+    {
+        alignas(slot_type) unsigned char storage[sizeof(slot_type)];
+        slot_type* removed = reinterpret_cast<slot_type*>(storage);
+        if (!remove_slot(key, removed)) return 0;
+        removed->~slot_type();
+        return 1;
+    }
+
+    // Removes the element at `pos`, which must be dereferenceable. Returns an
+    // iterator to the element that followed it.
+    iterator erase(const_iterator pos)
+    {
+        alignas(slot_type) unsigned char storage[sizeof(slot_type)];
+        slot_type* removed = reinterpret_cast<slot_type*>(storage);
+        // The key is only compared with until the element is moved out.
+        remove_slot(Params::key(pos.node_->elems()[pos.i_]), removed);
+        iterator next = lower_bound(Params::key(*removed));
+        removed->~slot_type();
+        return next;
+    }
+
+    // Maps have a distinct `iterator`, taken too so that passing one isn't
+    // ambiguous.
+    template <bool Set = Params::is_set, class = std::enable_if_t<!Set>>
+    iterator erase(iterator pos) { return erase(const_iterator(pos)); }
+
+    template <class K = key_type>
+    iterator find(const key_arg<K>& key)
+    {
+        node* n = root_;
+        while (n)
+        {
+            auto [idx, found] = search(n, key);
+            if (found) return iterator(this, n, idx);
+            n = n->children[idx];
+        }
+        return end();
+    }
+
+    template <class K = key_type>
+    const_iterator find(const key_arg<K>& key) const
+    {
+        return const_cast<btree*>(this)->template find<K>(key);
+    }
+
+    template <class K = key_type>
+    bool contains(const key_arg<K>& key) const { return find<K>(key) != end(); }
+
+    template <class K = key_type>
+    size_type count(const key_arg<K>& key) const { return contains<K>(key); }
+
+    // First element that is not less than `key`.
+    template <class K = key_type>
+    iterator lower_bound(const key_arg<K>& key)
+    {
+        node* n = root_;
+        while (n)
+        {
+            auto [idx, found] = search(n, key);
+            if (found) return iterator(this, n, idx);
+            if (n->leaf()) return settle(n, idx);
+            n = n->children[idx];
+        }
+        return end();
+    }
+
+    template <class K = key_type>
+    const_iterator lower_bound(const key_arg<K>& key) const
+    {
+        return const_cast<btree*>(this)->template lower_bound<K>(key);
+    }
+
+    // First element that is greater than `key`.
+    template <class K = key_type>
+    iterator upper_bound(const key_arg<K>& key)
+    {
+        iterator it = lower_bound<K>(key);
+        if (it != end() && !comp_(key, Params::key(it.node_->elems()[it.i_]))) ++it;
+        return it;
+    }
+
+    template <class K = key_type>
+    const_iterator upper_bound(const key_arg<K>& key) const
+    {
+        return const_cast<btree*>(this)->template upper_bound<K>(key);
+    }
+
+protected:
+    // Looks up `key` and inserts a default constructed value if it is missing,
+    // used by the `operator[]` of maps.
+    template <class K, class... Args>
+    std::pair<iterator, bool> try_emplace_impl(K&& key, Args&&... args)
+    {
+        iterator it = find(key);
+        if (it != end()) return { it, false };
+        return emplace(std::piecewise_construct,
+                       std::forward_as_tuple(std::forward<K>(key)),
+                       std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+private:
+    // Same contract as `bt_node_bsearch` but as a pair: the index of the first
+    // element not less than `key` and whether it compares equal to `key`.
+    template <class K>
+    std::pair<std::size_t, bool> search(const node* n, const K& key) const
+    {
+        std::size_t left  = 0;
+        std::size_t right = n->n;
+        while (left < right)
+        {
+            std::size_t mid = left + (right - left) / 2;
+            if (comp_(Params::key(n->elems()[mid]), key)) left  = mid + 1;
+            else                                          right = mid;
+        }
+        return { left, left < n->n && !comp_(key, Params::key(n->elems()[left])) };
+    }
+
+    // Moves `count` elements from `src` to the uninitialized `dst`, leaving
+    // `src` uninitialized. The ranges may overlap.
+    static void relocate(slot_type* dst, slot_type* src, std::size_t count)
+    {
+        if constexpr (std::is_trivially_copyable_v<slot_type>)
+        {
+            std::memmove(static_cast<void*>(dst), src, count * sizeof(slot_type));
+        }
+        else if (dst > src)
+        {
+            for (std::size_t i = count; i-- > 0;)
+            {
+                ::new (dst + i) slot_type(std::move(src[i]));
+                src[i].~slot_type();
+            }
+        }
+        else
+        {
+            for (std::size_t i = 0; i < count; i++)
+            {
+                ::new (dst + i) slot_type(std::move(src[i]));
+                src[i].~slot_type();
+            }
+        }
+    }
+
+    // Iterator to the element at `idx` in the leaf `n`, or to the next one in
+    // order if `idx` is past the end of the leaf.
+    iterator settle(node* n, std::size_t idx)
+    {
+        while (idx == n->n)
+        {
+            if (!n->parent) return end();
+            idx = n->parent->index_of(n);
+            n   = n->parent;
+        }
+        return iterator(this, n, idx);
+    }
+
+    // Splits the full child at `idx` of `parent`, moving its upper half to a
+    // new right sibling and its middle element to `parent` at `idx`. Same as
+    // `bt_split_node` followed by the insertion of the promoted element.
+    static void split(node* parent, std::size_t idx)
+    {
+        node* child   = parent->children[idx];
+        node* sibling = new node();
+
+        relocate(sibling->elems(), child->elems() + factor + 1, factor);
+        if (!child->leaf())
+        {
+            for (std::size_t i = 0; i <= factor; i++)
+            {
+                sibling->children[i] = child->children[factor + 1 + i];
+                sibling->children[i]->parent = sibling;
+                child->children[factor + 1 + i] = nullptr;
+            }
+        }
+        sibling->n      = factor;
+        sibling->parent = parent;
+
+        std::memmove(parent->children + idx + 2, parent->children + idx + 1,
+                     (parent->n - idx) * sizeof(node*));
+        parent->children[idx + 1] = sibling;
+
+        relocate(parent->elems() + idx + 1, parent->elems() + idx, parent->n - idx);
+        relocate(parent->elems() + idx, child->elems() + factor, 1);
+
+        parent->n++;
+        child->n = factor;
+    }
+
+    // After the child at `idx` of `parent` was split, updates the position of
+    // an element that was in that child.
+    static void track_split(node* parent, std::size_t idx, node*& at, std::size_t& at_i)
+    {
+        if (at != parent->children[idx] || at_i < factor) return;
+        if (at_i == factor)
+        {
+            at   = parent;
+            at_i = idx;
+        }
+        else
+        {
+            at   = parent->children[idx + 1];
+            at_i = at_i - factor - 1;
+        }
+    }
+
+    // Inserts `slot` into the subtree of `n` by moving from it, unless an equal
+    // element is already there. Either way, `at` and `at_i` are set to where
+    // the element with that key ends up.
+    bool node_insert(node* n, slot_type& slot, node*& at, std::size_t& at_i)
+    {
+        auto [idx, found] = search(n, Params::key(slot));
+        if (found)
+        {
+            at   = n;
+            at_i = idx;
+            return false;
+        }
+
+        if (node* child = n->children[idx])
+        {
+            bool inserted = node_insert(child, slot, at, at_i);
+            // The insertion did not overflow the child, it's ok to return.
+            if (child->n <= 2 * factor) return inserted;
+            split(n, idx);
+            track_split(n, idx, at, at_i);
+            return inserted;
+        }
+
+        relocate(n->elems() + idx + 1, n->elems() + idx, n->n - idx);
+        ::new (n->elems() + idx) slot_type(std::move(slot));
+        n->n++;
+
+        at   = n;
+        at_i = idx;
+        return true;
+    }
+
+    std::pair<iterator, bool> insert_slot(slot_type& slot)
+    {
+        if (!root_)
+        {
+            root_ = new node();
+            ::new (root_->elems()) slot_type(std::move(slot));
+            root_->n = 1;
+            size_    = 1;
+            return { iterator(this, root_, 0), true };
+        }
+
+        node*       at   = nullptr;
+        std::size_t at_i = 0;
+        bool inserted = node_insert(root_, slot, at, at_i);
+
+        if (root_->n > 2 * factor)
+        {
+            node* new_root = new node();
+            new_root->children[0] = root_;
+            root_->parent = new_root;
+            root_ = new_root;
+            split(root_, 0);
+            track_split(root_, 0, at, at_i);
+        }
+
+        size_ += inserted;
+        return { iterator(this, at, at_i), inserted };
+    }
+
+    // Fixes the child at `idx` of `parent` after it was left with `factor - 1`
+    // elements, by borrowing an element from one of its siblings or merging it
+    // with one of them. Same as `bt_rebalance_node`.
+    static void rebalance(node* parent, std::size_t idx)
+    {
+        node* child = parent->children[idx];
+        node* left  = idx > 0         ? parent->children[idx - 1] : nullptr;
+        node* right = idx < parent->n ? parent->children[idx + 1] : nullptr;
+
+        if (left && left->n > factor)
+        {
+            // Rotate right: the separator goes down to `child` and the last
+            // element of `left` takes its place, along with its last child.
+            relocate(child->elems() + 1, child->elems(), child->n);
+            std::memmove(child->children + 1, child->children, (child->n + 1) * sizeof(node*));
+            relocate(child->elems(), parent->elems() + idx - 1, 1);
+            relocate(parent->elems() + idx - 1, left->elems() + left->n - 1, 1);
+            child->children[0] = left->children[left->n];
+            left->children[left->n] = nullptr;
+            if (child->children[0]) child->children[0]->parent = child;
+            child->n++;
+            left->n--;
+        }
+        else if (right && right->n > factor)
+        {
+            // Rotate left: the mirror of the above.
+            relocate(child->elems() + child->n, parent->elems() + idx, 1);
+            relocate(parent->elems() + idx, right->elems(), 1);
+            relocate(right->elems(), right->elems() + 1, right->n - 1);
+            child->children[child->n + 1] = right->children[0];
+            if (right->children[0]) right->children[0]->parent = child;
+            std::memmove(right->children, right->children + 1, right->n * sizeof(node*));
+            right->children[right->n] = nullptr;
+            child->n++;
+            right->n--;
+        }
+        else
+        {
+            // Merge `child` with a sibling and the separator between them.
+            if (left)
+            {
+                right = child;
+                idx--;
+            }
+            else
+            {
+                left = child;
+            }
+
+            relocate(left->elems() + left->n, parent->elems() + idx, 1);
+            relocate(left->elems() + left->n + 1, right->elems(), right->n);
+            for (std::size_t i = 0; i <= right->n; i++)
+            {
+                left->children[left->n + 1 + i] = right->children[i];
+                if (right->children[i]) right->children[i]->parent = left;
+            }
+            left->n += right->n + 1;
+            delete right;
+
+            relocate(parent->elems() + idx, parent->elems() + idx + 1, parent->n - idx - 1);
+            std::memmove(parent->children + idx + 1, parent->children + idx + 2,
+                         (parent->n - idx - 1) * sizeof(node*));
+            parent->children[parent->n] = nullptr;
+            parent->n--;
+        }
+    }
+
+    // Moves the largest element of the subtree of `n` to the uninitialized
+    // `removed`.
+    static void remove_max(node* n, slot_type* removed)
+    {
+        node* child = n->children[n->n];
+        if (!child)
+        {
+            relocate(removed, n->elems() + --n->n, 1);
+            return;
+        }
+
+        remove_max(child, removed);
+        if (child->n < factor) rebalance(n, n->n);
+    }
+
+    // Moves the element with `key` out of the subtree of `n` to the
+    // uninitialized `removed`. Returns whether there was one.
+    template <class K>
+    bool node_remove(node* n, const K& key, slot_type* removed)
+    {
+        auto [i, found] = search(n, key);
+        node* child = n->children[i];
+
+        if (found)
+        {
+            relocate(removed, n->elems() + i, 1);
+
+            // In a leaf, just close the gap.
+            if (!child)
+            {
+                relocate(n->elems() + i, n->elems() + i + 1, n->n - i - 1);
+                n->n--;
+                return true;
+            }
+
+            // Otherwise, the predecessor takes the place of the removed element.
+            remove_max(child, n->elems() + i);
+        }
+        else if (!child || !node_remove(child, key, removed))
+        {
+            return false;
+        }
+
+        if (child->n < factor) rebalance(n, i);
+        return true;
+    }
+
+    template <class K>
+    bool remove_slot(const K& key, slot_type* removed)
+    {
+        if (!root_ || !node_remove(root_, key, removed)) return false;
+
+        // The root is left empty after a merge of its last two children, which
+        // becomes the new root, or once its last element is removed.
+        if (!root_->n)
+        {
+            node* old_root = root_;
+            root_ = old_root->children[0];
+            if (root_) root_->parent = nullptr;
+            delete old_root;
+        }
+
+        size_--;
+        return true;
+    }
+
+    static node* clone(const node* src, node* parent)
+    {
+        if (!src) return nullptr;
+        node* n = new node();
+        n->n      = src->n;
+        n->parent = parent;
+        for (std::size_t i = 0; i < src->n; i++)
+            ::new (n->elems() + i) slot_type(src->elems()[i]);
+        if (!src->leaf())
+            for (std::size_t i = 0; i <= src->n; i++)
+                n->children[i] = clone(src->children[i], n);
+        return n;
+    }
+
+    static void destroy(node* n)
+    {
+        if (!n) return;
+        for (std::size_t i = 0; i < n->n; i++)
+        {
+            n->elems()[i].~slot_type();
+            destroy(n->children[i]);
+        }
+        destroy(n->children[n->n]);
+        delete n;
+    }
+
+    node*       root_ = nullptr;
+    key_compare comp_ = key_compare();
+    size_type   size_ = 0;
+};
+
+} // namespace detail
+
+template <class T, class Compare = std::less<T>, std::size_t NodeBytes = 256>
+class btree_set : public detail::btree<detail::set_params<T, Compare, NodeBytes>>
+{
+    using base = detail::btree<detail::set_params<T, Compare, NodeBytes>>;
+
+public:
+    using base::base;
+
+    btree_set(std::initializer_list<T> values) { this->insert(values); }
+
+    template <class It>
+    btree_set(It first, It last) { this->insert(first, last); }
+};
+
+template <class K, class V, class Compare = std::less<K>, std::size_t NodeBytes = 256>
+class btree_map : public detail::btree<detail::map_params<K, V, Compare, NodeBytes>>
+{
+    using base = detail::btree<detail::map_params<K, V, Compare, NodeBytes>>;
+
+public:
+    using mapped_type = V;
+    using typename base::iterator;
+    using typename base::value_type;
+
+    using base::base;
+
+    btree_map(std::initializer_list<value_type> values) { this->insert(values); }
+
+    template <class It>
+    btree_map(It first, It last) { this->insert(first, last); }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const K& key, Args&&... args)
+    {
+        return this->try_emplace_impl(key, std::forward<Args>(args)...);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args)
+    {
+        return this->try_emplace_impl(std::move(key), std::forward<Args>(args)...);
+    }
+
+    V& operator[](const K& key) { return try_emplace(key).first->second; }
+    V& operator[](K&& key) { return try_emplace(std::move(key)).first->second; }
+
+    V& at(const K& key)
+    {
+        auto it = this->find(key);
+        if (it == this->end()) throw std::out_of_range("mk_bt::btree_map::at");
+        return it->second;
+    }
+
+    const V& at(const K& key) const
+    {
+        auto it = this->find(key);
+        if (it == this->end()) throw std::out_of_range("mk_bt::btree_map::at");
+        return it->second;
+    }
+};
+
+} // namespace mk_bt
+
+#endif
@@ -0,0 +1,278 @@
+/**
+ * > BTree index - secondary indexes with composite keys over `mk_bt.h`.
+ *
+ * Generates btrees that index records owned by the caller by a tuple of their
+ * fields, and tables that keep several of those indexes up to date together.
+ *
+ * Indexes
+ * =======
+ *
+ * Define `BT_INDEX_RECORD`, the type of the records, `BT_INDEX_NAME`, the prefix
+ * of every generated name, and `BT_INDEX_COLUMNS(COL)`, the fields of the key
+ * in order, each as `COL(type, field, order)`. The type is one of `u8`, `u16`,
+ * `u32`, `u64`, `i8`, `i16`, `i32`, `i64`, `f32` and `f64`, and the order is
+ * `ASC` or `DESC`:
+ *
+ * ```c
+ * #define BT_INDEX_RECORD          struct user
+ * #define BT_INDEX_NAME            by_country
+ * #define BT_INDEX_COLUMNS(COL)    COL(u16, country, ASC) COL(i32, age, DESC)
+ * #include "mk_bt_index.h"
+ * ```
+ *
+ * The key of a record is its columns, encoded with `mk_bt_key.h` so that
+ * comparing the bytes of two keys with `memcmp` orders them as the columns
+ * (every bit flipped for `DESC` ones), padded to a multiple of 8 bytes. The
+ * address of the record is appended, so records with the same columns get
+ * different keys, and the key is all the index stores. The tree is a regular
+ * `mk_bt.h` tree with `BT_KEY_BYTES`, of `struct by_country_bt_key`, `struct
+ * by_country_bt`, with every function prefixed by `by_country_`. Keys are
+ * compared 8 bytes at a time, as integers, instead of one column at a time.
+ * Any other macro of `mk_bt.h` (`BT_FACTOR`, `BT_DECL_ONLY`, ...) can be
+ * defined as well, except for the ones about elements and keys.
+ *
+ * Records must not move while indexed, and their columns must not change
+ * without going through `by_country_bt_index_move` (or `users_table_update`),
+ * since the index finds their entries by their columns.
+ *
+ * Tables
+ * ======
+ *
+ * Once the indexes are generated, define `BT_TABLE_RECORD`, `BT_TABLE_NAME` and
+ * `BT_TABLE_INDEXES(X)`, the names of the indexes, each as `X(name)`:
+ *
+ * ```c
+ * #define BT_TABLE_RECORD          struct user
+ * #define BT_TABLE_NAME            users
+ * #define BT_TABLE_INDEXES(X)      X(by_country) X(by_name)
+ * #include "mk_bt_index.h"
+ * ```
+ *
+ * to get `struct users_table`, with a member for each index, and
+ * `users_table_insert`, `users_table_remove` and `users_table_update`, which
+ * change every index in one call.
+ *
+ * All of those macros will be undefined at the end of this header file.
+ *
+ * Macros
+ * ======
+ *
+ * Name                         Default                         Description
+ * ----------------------------------------------------------------------------------------------------------------
+ * BT_INDEX_RECORD              -                               Type of the indexed records.
+ * BT_INDEX_NAME                -                               Prefix of the names of the index.
+ * BT_INDEX_COLUMNS(COL)        -                               Columns of the key, as `COL(type, field, order)`.
+ * BT_TABLE_RECORD              -                               Type of the records of a table.
+ * BT_TABLE_NAME                -                               Prefix of the names of the table.
+ * BT_TABLE_INDEXES(X)          -                               Indexes of the table, as `X(name)`.
+ */
+
+// Shared by every index.
+#ifndef _BT_INDEX_H_
+#define _BT_INDEX_H_
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "mk_bt_key.h"
+
+#define BT_INDEX_CAT_(a, b) a##_##b
+#define BT_INDEX_CAT(a, b)  BT_INDEX_CAT_(a, b)
+
+#define BT_INDEX_WIDTH_u8   1
+#define BT_INDEX_WIDTH_u16  2
+#define BT_INDEX_WIDTH_u32  4
+#define BT_INDEX_WIDTH_u64  8
+#define BT_INDEX_WIDTH_i8   1
+#define BT_INDEX_WIDTH_i16  2
+#define BT_INDEX_WIDTH_i32  4
+#define BT_INDEX_WIDTH_i64  8
+#define BT_INDEX_WIDTH_f32  4
+#define BT_INDEX_WIDTH_f64  8
+
+// Applies the order of a column to its bytes, from `start` to `end`.
+#define BT_INDEX_ORDER_ASC(start, end)  (end)
+#define BT_INDEX_ORDER_DESC(start, end) bt_key_put_desc(start, end)
+
+#endif
+
+#ifdef BT_INDEX_COLUMNS
+
+#if !defined(BT_INDEX_RECORD) || !defined(BT_INDEX_NAME)
+#error "An index needs BT_INDEX_RECORD and BT_INDEX_NAME"
+#endif
+
+#define BT_INDEX_MKID(name) BT_INDEX_CAT(BT_INDEX_NAME, name)
+
+// Width of a column, followed by a `+` or `,`.
+#define BT_INDEX_SUM(type, field, order)    BT_INDEX_WIDTH_##type +
+#define BT_INDEX_LIST(type, field, order)   BT_INDEX_WIDTH_##type,
+
+// Columns, padded with zeros to a multiple of 8 bytes, then the address of
+// the record.
+#define BT_INDEX_WORDS ((BT_INDEX_COLUMNS(BT_INDEX_SUM) 7) / 8 + 1)
+
+#define BT_KEY_BYTES            (8 * BT_INDEX_WORDS)
+#define BT_MKID(name)           BT_INDEX_MKID(name)
+#include "mk_bt.h"
+
+// The record of the entry with `key`.
+static inline BT_INDEX_RECORD* BT_INDEX_MKID(bt_index_record)(const struct BT_INDEX_MKID(bt_key)* key)
+{
+    return (BT_INDEX_RECORD*)(uintptr_t)bt_key_get_u64(key->bytes + sizeof(key->bytes) - 8);
+}
+
+// Width of each column, then of the address, which isn't a column.
+static const size_t BT_INDEX_MKID(bt_index_widths)[] = { BT_INDEX_COLUMNS(BT_INDEX_LIST) 8 };
+#define BT_INDEX_NCOLS (sizeof(BT_INDEX_MKID(bt_index_widths)) / sizeof(size_t) - 1)
+
+// Called by `bt_index_scan` with each record, stops the scan when it returns
+// `false`.
+typedef bool (*BT_INDEX_MKID(bt_index_fn))(BT_INDEX_RECORD* record, void* ctx);
+
+// Encodes the key of `record` from the columns of `fields`, usually the record
+// itself, or a copy of its columns from before they changed.
+static inline void BT_INDEX_MKID(bt_index_key)(
+    struct BT_INDEX_MKID(bt_key)* key, const BT_INDEX_RECORD* fields, const BT_INDEX_RECORD* record
+) {
+    unsigned char* p = key->bytes;
+#define BT_INDEX_PUT(type, field, order) \
+    p = BT_INDEX_ORDER_##order(p, bt_key_put_##type(p, fields->field));
+    BT_INDEX_COLUMNS(BT_INDEX_PUT)
+#undef BT_INDEX_PUT
+    unsigned char* end = key->bytes + sizeof(key->bytes) - 8;
+    memset(p, 0, end - p);
+    bt_key_put_u64(end, (uintptr_t)record);
+}
+
+// Adds `record` to the index. Returns `false` if it already was there.
+static inline bool BT_INDEX_MKID(bt_index_add)(struct BT_INDEX_MKID(bt)* bt, BT_INDEX_RECORD* record)
+{
+    struct BT_INDEX_MKID(bt_key) key;
+    BT_INDEX_MKID(bt_index_key)(&key, record, record);
+    return !BT_INDEX_MKID(bt_insert)(bt, key, NULL);
+}
+
+// Removes `record`, whose columns are those of `fields`, from the index.
+// Returns `false` if it wasn't there.
+static inline bool BT_INDEX_MKID(bt_index_del)(
+    struct BT_INDEX_MKID(bt)* bt, const BT_INDEX_RECORD* fields, const BT_INDEX_RECORD* record
+) {
+    struct BT_INDEX_MKID(bt_key) key;
+    BT_INDEX_MKID(bt_index_key)(&key, fields, record);
+    return BT_INDEX_MKID(bt_remove)(bt, &key, NULL);
+}
+
+// Moves `record` to its place after its columns changed from those of `old`.
+// Does nothing if none of the columns of this index changed.
+static inline void BT_INDEX_MKID(bt_index_move)(
+    struct BT_INDEX_MKID(bt)* bt, const BT_INDEX_RECORD* old, BT_INDEX_RECORD* record
+) {
+    struct BT_INDEX_MKID(bt_key) from, to;
+    BT_INDEX_MKID(bt_index_key)(&from, old, record);
+    BT_INDEX_MKID(bt_index_key)(&to, record, record);
+    if (!memcmp(from.bytes, to.bytes, sizeof(to.bytes))) return;
+
+    BT_INDEX_MKID(bt_remove)(bt, &from, NULL);
+    BT_INDEX_MKID(bt_insert)(bt, to, NULL);
+}
+
+// Calls `fn` on every record whose first `ncols` columns are equal to those of
+// `probe`, in the order of the index. `ncols` may be 0 to visit every record.
+static inline void BT_INDEX_MKID(bt_index_scan)(
+    struct BT_INDEX_MKID(bt)* bt, const BT_INDEX_RECORD* probe, size_t ncols,
+    BT_INDEX_MKID(bt_index_fn) fn, void* ctx
+) {
+    assert(ncols <= BT_INDEX_NCOLS);
+    size_t prefix = 0;
+    for (size_t i = 0; i < ncols; i++) prefix += BT_INDEX_MKID(bt_index_widths)[i];
+
+    // The smallest key starting with the columns of `probe`.
+    struct BT_INDEX_MKID(bt_key) key;
+    BT_INDEX_MKID(bt_index_key)(&key, probe, NULL);
+    memset(key.bytes + prefix, 0, sizeof(key.bytes) - prefix);
+
+    struct BT_INDEX_MKID(bt_iter_dfs) iter = BT_INDEX_MKID(bt_iter_dfs_seek)(bt, &key);
+    struct BT_INDEX_MKID(bt_key)* entry;
+    while ((entry = BT_INDEX_MKID(bt_iter_dfs_next)(&iter)) && !memcmp(entry->bytes, key.bytes, prefix))
+    {
+        if (!fn(BT_INDEX_MKID(bt_index_record)(entry), ctx)) return;
+    }
+}
+
+#undef BT_INDEX_MKID
+#undef BT_INDEX_SUM
+#undef BT_INDEX_LIST
+#undef BT_INDEX_NCOLS
+#undef BT_INDEX_WORDS
+
+#endif
+
+#ifdef BT_TABLE_INDEXES
+
+#if !defined(BT_TABLE_RECORD) || !defined(BT_TABLE_NAME)
+#error "A table needs BT_TABLE_RECORD and BT_TABLE_NAME"
+#endif
+
+#define BT_TABLE_MKID(name) BT_INDEX_CAT(BT_TABLE_NAME, name)
+
+#define BT_TABLE_MEMBER(name)   struct name##_bt name;
+#define BT_TABLE_MK(name)       table->name = name##_bt_mk();
+#define BT_TABLE_FREE(name)     name##_bt_free(table->name);
+#define BT_TABLE_ADD(name)      name##_bt_index_add(&table->name, record);
+#define BT_TABLE_DEL(name)      name##_bt_index_del(&table->name, record, record);
+#define BT_TABLE_MOVE(name)     name##_bt_index_move(&table->name, old, record);
+
+struct BT_TABLE_MKID(table)
+{
+    BT_TABLE_INDEXES(BT_TABLE_MEMBER)
+};
+
+static inline void BT_TABLE_MKID(table_init)(struct BT_TABLE_MKID(table)* table)
+{
+    BT_TABLE_INDEXES(BT_TABLE_MK)
+}
+
+// Frees the indexes, not the records.
+static inline void BT_TABLE_MKID(table_free)(struct BT_TABLE_MKID(table)* table)
+{
+    BT_TABLE_INDEXES(BT_TABLE_FREE)
+}
+
+// Adds `record` to every index.
+static inline void BT_TABLE_MKID(table_insert)(struct BT_TABLE_MKID(table)* table, BT_TABLE_RECORD* record)
+{
+    BT_TABLE_INDEXES(BT_TABLE_ADD)
+}
+
+// Removes `record` from every index, before it's freed or moved.
+static inline void BT_TABLE_MKID(table_remove)(struct BT_TABLE_MKID(table)* table, BT_TABLE_RECORD* record)
+{
+    BT_TABLE_INDEXES(BT_TABLE_DEL)
+}
+
+// Moves `record` in every index whose columns changed from those of `old`, a
+// copy of the record from before it was changed.
+static inline void BT_TABLE_MKID(table_update)(
+    struct BT_TABLE_MKID(table)* table, const BT_TABLE_RECORD* old, BT_TABLE_RECORD* record
+) {
+    BT_TABLE_INDEXES(BT_TABLE_MOVE)
+}
+
+#undef BT_TABLE_MKID
+#undef BT_TABLE_MEMBER
+#undef BT_TABLE_MK
+#undef BT_TABLE_FREE
+#undef BT_TABLE_ADD
+#undef BT_TABLE_DEL
+#undef BT_TABLE_MOVE
+
+#endif
+
+#undef BT_INDEX_RECORD
+#undef BT_INDEX_NAME
+#undef BT_INDEX_COLUMNS
+#undef BT_TABLE_RECORD
+#undef BT_TABLE_NAME
+#undef BT_TABLE_INDEXES
@@ -0,0 +1,176 @@
+/**
+ * > BTree keys - order preserving encodings of keys into bytes.
+ *
+ * Encodes integers, floating point numbers and strings into bytes that compare
+ * with `memcmp` as the values they encode do, so that keys of any type, and
+ * tuples of them, are compared the same way: byte by byte, or better, 8 bytes
+ * at a time as big endian integers (see `BT_KEY_BYTES` in `mk_bt.h`).
+ *
+ * Every `bt_key_put_*` writes a value at `p` and returns the end of what it
+ * wrote, so a tuple is encoded by writing its fields one after the other:
+ *
+ * ```c
+ * unsigned char* p = key.bytes;
+ * p = bt_key_put_u16(p, user->country);
+ * p = bt_key_put_desc(p, bt_key_put_i32(p, user->age));
+ * p = bt_key_put_str(p, user->name, 16);
+ * ```
+ *
+ * - Unsigned integers are written in big endian.
+ * - Signed integers get their sign bit flipped first, so negative numbers
+ *   come first.
+ * - Floating point numbers get their sign bit flipped if they are positive,
+ *   and every bit flipped if they are negative. `-0.0` is encoded as `0.0`,
+ *   and every NaN, whatever its sign and payload, as the same positive quiet
+ *   NaN, which comes after infinity.
+ * - Strings are truncated or padded with zeros to a fixed width, so strings
+ *   that only differ by trailing zeros or after the width compare equal.
+ * - `bt_key_put_desc` flips every bit of what was written since `p`, which
+ *   reverses its order.
+ *
+ * `bt_key_get_*` decode the fixed width encodings. This header doesn't depend
+ * on `mk_bt.h` and can be included any number of times.
+ */
+
+#ifndef _BT_KEY_H_
+#define _BT_KEY_H_
+
+#include <stdint.h>
+#include <string.h>
+
+// Writes the low `width` bytes of `value` to `p` in big endian.
+static inline unsigned char* bt_key_put_be(unsigned char* p, uint64_t value, size_t width)
+{
+    for (size_t i = width; i--;)
+    {
+        p[i]    = (unsigned char)value;
+        value >>= 8;
+    }
+    return p + width;
+}
+
+// Reads `width` bytes from `p` in big endian.
+static inline uint64_t bt_key_get_be(const unsigned char* p, size_t width)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < width; i++) value = value << 8 | p[i];
+    return value;
+}
+
+// Reads 8 bytes from `p` in big endian. Written out so that compilers turn it
+// into a single load and byte swap.
+static inline uint64_t bt_key_get64(const unsigned char* p)
+{
+    return (uint64_t)p[0] << 56 | (uint64_t)p[1] << 48 | (uint64_t)p[2] << 40 | (uint64_t)p[3] << 32
+         | (uint64_t)p[4] << 24 | (uint64_t)p[5] << 16 | (uint64_t)p[6] << 8  | (uint64_t)p[7];
+}
+
+static inline unsigned char* bt_key_put_u8(unsigned char* p, uint8_t value)   { return bt_key_put_be(p, value, 1); }
+static inline unsigned char* bt_key_put_u16(unsigned char* p, uint16_t value) { return bt_key_put_be(p, value, 2); }
+static inline unsigned char* bt_key_put_u32(unsigned char* p, uint32_t value) { return bt_key_put_be(p, value, 4); }
+static inline unsigned char* bt_key_put_u64(unsigned char* p, uint64_t value) { return bt_key_put_be(p, value, 8); }
+
+static inline unsigned char* bt_key_put_i8(unsigned char* p, int8_t value)
+{
+    return bt_key_put_be(p, (uint8_t)value ^ UINT8_C(0x80), 1);
+}
+
+static inline unsigned char* bt_key_put_i16(unsigned char* p, int16_t value)
+{
+    return bt_key_put_be(p, (uint16_t)value ^ UINT16_C(0x8000), 2);
+}
+
+static inline unsigned char* bt_key_put_i32(unsigned char* p, int32_t value)
+{
+    return bt_key_put_be(p, (uint32_t)value ^ UINT32_C(0x80000000), 4);
+}
+
+static inline unsigned char* bt_key_put_i64(unsigned char* p, int64_t value)
+{
+    return bt_key_put_be(p, (uint64_t)value ^ UINT64_C(0x8000000000000000), 8);
+}
+
+static inline unsigned char* bt_key_put_f32(unsigned char* p, float value)
+{
+    uint32_t bits;
+    if (value == 0) value = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    // Negative NaNs would come before -infinity.
+    if (value != value) bits = UINT32_C(0x7fc00000);
+    bits ^= bits >> 31 ? UINT32_C(0xffffffff) : UINT32_C(0x80000000);
+    return bt_key_put_be(p, bits, 4);
+}
+
+static inline unsigned char* bt_key_put_f64(unsigned char* p, double value)
+{
+    uint64_t bits;
+    if (value == 0) value = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    if (value != value) bits = UINT64_C(0x7ff8000000000000);
+    bits ^= bits >> 63 ? UINT64_C(0xffffffffffffffff) : UINT64_C(0x8000000000000000);
+    return bt_key_put_be(p, bits, 8);
+}
+
+// Writes the first `width` bytes of the string `str`, padded with zeros.
+static inline unsigned char* bt_key_put_str(unsigned char* p, const char* str, size_t width)
+{
+    size_t len = 0;
+    while (len < width && str[len]) len++;
+    memcpy(p, str, len);
+    memset(p + len, 0, width - len);
+    return p + width;
+}
+
+// Reverses the order of what was written from `start` to `end`.
+static inline unsigned char* bt_key_put_desc(unsigned char* start, unsigned char* end)
+{
+    for (unsigned char* p = start; p < end; p++) *p = ~*p;
+    return end;
+}
+
+static inline uint8_t  bt_key_get_u8(const unsigned char* p)  { return (uint8_t)bt_key_get_be(p, 1); }
+static inline uint16_t bt_key_get_u16(const unsigned char* p) { return (uint16_t)bt_key_get_be(p, 2); }
+static inline uint32_t bt_key_get_u32(const unsigned char* p) { return (uint32_t)bt_key_get_be(p, 4); }
+static inline uint64_t bt_key_get_u64(const unsigned char* p) { return bt_key_get64(p); }
+
+static inline int8_t  bt_key_get_i8(const unsigned char* p)  { return (int8_t)(bt_key_get_u8(p) ^ UINT8_C(0x80)); }
+static inline int16_t bt_key_get_i16(const unsigned char* p) { return (int16_t)(bt_key_get_u16(p) ^ UINT16_C(0x8000)); }
+static inline int32_t bt_key_get_i32(const unsigned char* p) { return (int32_t)(bt_key_get_u32(p) ^ UINT32_C(0x80000000)); }
+
+static inline int64_t bt_key_get_i64(const unsigned char* p)
+{
+    return (int64_t)(bt_key_get_u64(p) ^ UINT64_C(0x8000000000000000));
+}
+
+static inline float bt_key_get_f32(const unsigned char* p)
+{
+    uint32_t bits = bt_key_get_u32(p);
+    bits ^= bits >> 31 ? UINT32_C(0x80000000) : UINT32_C(0xffffffff);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline double bt_key_get_f64(const unsigned char* p)
+{
+    uint64_t bits = bt_key_get_u64(p);
+    bits ^= bits >> 63 ? UINT64_C(0x8000000000000000) : UINT64_C(0xffffffffffffffff);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Compares `n` bytes as `memcmp` does, 8 at a time.
+static inline int bt_key_cmp(const unsigned char* a, const unsigned char* b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t x = bt_key_get64(a + i);
+        uint64_t y = bt_key_get64(b + i);
+        if (x != y) return x < y ? -1 : 1;
+    }
+    return i < n ? memcmp(a + i, b + i, n - i) : 0;
+}
+
+#endif
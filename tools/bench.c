@@ -0,0 +1,275 @@
+/**
+ * > Bench - a representative workload for `mk_bt.h`.
+ *
+ * Build it with the same `-D` flags used for the btree instantiation, for
+ * example:
+ *
+ * ```sh
+ * cc -O2 -I. -DBT_FACTOR=16 tools/bench.c -o bench -lm && ./bench 1000000
+ * ```
+ *
+ * The optional second argument is the distribution of the keys: `uniform`
+ * (the default), `seq` (consecutive integers, inserted in order) or `lognormal`
+ * (skewed, with dense and sparse regions like many real world keys).
+ *
+ * Keys are built from 64 bit integers with `BENCH_MK(i)`, which by default is
+ * a plain cast to `BT_ELEM`. For struct elements, define it in a header and
+ * pass it with `-include`.
+ *
+ * The output is a single line of the form
+ *
+ *     <total ns/op> insert=<ns/op> hit=<ns/op> miss=<ns/op> iter=<ns/elem> zipf=<ns/op> remove=<ns/op>
+ *
+ * which is what `tools/tune.sh` parses. The total doesn't include `zipf`,
+ * lookups of inserted keys following a Zipfian distribution (skewed towards a
+ * few hot keys), nor `remove`, removals of half of the inserted keys. With
+ * `BT_BLOOM`, the false positive rate of the bloom filter on the misses is
+ * appended as `fpr=<rate>`.
+ *
+ * The tree is then checked against a sorted array of the keys: random inserts
+ * and removals of hits and misses must agree with it on whether the key was
+ * there, and afterwards lookups of every key, the size and an iteration in
+ * order must match it. A mismatch is printed to stderr, and the exit status is
+ * 1.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <math.h>
+
+#include "bench.h"
+
+// `mk_bt.h` undefines its macros, so keep a name for the element type.
+#ifndef BT_ELEM
+#define BT_ELEM int
+#endif
+
+#ifndef BT_KEY
+#define BT_KEY BT_ELEM
+#endif
+
+#ifndef BT_KEY_OF
+#define BT_KEY_OF(elem) (elem)
+#endif
+
+#ifdef BT_BLOOM
+#define BENCH_BLOOM
+#endif
+
+typedef BT_ELEM elem_t;
+typedef BT_KEY  elem_key_t;
+
+static const elem_key_t* key_of(const elem_t* elem) { return BT_KEY_OF(elem); }
+
+// `mk_bt.h` also undefines the comparison, but generates its default one.
+#ifdef BT_CMP
+static int key_cmp(const elem_key_t* a, const elem_key_t* b) { return BT_CMP(a, b); }
+#else
+#define BENCH_DEFAULT_CMP
+#endif
+
+#ifndef BENCH_MK
+#define BENCH_MK(i) ((elem_t)(i))
+#endif
+
+#include "mk_bt.h"
+
+#ifdef BENCH_DEFAULT_CMP
+static int key_cmp(const elem_key_t* a, const elem_key_t* b) { return bt_default_cmp(a, b); }
+#endif
+
+static int elem_cmp(const void* a, const void* b) { return key_cmp(key_of(a), key_of(b)); }
+
+// Index of `key` in `sorted`, which must hold it.
+static size_t index_of(const elem_t* key, const elem_t* sorted, size_t distinct)
+{
+    return (const elem_t*)bsearch(key, sorted, distinct, sizeof(elem_t), elem_cmp) - sorted;
+}
+
+// Key number `i` of the hits (`i < n`) or misses (`i >= n`).
+static uint64_t key_gen(const char* dist, size_t i, size_t n)
+{
+    // Even keys are hits and odd keys misses.
+    size_t j   = i < n ? i : i - n;
+    uint64_t odd = i >= n;
+
+    if (!strcmp(dist, "seq")) return 2 * j + odd;
+
+    if (!strcmp(dist, "lognormal"))
+    {
+        // Box-Muller transform of two uniform numbers.
+        double u1 = ((splitmix64(i) >> 11) + 1) * 0x1.0p-53;
+        double u2 = (splitmix64(i + 5 * n) >> 11) * 0x1.0p-53;
+        double z  = sqrt(-2 * log(u1)) * cos(6.283185307179586 * u2);
+        return 2 * (uint64_t)(exp(z * 1.5) * 1e5) + odd;
+    }
+
+    // Hits and misses come from disjoint ranges of the same generator, mixing
+    // the index makes the insertion order random.
+    return splitmix64(i) >> 2;
+}
+
+// Checks the tree against `sorted`, the distinct keys of `keys` in order, and
+// `present`, whether each of them is in the tree. Returns the number of
+// mismatches.
+static size_t check(struct bt* bt, const elem_t* keys, size_t n, const elem_t* sorted, const bool* present, size_t distinct)
+{
+    size_t errors = 0, size = 0;
+    for (size_t i = 0; i < distinct; i++) size += present[i];
+    if (bt->size != size)
+    {
+        fprintf(stderr, "bench: size is %zu, expected %zu\n", bt->size, size);
+        errors++;
+    }
+
+    for (size_t i = 0; i < 2 * n; i++)
+    {
+        const elem_t* found = bt_lookup(bt, key_of(keys + i));
+        if ((found != NULL) != present[index_of(keys + i, sorted, distinct)]
+            || (found && key_cmp(key_of(found), key_of(keys + i))))
+        {
+            fprintf(stderr, "bench: lookup of key %zu %s\n", i, found ? "found it" : "missed it");
+            errors++;
+        }
+    }
+
+    struct bt_iter_dfs iter = bt_iter_dfs_mk(bt);
+    size_t next = 0;
+    for (elem_t* elem; (elem = bt_iter_dfs_next(&iter));)
+    {
+        while (next < distinct && !present[next]) next++;
+        if (next == distinct || key_cmp(key_of(elem), key_of(sorted + next)))
+        {
+            fprintf(stderr, "bench: iteration is out of order at element %zu\n", next);
+            return errors + 1;
+        }
+        next++;
+    }
+    while (next < distinct && !present[next]) next++;
+    if (next != distinct)
+    {
+        fprintf(stderr, "bench: iteration stopped before element %zu\n", next);
+        errors++;
+    }
+    return errors;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    const char* dist = argc > 2 ? argv[2] : "uniform";
+
+    if (strcmp(dist, "uniform") && strcmp(dist, "seq") && strcmp(dist, "lognormal"))
+    {
+        fprintf(stderr, "bench: unknown distribution '%s'\n", dist);
+        return 1;
+    }
+
+    elem_t* keys = malloc(2 * n * sizeof(elem_t));
+    for (size_t i = 0; i < 2 * n; i++)
+        keys[i] = BENCH_MK(key_gen(dist, i, n));
+
+    struct bt bt = bt_mk();
+    volatile size_t sink = 0;
+
+    double t0 = now_ns();
+    for (size_t i = 0; i < n; i++)
+        bt_insert(&bt, keys[i], NULL);
+
+    double t1 = now_ns();
+    for (size_t i = 0; i < n; i++)
+        sink += bt_lookup(&bt, key_of(keys + splitmix64(i + 2 * n) % n)) != NULL;
+
+    double t2 = now_ns();
+    for (size_t i = 0; i < n; i++)
+        sink += bt_lookup(&bt, key_of(keys + n + i)) != NULL;
+
+    double t3 = now_ns();
+    struct bt_iter_dfs iter = bt_iter_dfs_mk(&bt);
+    while (bt_iter_dfs_next(&iter)) sink++;
+
+    double t4 = now_ns();
+
+    size_t* ranks = malloc(n * sizeof(size_t));
+    zipf_fill(ranks, n, n, 0.99);
+
+    double t5 = now_ns();
+    for (size_t i = 0; i < n; i++)
+        sink += bt_lookup(&bt, key_of(keys + ranks[i])) != NULL;
+
+    double t6 = now_ns();
+    for (size_t i = 0; i < n; i += 2)
+        sink += bt_remove(&bt, key_of(keys + i), NULL);
+
+    double t7 = now_ns();
+
+    printf("%.2f insert=%.2f hit=%.2f miss=%.2f iter=%.2f zipf=%.2f remove=%.2f",
+           (t4 - t0) / (4 * n),
+           (t1 - t0) / n,
+           (t2 - t1) / n,
+           (t3 - t2) / n,
+           (t4 - t3) / n,
+           (t6 - t5) / n,
+           (t7 - t6) / ((n + 1) / 2));
+
+#ifdef BENCH_BLOOM
+    size_t passed = 0, misses = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (bt_lookup_node(&bt, key_of(keys + n + i), NULL)) continue;
+        misses++;
+        passed += bt_bloom_test(&bt, key_of(keys + n + i));
+    }
+    printf(" fpr=%.4f", misses ? (double)passed / misses : 0.0);
+#endif
+
+    printf("\n");
+
+    // The distinct keys in order, and which ones are left in the tree.
+    elem_t* sorted = malloc(2 * n * sizeof(elem_t));
+    memcpy(sorted, keys, 2 * n * sizeof(elem_t));
+    qsort(sorted, 2 * n, sizeof(elem_t), elem_cmp);
+    size_t distinct = 0;
+    for (size_t i = 0; i < 2 * n; i++)
+    {
+        if (distinct && !elem_cmp(sorted + distinct - 1, sorted + i)) continue;
+        sorted[distinct++] = sorted[i];
+    }
+
+    // Keys inserted more than once are gone once any of them was removed.
+    bool* present = calloc(distinct, sizeof(bool));
+    for (size_t i = 0; i < n; i++) present[index_of(keys + i, sorted, distinct)] = true;
+    for (size_t i = 0; i < n; i += 2) present[index_of(keys + i, sorted, distinct)] = false;
+
+    size_t errors = check(&bt, keys, n, sorted, present, distinct);
+
+    // Random inserts and removals of hits and misses.
+    for (size_t i = 0; i < 2 * n && !errors; i++)
+    {
+        uint64_t r   = splitmix64(i + 7 * n);
+        size_t k     = r % (2 * n);
+        size_t at    = index_of(keys + k, sorted, distinct);
+        bool removal = r >> 63;
+        bool had     = removal ? bt_remove(&bt, key_of(keys + k), NULL) : bt_insert(&bt, keys[k], NULL);
+        if (had != present[at])
+        {
+            fprintf(stderr, "bench: %s of key %zu %s it\n", removal ? "removal" : "insert", k, had ? "found" : "missed");
+            errors++;
+        }
+        present[at] = !removal;
+    }
+    if (!errors) errors = check(&bt, keys, n, sorted, present, distinct);
+
+    free(present);
+    free(sorted);
+    bt_free(bt);
+    free(ranks);
+    free(keys);
+    return errors != 0;
+}
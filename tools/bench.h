@@ -0,0 +1,57 @@
+/**
+ * > Bench helpers - the random numbers, clock and key distributions shared by
+ * the benchmarks in `tools/`.
+ *
+ * Include it after the system headers, once the feature test macro that
+ * exposes `clock_gettime` (`_POSIX_C_SOURCE` or an equivalent) is defined.
+ * `zipf_fill` needs `-lm`.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+
+// Mixes `x` into a pseudo random 64 bit number, so that consecutive integers
+// give independent looking keys.
+static inline uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Monotonic time in nanoseconds.
+static inline double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Zipfian ranks in [0, n) with parameter `theta`, as generated by YCSB (Gray et
+// al., "Quickly Generating Billion-Record Synthetic Databases").
+static inline void zipf_fill(size_t* out, size_t count, size_t n, double theta)
+{
+    double zetan = 0;
+    for (size_t i = 1; i <= n; i++) zetan += 1 / pow(i, theta);
+    double zeta2 = 1 + 1 / pow(2, theta);
+    double alpha = 1 / (1 - theta);
+    double eta   = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        double u  = (splitmix64(i + 3 * n) >> 11) * 0x1.0p-53;
+        double uz = u * zetan;
+        if      (uz < 1)                   out[i] = 0;
+        else if (uz < 1 + pow(0.5, theta)) out[i] = 1;
+        else                               out[i] = n * pow(eta * u - eta + 1, alpha);
+        if (out[i] >= n) out[i] = n - 1;
+    }
+}
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ * > Bench arena - lookups in a tree whose nodes come from `BT_ARENA`, backed by
+ * huge pages, against one whose nodes come from `calloc`.
+ *
+ * ```sh
+ * cc -O2 -I. tools/bench_arena.c -o bench_arena -lpthread && ./bench_arena 20000000 5000000
+ * ```
+ *
+ * Arguments are the number of keys and of lookups. Builds both trees from the
+ * same random keys, then looks up random keys in each, and prints:
+ *
+ *     calloc: lookup=<ns/op> dtlb=<misses/op>
+ *     arena:  lookup=<ns/op> dtlb=<misses/op> chunks=<n> huge=<n> AnonHugePages=<kB>
+ *
+ * dTLB misses are read with `perf_event_open`, and are `n/a` where hardware
+ * counters aren't available (most VMs and containers). `huge` is the number
+ * of chunks `madvise(MADV_HUGEPAGE)` was accepted for, and `AnonHugePages`
+ * how much of the process the kernel did back with huge pages.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "bench.h"
+
+#define BT_ELEM         uint64_t
+#define BT_MKID(name)   heap_##name
+#define BT_FACTOR       16
+#include "mk_bt.h"
+
+#define BT_ARENA
+#define BT_ELEM         uint64_t
+#define BT_MKID(name)   arena_##name
+#define BT_FACTOR       16
+#include "mk_bt.h"
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Counter of the dTLB load misses of this thread, or -1.
+static int dtlb_open(void)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HW_CACHE;
+    attr.config         = PERF_COUNT_HW_CACHE_DTLB
+                        | PERF_COUNT_HW_CACHE_OP_READ << 8
+                        | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t dtlb_read(int fd)
+{
+    uint64_t count = 0;
+    if (fd >= 0 && read(fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+    return count;
+}
+
+static void print_dtlb(int fd, uint64_t misses, size_t n)
+{
+    if (fd < 0) printf(" dtlb=n/a");
+    else        printf(" dtlb=%.3f", (double)misses / n);
+}
+
+static long anon_huge_kb(void)
+{
+    FILE* f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) return -1;
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) break;
+    }
+    fclose(f);
+    return kb;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n       = argc > 1 ? strtoull(argv[1], NULL, 10) : 20000000;
+    size_t lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 5000000;
+
+    uint64_t* keys = malloc(n * sizeof(uint64_t));
+    for (size_t i = 0; i < n; i++) keys[i] = splitmix64(i);
+    qsort(keys, n, sizeof(uint64_t), cmp_u64);
+
+    struct heap_bt heap = heap_bt_mk();
+    heap_bt_bulk_load(&heap, keys, n);
+    struct arena_bt arena = arena_bt_mk();
+    arena_bt_bulk_load(&arena, keys, n);
+    free(keys);
+
+    int fd = dtlb_open();
+    volatile size_t sink = 0;
+
+    uint64_t m0 = dtlb_read(fd);
+    double t0 = now_ns();
+    for (size_t i = 0; i < lookups; i++)
+    {
+        uint64_t key = splitmix64(splitmix64(i) % n);
+        sink += heap_bt_lookup(&heap, &key) != NULL;
+    }
+    double t1 = now_ns();
+    uint64_t m1 = dtlb_read(fd);
+    for (size_t i = 0; i < lookups; i++)
+    {
+        uint64_t key = splitmix64(splitmix64(i) % n);
+        sink += arena_bt_lookup(&arena, &key) != NULL;
+    }
+    double t2 = now_ns();
+    uint64_t m2 = dtlb_read(fd);
+
+    if (sink != 2 * lookups)
+    {
+        fprintf(stderr, "bench_arena: a key is missing\n");
+        return 1;
+    }
+
+    struct arena_bt_arena* stats = arena_bt_arena_get();
+    printf("calloc: lookup=%.2f", (t1 - t0) / lookups);
+    print_dtlb(fd, m1 - m0, lookups);
+    printf("\narena:  lookup=%.2f", (t2 - t1) / lookups);
+    print_dtlb(fd, m2 - m1, lookups);
+    printf(" chunks=%zu huge=%zu AnonHugePages=%ld\n", stats->chunks, stats->huge, anon_huge_kb());
+
+    heap_bt_free(heap);
+    arena_bt_free(arena);
+    return 0;
+}
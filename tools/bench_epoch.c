@@ -0,0 +1,147 @@
+/**
+ * > Bench epoch - cost of `bt_epoch` pins and how long retired memory waits.
+ *
+ * ```sh
+ * cc -O2 -I. -pthread tools/bench_epoch.c -o bench_epoch && ./bench_epoch 1000000 64
+ * ```
+ *
+ * Arguments are the number of operations per thread and the maximum number of
+ * threads. For 1, 2, 4, ... threads, measures a pin and unpin with nothing
+ * else in between, then a pin, the retirement of a fresh allocation and an
+ * unpin, and the time from each retirement to the free. Prints one line per
+ * number of threads:
+ *
+ *     threads=<n> pin=<ns/op> retire=<ns/op> latency=<mean us> max=<us> pending=<n>
+ *
+ * where `pending` is what was still retired once every thread stopped, before
+ * `bt_epoch_destroy`.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "bench.h"
+
+#define BT_EPOCH
+#define BT_ELEM uint64_t
+#include "mk_bt.h"
+
+struct stats
+{
+    atomic_uint_fast64_t freed;
+    atomic_uint_fast64_t total_ns;
+    atomic_uint_fast64_t max_ns;
+};
+
+// Retired allocation, which records how long it waited when freed.
+struct garbage
+{
+    double retired_ns;
+    struct stats* stats;
+};
+
+struct work
+{
+    size_t n;
+    struct bt_epoch* epoch;
+    struct stats* stats;
+    double pin_ns;
+    double retire_ns;
+};
+
+static volatile size_t sink;
+
+static void garbage_free(void* ptr)
+{
+    struct garbage* g = ptr;
+    uint_fast64_t waited = now_ns() - g->retired_ns;
+    atomic_fetch_add(&g->stats->freed, 1);
+    atomic_fetch_add(&g->stats->total_ns, waited);
+
+    uint_fast64_t max = atomic_load(&g->stats->max_ns);
+    while (waited > max && !atomic_compare_exchange_weak(&g->stats->max_ns, &max, waited)) {}
+    free(g);
+}
+
+static void* run(void* arg)
+{
+    struct work* w = arg;
+    struct bt_epoch_thread* thread = bt_epoch_register(w->epoch);
+
+    double t0 = now_ns();
+    for (size_t i = 0; i < w->n; i++)
+    {
+        bt_epoch_pin(thread);
+        sink++;
+        bt_epoch_unpin(thread);
+    }
+
+    double t1 = now_ns();
+    for (size_t i = 0; i < w->n; i++)
+    {
+        bt_epoch_pin(thread);
+        struct garbage* g = malloc(sizeof(struct garbage));
+        g->stats      = w->stats;
+        g->retired_ns = now_ns();
+        bt_epoch_retire(thread, g, garbage_free);
+        bt_epoch_unpin(thread);
+    }
+
+    double t2 = now_ns();
+    w->pin_ns    = (t1 - t0) / w->n;
+    w->retire_ns = (t2 - t1) / w->n;
+    bt_epoch_unregister(thread);
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n           = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t max_threads = argc > 2 ? strtoull(argv[2], NULL, 10) : 64;
+
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        struct bt_epoch epoch;
+        bt_epoch_init(&epoch);
+        struct stats stats;
+        atomic_init(&stats.freed, 0);
+        atomic_init(&stats.total_ns, 0);
+        atomic_init(&stats.max_ns, 0);
+
+        pthread_t* ids  = malloc(threads * sizeof(pthread_t));
+        struct work* ws = malloc(threads * sizeof(struct work));
+        for (size_t t = 0; t < threads; t++)
+        {
+            ws[t] = (struct work){ .n = n, .epoch = &epoch, .stats = &stats };
+            pthread_create(ids + t, NULL, run, ws + t);
+        }
+
+        double pin = 0, retire = 0;
+        for (size_t t = 0; t < threads; t++)
+        {
+            pthread_join(ids[t], NULL);
+            pin    += ws[t].pin_ns / threads;
+            retire += ws[t].retire_ns / threads;
+        }
+
+        size_t pending = threads * n - atomic_load(&stats.freed);
+        size_t freed   = atomic_load(&stats.freed);
+        printf("threads=%zu pin=%.2f retire=%.2f latency=%.2f max=%.2f pending=%zu\n",
+               threads,
+               pin,
+               retire,
+               freed ? atomic_load(&stats.total_ns) / 1e3 / freed : 0.0,
+               atomic_load(&stats.max_ns) / 1e3,
+               pending);
+
+        bt_epoch_destroy(&epoch);
+        free(ids);
+        free(ws);
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+/**
+ * > Bench index - a `mk_bt_index.h` index against a tree with a composite
+ * comparator.
+ *
+ * ```sh
+ * cc -O2 -I. tools/bench_index.c -o bench_index && ./bench_index 1000000
+ * ```
+ *
+ * The argument is the number of records. Both trees index them by
+ * `(country ASC, age DESC, id ASC)`: one with the encoded keys of
+ * `mk_bt_index.h`, the other with a struct of those fields compared one by
+ * one. Inserts every record, looks each one up by its full key and counts
+ * the records of one country and age, and prints:
+ *
+ *     index: insert=<ns/op> lookup=<ns/op> scan=<ns/record>
+ *     cmp:   insert=<ns/op> lookup=<ns/op> scan=<ns/record>
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bench.h"
+
+struct user
+{
+    uint64_t id;
+    int32_t age;
+    uint16_t country;
+};
+
+#define BT_INDEX_RECORD         struct user
+#define BT_INDEX_NAME           by_country
+#define BT_INDEX_COLUMNS(COL)   COL(u16, country, ASC) COL(i32, age, DESC) COL(u64, id, ASC)
+#define BT_FACTOR               16
+#include "mk_bt_index.h"
+
+// The same index, with the fields of the key compared one by one.
+struct user_key
+{
+    uint16_t country;
+    int32_t age;
+    uint64_t id;
+    struct user* record;
+};
+
+static int user_key_cmp(const struct user_key* a, const struct user_key* b)
+{
+    if (a->country != b->country) return a->country < b->country ? -1 : 1;
+    if (a->age != b->age)         return a->age > b->age ? -1 : 1;
+    if (a->id != b->id)           return a->id < b->id ? -1 : 1;
+    return (a->record > b->record) - (a->record < b->record);
+}
+
+#define BT_ELEM         struct user_key
+#define BT_MKID(name)   cmp_##name
+#define BT_CMP          user_key_cmp
+#define BT_FACTOR       16
+#include "mk_bt.h"
+
+static struct user_key user_key(struct user* user)
+{
+    return (struct user_key){ user->country, user->age, user->id, user };
+}
+
+static bool count(struct user* user, void* ctx)
+{
+    (void)user;
+    (*(size_t*)ctx)++;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+
+    // Few countries and ages, so most comparisons get to the id.
+    struct user* users = malloc(n * sizeof(struct user));
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t r = splitmix64(i);
+        users[i] = (struct user){ r >> 32, (int32_t)(r % 100), (uint16_t)(r >> 16) % 4 };
+    }
+
+    struct by_country_bt index = by_country_bt_mk();
+    struct cmp_bt cmp = cmp_bt_mk();
+    volatile size_t sink = 0;
+
+    double t0 = now_ns();
+    for (size_t i = 0; i < n; i++) by_country_bt_index_add(&index, users + i);
+
+    double t1 = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        struct user* user = users + splitmix64(i + n) % n;
+        struct by_country_bt_key key;
+        by_country_bt_index_key(&key, user, user);
+        sink += by_country_bt_lookup(&index, &key) != NULL;
+    }
+
+    double t2 = now_ns();
+    size_t scanned = 0;
+    for (int age = 0; age < 100; age++)
+    {
+        struct user probe = { .country = 1, .age = age };
+        by_country_bt_index_scan(&index, &probe, 2, count, &scanned);
+    }
+
+    double t3 = now_ns();
+    for (size_t i = 0; i < n; i++) cmp_bt_insert(&cmp, user_key(users + i), NULL);
+
+    double t4 = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        struct user_key key = user_key(users + splitmix64(i + n) % n);
+        sink += cmp_bt_lookup(&cmp, &key) != NULL;
+    }
+
+    double t5 = now_ns();
+    size_t checked = 0;
+    for (int age = 0; age < 100; age++)
+    {
+        struct user_key key = { 1, age, 0, NULL };
+        struct cmp_bt_iter_dfs iter = cmp_bt_iter_dfs_seek(&cmp, &key);
+        struct user_key* elem;
+        while ((elem = cmp_bt_iter_dfs_next(&iter)) && elem->country == 1 && elem->age == age) checked++;
+    }
+    double t6 = now_ns();
+
+    if (scanned != checked || sink != 2 * n)
+    {
+        fprintf(stderr, "bench_index: the trees disagree\n");
+        return 1;
+    }
+
+    printf("index: insert=%.2f lookup=%.2f scan=%.2f\n", (t1 - t0) / n, (t2 - t1) / n, (t3 - t2) / scanned);
+    printf("cmp:   insert=%.2f lookup=%.2f scan=%.2f\n", (t4 - t3) / n, (t5 - t4) / n, (t6 - t5) / checked);
+
+    by_country_bt_free(index);
+    cmp_bt_free(cmp);
+    free(users);
+    return 0;
+}
@@ -0,0 +1,127 @@
+/**
+ * > Bench interval - overlap queries with `BT_INTERVAL` against plain scans.
+ *
+ * ```sh
+ * cc -O2 -I. tools/bench_interval.c -o bench_interval && ./bench_interval 10000000
+ * ```
+ *
+ * The argument is the number of intervals. Starts are random, and lengths are
+ * short except for 1 in 1000 intervals, which are up to 1000 times longer. For
+ * windows of a few lengths, runs overlap queries in three ways and prints:
+ *
+ *     insert=<ns/op>
+ *     window=<width> hits=<per query> overlaps=<ns/query> seek=<ns/query> scan=<ns/query>
+ *
+ * where `overlaps` is `bt_interval_overlaps`, `seek` iterates from the start of
+ * the window minus the longest length (which must be known up front) and
+ * `scan` iterates from the smallest key, as a tree without the maximum ends
+ * has to.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bench.h"
+
+struct interval
+{
+    uint64_t lo, hi;
+};
+
+#define BT_INTERVAL
+#define BT_ELEM                 struct interval
+#define BT_KEY                  uint64_t
+#define BT_KEY_OF(elem)         (&(elem)->lo)
+#define BT_INTERVAL_END(elem)   (&(elem)->hi)
+#define BT_FACTOR               16
+#include "mk_bt.h"
+
+#define SHORT 1000
+#define LONG  (1000 * SHORT)
+
+static bool count(struct interval* elem, void* ctx)
+{
+    (void)elem;
+    (*(size_t*)ctx)++;
+    return true;
+}
+
+// Counts the intervals overlapping `[a, b]` iterating from `from`.
+static size_t iterate(struct bt* bt, uint64_t from, uint64_t a, uint64_t b)
+{
+    size_t hits = 0;
+    struct bt_iter_dfs iter = bt_iter_dfs_seek(bt, &from);
+    struct interval* elem;
+    while ((elem = bt_iter_dfs_next(&iter)) && elem->lo <= b)
+        hits += elem->hi >= a;
+    return hits;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    uint64_t range = 64 * (uint64_t)n;
+
+    struct bt bt = bt_mk();
+    double t0 = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t lo  = splitmix64(i) % range;
+        uint64_t len = splitmix64(i + n) % (i % 1000 ? SHORT : LONG);
+        bt_insert(&bt, (struct interval){ lo, lo + len }, NULL);
+    }
+    printf("insert=%.2f\n", (now_ns() - t0) / n);
+
+    static const uint64_t windows[] = { 1, 100, 10000 };
+    for (size_t w = 0; w < sizeof(windows) / sizeof(*windows); w++)
+    {
+        size_t queries = 10000;
+        size_t scans   = 10;
+        size_t hits = 0, check = 0;
+
+        double t1 = now_ns();
+        for (size_t q = 0; q < queries; q++)
+        {
+            uint64_t a = splitmix64(q + 2 * n) % range;
+            uint64_t b = a + windows[w] - 1;
+            bt_interval_overlaps(&bt, &a, &b, count, &hits);
+        }
+
+        double t2 = now_ns();
+        for (size_t q = 0; q < queries; q++)
+        {
+            uint64_t a = splitmix64(q + 2 * n) % range;
+            uint64_t b = a + windows[w] - 1;
+            check += iterate(&bt, a < LONG ? 0 : a - LONG, a, b);
+        }
+
+        double t3 = now_ns();
+        for (size_t q = 0; q < scans; q++)
+        {
+            uint64_t a = splitmix64(q + 2 * n) % range;
+            uint64_t b = a + windows[w] - 1;
+            iterate(&bt, 0, a, b);
+        }
+        double t4 = now_ns();
+
+        if (hits != check)
+        {
+            fprintf(stderr, "bench_interval: %zu overlaps, but %zu by iteration\n", hits, check);
+            return 1;
+        }
+
+        printf("window=%llu hits=%.2f overlaps=%.2f seek=%.2f scan=%.2f\n",
+               (unsigned long long)windows[w],
+               (double)hits / queries,
+               (t2 - t1) / queries,
+               (t3 - t2) / queries,
+               (t4 - t3) / scans);
+    }
+
+    bt_free(bt);
+    return 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * > Bench key - keys encoded with `mk_bt_key.h` against a composite comparator.
+ *
+ * ```sh
+ * cc -O2 -I. tools/bench_key.c -o bench_key && ./bench_key 1000000
+ * ```
+ *
+ * The argument is the number of keys. Both trees are ordered by
+ * `(name ASC, score DESC, id ASC)`, a `char[8]`, a `double` and an `int64_t`:
+ * one with a `BT_CMP` that compares the fields one by one, the other with the
+ * fields encoded into 24 bytes and `BT_KEY_BYTES`. Inserts every key and looks
+ * each one up, and prints:
+ *
+ *     cmp:     insert=<ns/op> lookup=<ns/op>
+ *     encoded: insert=<ns/op> lookup=<ns/op>
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bench.h"
+
+#include "mk_bt_key.h"
+
+struct row
+{
+    char name[8];
+    double score;
+    int64_t id;
+};
+
+static int row_cmp(const struct row* a, const struct row* b)
+{
+    int c = strncmp(a->name, b->name, sizeof(a->name));
+    if (c) return c;
+    if (a->score != b->score) return a->score > b->score ? -1 : 1;
+    if (a->id != b->id)       return a->id < b->id ? -1 : 1;
+    return 0;
+}
+
+#define BT_ELEM         struct row
+#define BT_MKID(name)   cmp_##name
+#define BT_CMP          row_cmp
+#define BT_FACTOR       16
+#include "mk_bt.h"
+
+#define BT_KEY_BYTES    24
+#define BT_MKID(name)   enc_##name
+#define BT_FACTOR       16
+#include "mk_bt.h"
+
+static struct enc_bt_key encode(const struct row* row)
+{
+    struct enc_bt_key key;
+    unsigned char* p = key.bytes;
+    p = bt_key_put_str(p, row->name, sizeof(row->name));
+    p = bt_key_put_desc(p, bt_key_put_f64(p, row->score));
+    p = bt_key_put_i64(p, row->id);
+    memset(p, 0, key.bytes + sizeof(key.bytes) - p);
+    return key;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+
+    // Few names and scores, so most comparisons get to the id.
+    struct row* rows = malloc(n * sizeof(struct row));
+    for (size_t i = 0; i < n; i++)
+    {
+        uint64_t r = splitmix64(i);
+        rows[i] = (struct row){ { 'u', 's', 'e', 'r', '0' + r % 8 } };
+        rows[i].score = (double)(int)(r >> 8 & 63) - 32.5;
+        rows[i].id    = (int64_t)(r >> 16) - (1ll << 46);
+    }
+
+    struct cmp_bt cmp = cmp_bt_mk();
+    struct enc_bt enc = enc_bt_mk();
+    volatile size_t sink = 0;
+
+    double t0 = now_ns();
+    for (size_t i = 0; i < n; i++) cmp_bt_insert(&cmp, rows[i], NULL);
+
+    double t1 = now_ns();
+    for (size_t i = 0; i < n; i++) sink += cmp_bt_lookup(&cmp, rows + splitmix64(i + n) % n) != NULL;
+
+    double t2 = now_ns();
+    for (size_t i = 0; i < n; i++) enc_bt_insert(&enc, encode(rows + i), NULL);
+
+    double t3 = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        struct enc_bt_key key = encode(rows + splitmix64(i + n) % n);
+        sink += enc_bt_lookup(&enc, &key) != NULL;
+    }
+    double t4 = now_ns();
+
+    if (cmp.size != enc.size || sink != 2 * n)
+    {
+        fprintf(stderr, "bench_key: the trees disagree\n");
+        return 1;
+    }
+
+    // Same order, so the first key decodes to the first row.
+    struct cmp_bt_iter_dfs a = cmp_bt_iter_dfs_mk(&cmp);
+    struct enc_bt_iter_dfs b = enc_bt_iter_dfs_mk(&enc);
+    struct row* row = cmp_bt_iter_dfs_next(&a);
+    struct enc_bt_key* key = enc_bt_iter_dfs_next(&b);
+    if (memcmp(key->bytes, row->name, 5) || bt_key_get_i64(key->bytes + 16) != row->id)
+    {
+        fprintf(stderr, "bench_key: the trees are in different orders\n");
+        return 1;
+    }
+
+    printf("cmp:     insert=%.2f lookup=%.2f\n", (t1 - t0) / n, (t2 - t1) / n);
+    printf("encoded: insert=%.2f lookup=%.2f\n", (t3 - t2) / n, (t4 - t3) / n);
+
+    cmp_bt_free(cmp);
+    enc_bt_free(enc);
+    free(rows);
+    return 0;
+}
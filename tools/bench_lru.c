@@ -0,0 +1,81 @@
+/**
+ * > Bench LRU - a read through `bt_lru` cache under Zipfian traffic.
+ *
+ * ```sh
+ * cc -O2 -I. tools/bench_lru.c -o bench_lru -lm && ./bench_lru 1000000 10000000
+ * ```
+ *
+ * Arguments are the number of distinct keys and of requests. Requests follow
+ * a Zipfian distribution (theta 0.99), and each one looks up its key in the
+ * cache and puts it there on a miss. For caches that fit 1%, 5% and 20% of the
+ * keys, prints:
+ *
+ *     budget=<% of keys> hit=<ratio> ns/op=<ns> evictions=<per miss>
+ *
+ * Build it with `-DBT_LRU_BATCH=1` to compare with evicting one element at a
+ * time.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bench.h"
+
+struct entry
+{
+    uint64_t key;
+    uint64_t value[7];
+};
+
+#define BT_LRU
+#define BT_ELEM             struct entry
+#define BT_KEY              uint64_t
+#define BT_KEY_OF(elem)     (&(elem)->key)
+#define BT_FACTOR           16
+#include "mk_bt.h"
+
+int main(int argc, char** argv)
+{
+    size_t n        = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t requests = argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000;
+
+    size_t* ranks = malloc(requests * sizeof(size_t));
+    zipf_fill(ranks, requests, n, 0.99);
+
+    static const double budgets[] = { 0.01, 0.05, 0.2 };
+    for (size_t b = 0; b < sizeof(budgets) / sizeof(*budgets); b++)
+    {
+        struct bt_lru lru;
+        bt_lru_init(&lru, budgets[b] * n * sizeof(struct entry));
+
+        volatile uint64_t sink = 0;
+        double t0 = now_ns();
+        for (size_t i = 0; i < requests; i++)
+        {
+            // Hot ranks are spread over the key space.
+            uint64_t key = splitmix64(ranks[i]);
+            struct entry* entry = bt_lru_get(&lru, &key);
+            if (entry)
+            {
+                sink += entry->value[0];
+                continue;
+            }
+            bt_lru_put(&lru, (struct entry){ .key = key, .value = { key } });
+        }
+        double t1 = now_ns();
+
+        printf("budget=%g%% hit=%.4f ns/op=%.2f evictions=%.2f\n",
+               budgets[b] * 100,
+               (double)lru.hits / requests,
+               (t1 - t0) / requests,
+               lru.misses ? (double)lru.evictions / lru.misses : 0.0);
+        bt_lru_destroy(&lru);
+    }
+
+    free(ranks);
+    return 0;
+}
@@ -0,0 +1,192 @@
+/**
+ * > Bench mvcc - reads of `bt_mvcc` snapshots under concurrent updates, against
+ * snapshots taken by holding a mutex.
+ *
+ * ```sh
+ * cc -O2 -I. -pthread tools/bench_mvcc.c -o bench_mvcc && ./bench_mvcc 1000000 64 1
+ * ```
+ *
+ * Arguments are the number of lookups per reader, the maximum number of
+ * readers and the number of writers, which update random keys of a preloaded
+ * tree until the readers are done. Readers look up 16 keys per snapshot: with
+ * the mutex, a snapshot holds it for those lookups, with `bt_mvcc` it's a
+ * `bt_mvcc_begin` and lookups at its timestamp, while another thread runs
+ * `bt_mvcc_gc` every millisecond. For 1, 2, 4, ... readers, prints the read
+ * throughput:
+ *
+ *     readers=<n> mutex=<Mops/s> mvcc=<Mops/s>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "bench.h"
+
+#define BT_MVCC
+#define BT_ELEM uint64_t
+#define BT_FACTOR 16
+#include "mk_bt.h"
+
+#define KEYS     (1 << 20)
+#define SNAPSHOT 16
+
+struct work
+{
+    size_t n;
+    uint64_t seed;
+    atomic_bool* done;
+    pthread_mutex_t* lock;
+    struct bt* bt;
+    struct bt_mvcc* mvcc;
+};
+
+static volatile size_t sink;
+
+static void* read_mutex(void* arg)
+{
+    struct work* w = arg;
+    size_t found = 0;
+    for (size_t i = 0; i < w->n; i += SNAPSHOT)
+    {
+        pthread_mutex_lock(w->lock);
+        for (size_t j = i; j < i + SNAPSHOT; j++)
+        {
+            uint64_t key = splitmix64(w->seed + j) % KEYS;
+            found += bt_lookup(w->bt, &key) != NULL;
+        }
+        pthread_mutex_unlock(w->lock);
+    }
+    sink += found;
+    return NULL;
+}
+
+static void* write_mutex(void* arg)
+{
+    struct work* w = arg;
+    for (size_t i = 0; !atomic_load_explicit(w->done, memory_order_relaxed); i++)
+    {
+        pthread_mutex_lock(w->lock);
+        bt_insert(w->bt, splitmix64(w->seed + i) % KEYS, NULL);
+        pthread_mutex_unlock(w->lock);
+    }
+    return NULL;
+}
+
+static void* read_mvcc(void* arg)
+{
+    struct work* w = arg;
+    struct bt_mvcc_thread* thread = bt_mvcc_register(w->mvcc);
+    size_t found = 0;
+    uint64_t elem;
+    for (size_t i = 0; i < w->n; i += SNAPSHOT)
+    {
+        uint64_t ts = bt_mvcc_begin(thread);
+        for (size_t j = i; j < i + SNAPSHOT; j++)
+        {
+            uint64_t key = splitmix64(w->seed + j) % KEYS;
+            found += bt_mvcc_lookup_at(thread, &key, ts, &elem);
+        }
+        bt_mvcc_end(thread);
+    }
+    bt_mvcc_unregister(thread);
+    sink += found;
+    return NULL;
+}
+
+static void* write_mvcc(void* arg)
+{
+    struct work* w = arg;
+    struct bt_mvcc_thread* thread = bt_mvcc_register(w->mvcc);
+    for (size_t i = 0; !atomic_load_explicit(w->done, memory_order_relaxed); i++)
+        bt_mvcc_put(thread, splitmix64(w->seed + i) % KEYS);
+    bt_mvcc_unregister(thread);
+    return NULL;
+}
+
+static void* gc_mvcc(void* arg)
+{
+    struct work* w = arg;
+    struct bt_mvcc_thread* thread = bt_mvcc_register(w->mvcc);
+    while (!atomic_load_explicit(w->done, memory_order_relaxed))
+    {
+        bt_mvcc_gc(thread);
+        nanosleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+    }
+    bt_mvcc_unregister(thread);
+    return NULL;
+}
+
+// Runs `readers` threads of `read` along with `writers` threads of `write`
+// (and `extra` if not `NULL`) until the readers are done. Returns the read
+// throughput in millions of lookups per second.
+static double run(void* (*read)(void*), void* (*write)(void*), void* (*extra)(void*),
+                  struct work base, size_t readers, size_t writers)
+{
+    atomic_bool done;
+    atomic_init(&done, false);
+    base.done = &done;
+
+    size_t threads  = readers + writers + 1;
+    pthread_t* ids  = malloc(threads * sizeof(pthread_t));
+    struct work* ws = malloc(threads * sizeof(struct work));
+    for (size_t t = 0; t < threads; t++)
+    {
+        ws[t]      = base;
+        ws[t].seed = splitmix64(t + 1);
+    }
+
+    for (size_t t = readers; t < readers + writers; t++) pthread_create(ids + t, NULL, write, ws + t);
+    if (extra) pthread_create(ids + threads - 1, NULL, extra, ws + threads - 1);
+
+    double t0 = now_ns();
+    for (size_t t = 0; t < readers; t++) pthread_create(ids + t, NULL, read, ws + t);
+    for (size_t t = 0; t < readers; t++) pthread_join(ids[t], NULL);
+    double t1 = now_ns();
+
+    atomic_store(&done, true);
+    for (size_t t = readers; t < readers + writers; t++) pthread_join(ids[t], NULL);
+    if (extra) pthread_join(ids[threads - 1], NULL);
+
+    free(ids);
+    free(ws);
+    return readers * base.n / (t1 - t0) * 1e3;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n           = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t max_readers = argc > 2 ? strtoull(argv[2], NULL, 10) : 64;
+    size_t writers     = argc > 3 ? strtoull(argv[3], NULL, 10) : 1;
+
+    for (size_t readers = 1; readers <= max_readers; readers *= 2)
+    {
+        pthread_mutex_t lock;
+        pthread_mutex_init(&lock, NULL);
+        struct bt bt = bt_mk();
+        struct bt_mvcc mvcc;
+        bt_mvcc_init(&mvcc);
+
+        struct bt_mvcc_thread* thread = bt_mvcc_register(&mvcc);
+        for (uint64_t i = 0; i < KEYS; i += 2)
+        {
+            bt_insert(&bt, i, NULL);
+            bt_mvcc_put(thread, i);
+        }
+        bt_mvcc_unregister(thread);
+
+        struct work w = { .n = n, .lock = &lock, .bt = &bt, .mvcc = &mvcc };
+        double locked    = run(read_mutex, write_mutex, NULL, w, readers, writers);
+        double versioned = run(read_mvcc, write_mvcc, gc_mvcc, w, readers, writers);
+        printf("readers=%zu mutex=%.2f mvcc=%.2f\n", readers, locked, versioned);
+
+        bt_free(bt);
+        bt_mvcc_destroy(&mvcc);
+        pthread_mutex_destroy(&lock);
+    }
+    return 0;
+}
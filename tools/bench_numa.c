@@ -0,0 +1,155 @@
+/**
+ * > Bench NUMA - lookups from threads on every NUMA node in a `bt_numa`, with
+ * the top levels of the tree copied to each node and without.
+ *
+ * ```sh
+ * cc -O2 -I. tools/bench_numa.c -o bench_numa -lpthread && ./bench_numa 10000000 2000000 8 0
+ * ```
+ *
+ * Arguments are the number of keys, of lookups per thread, of threads and of
+ * nodes. With 0 nodes each thread uses the node it runs on, so they should be
+ * spread over the nodes (e.g. with `numactl --interleave=all`); otherwise
+ * thread `i` pretends to be on node `i % nodes`, which only measures the cost
+ * of the copies on a machine with a single node. Both trees are built by the
+ * main thread, so on a real machine most of their nodes are remote to most of
+ * the threads. Prints:
+ *
+ *     nodes=<n> sync=<ms to copy the top levels to every node>
+ *     copied: lookup=<ns/op> <Mops/s in total>
+ *     shared: lookup=<ns/op> <Mops/s in total>
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "bench.h"
+
+// Node of the thread, set by each thread before its lookups.
+static _Thread_local size_t thread_node;
+
+#define BT_NUMA
+#define BT_NUMA_NODE()  thread_node
+#define BT_ELEM         uint64_t
+#define BT_MKID(name)   copied_##name
+#define BT_FACTOR       16
+#include "mk_bt.h"
+
+#define BT_NUMA
+#define BT_NUMA_NODE()  thread_node
+#define BT_NUMA_LEVELS  0
+#define BT_ELEM         uint64_t
+#define BT_MKID(name)   shared_##name
+#define BT_FACTOR       16
+#include "mk_bt.h"
+
+struct worker
+{
+    pthread_t thread;
+    size_t id;
+    size_t lookups;
+    size_t n;
+    size_t found;
+    struct copied_bt_numa* copied;
+    struct shared_bt_numa* shared;
+};
+
+static size_t nodes;
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void* run(void* arg)
+{
+    struct worker* worker = arg;
+    thread_node = nodes ? worker->id % nodes : copied_bt_numa_node();
+
+    uint64_t elem;
+    for (size_t i = 0; i < worker->lookups; i++)
+    {
+        uint64_t key = splitmix64(splitmix64(worker->id * worker->lookups + i) % worker->n);
+        if (worker->copied) worker->found += copied_bt_numa_lookup(worker->copied, &key, &elem);
+        else                worker->found += shared_bt_numa_lookup(worker->shared, &key, &elem);
+    }
+    return NULL;
+}
+
+// Runs the lookups of every thread on one of the trees, returns the time taken.
+static double bench(struct worker* workers, size_t threads, struct copied_bt_numa* copied, struct shared_bt_numa* shared)
+{
+    double t0 = now_ns();
+    for (size_t i = 0; i < threads; i++)
+    {
+        workers[i].copied = copied;
+        workers[i].shared = shared;
+        workers[i].found  = 0;
+        pthread_create(&workers[i].thread, NULL, run, workers + i);
+    }
+    size_t found = 0;
+    for (size_t i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        found += workers[i].found;
+    }
+    double t1 = now_ns();
+
+    if (found != threads * workers[0].lookups)
+    {
+        fprintf(stderr, "bench_numa: a key is missing\n");
+        exit(1);
+    }
+    return t1 - t0;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n       = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    size_t lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 2000000;
+    size_t threads = argc > 3 ? strtoull(argv[3], NULL, 10) : 8;
+    nodes          = argc > 4 ? strtoull(argv[4], NULL, 10) : 0;
+
+    uint64_t* keys = malloc(n * sizeof(uint64_t));
+    for (size_t i = 0; i < n; i++) keys[i] = splitmix64(i);
+    qsort(keys, n, sizeof(uint64_t), cmp_u64);
+
+    struct copied_bt_numa copied;
+    struct shared_bt_numa shared;
+    copied_bt_numa_init(&copied, nodes);
+    shared_bt_numa_init(&shared, nodes);
+    copied_bt_bulk_load(&copied.tree, keys, n);
+    shared_bt_bulk_load(&shared.tree, keys, n);
+    free(keys);
+
+    double t0 = now_ns();
+    copied_bt_numa_sync(&copied);
+    double t1 = now_ns();
+    shared_bt_numa_sync(&shared);
+
+    struct worker* workers = calloc(threads, sizeof(struct worker));
+    for (size_t i = 0; i < threads; i++)
+    {
+        workers[i].id      = i;
+        workers[i].lookups = lookups;
+        workers[i].n       = n;
+    }
+
+    double tc = bench(workers, threads, &copied, NULL);
+    double ts = bench(workers, threads, NULL, &shared);
+    size_t total = threads * lookups;
+
+    printf("nodes=%zu sync=%.2f\n", copied.nodes, (t1 - t0) / 1e6);
+    printf("copied: lookup=%.2f %.2f\n", tc / lookups, total / tc * 1e3);
+    printf("shared: lookup=%.2f %.2f\n", ts / lookups, total / ts * 1e3);
+
+    free(workers);
+    copied_bt_numa_destroy(&copied);
+    shared_bt_numa_destroy(&shared);
+    return 0;
+}
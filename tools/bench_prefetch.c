@@ -0,0 +1,114 @@
+/**
+ * > Bench prefetch - latency of lookups with `BT_PREFETCH` and without, in
+ * trees larger than the last level cache.
+ *
+ * ```sh
+ * cc -O2 -I. tools/bench_prefetch.c -o bench_prefetch && ./bench_prefetch 20000000 2000000
+ * ```
+ *
+ * Arguments are the number of keys and of lookups. Builds a tree of random
+ * keys for each factor, 16 (nodes of 9 cache lines) and 64 (33 lines), with
+ * and without prefetching, then looks up random keys one at a time: each key
+ * depends on the element found by the previous lookup, so that lookups can't
+ * overlap and each takes the latency of a descent. Prints:
+ *
+ *     factor=16: plain=<ns/op> prefetch=<ns/op>
+ *     factor=64: plain=<ns/op> prefetch=<ns/op>
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define BT_ELEM         uint64_t
+#define BT_MKID(name)   plain16_##name
+#define BT_FACTOR       16
+#include "mk_bt.h"
+
+#define BT_PREFETCH
+#define BT_ELEM         uint64_t
+#define BT_MKID(name)   prefetch16_##name
+#define BT_FACTOR       16
+#include "mk_bt.h"
+
+#define BT_ELEM         uint64_t
+#define BT_MKID(name)   plain64_##name
+#define BT_FACTOR       64
+#include "mk_bt.h"
+
+#define BT_PREFETCH
+#define BT_ELEM         uint64_t
+#define BT_MKID(name)   prefetch64_##name
+#define BT_FACTOR       64
+#include "mk_bt.h"
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Looks up `lookups` keys of the `n` from `splitmix64(0)` in a chain, each one
+// picked from the element found by the previous lookup. Returns ns per lookup.
+#define BENCH(prefix, tree, n, lookups)                                         \
+    do {                                                                        \
+        uint64_t found = 0;                                                     \
+        double t0 = now_ns();                                                   \
+        for (size_t i = 0; i < (lookups); i++)                                  \
+        {                                                                       \
+            uint64_t key = splitmix64(splitmix64(found + i) % (n));             \
+            uint64_t* elem = prefix##_bt_lookup(&(tree), &key);                 \
+            if (!elem)                                                          \
+            {                                                                   \
+                fprintf(stderr, "bench_prefetch: a key is missing\n");          \
+                exit(1);                                                        \
+            }                                                                   \
+            found = *elem;                                                      \
+        }                                                                       \
+        elapsed = (now_ns() - t0) / (lookups);                                  \
+    } while (0)
+
+int main(int argc, char** argv)
+{
+    size_t n       = argc > 1 ? strtoull(argv[1], NULL, 10) : 20000000;
+    size_t lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 2000000;
+
+    uint64_t* keys = malloc(n * sizeof(uint64_t));
+    for (size_t i = 0; i < n; i++) keys[i] = splitmix64(i);
+    qsort(keys, n, sizeof(uint64_t), cmp_u64);
+
+    double elapsed, plain, prefetch;
+
+    // One pair of trees at a time, to fit in memory.
+    struct plain16_bt p16 = plain16_bt_mk();
+    struct prefetch16_bt f16 = prefetch16_bt_mk();
+    plain16_bt_bulk_load(&p16, keys, n);
+    prefetch16_bt_bulk_load(&f16, keys, n);
+    BENCH(plain16, p16, n, lookups);
+    plain = elapsed;
+    BENCH(prefetch16, f16, n, lookups);
+    prefetch = elapsed;
+    printf("factor=16: plain=%.2f prefetch=%.2f\n", plain, prefetch);
+    plain16_bt_free(p16);
+    prefetch16_bt_free(f16);
+
+    struct plain64_bt p64 = plain64_bt_mk();
+    struct prefetch64_bt f64 = prefetch64_bt_mk();
+    plain64_bt_bulk_load(&p64, keys, n);
+    prefetch64_bt_bulk_load(&f64, keys, n);
+    BENCH(plain64, p64, n, lookups);
+    plain = elapsed;
+    BENCH(prefetch64, f64, n, lookups);
+    prefetch = elapsed;
+    printf("factor=64: plain=%.2f prefetch=%.2f\n", plain, prefetch);
+    plain64_bt_free(p64);
+    prefetch64_bt_free(f64);
+
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,141 @@
+/**
+ * > Bench rw - contention of `bt_rw` against a single read-write lock.
+ *
+ * ```sh
+ * cc -O2 -I. -pthread tools/bench_rw.c -o bench_rw && ./bench_rw 1000000 64 10
+ * ```
+ *
+ * Arguments are the number of operations, the maximum number of threads and
+ * the percentage of writes (insertions), the rest are lookups. For 1, 2, 4, ...
+ * threads, runs the same operations, split evenly between the threads, on a
+ * tree behind a `pthread_rwlock_t` and on a `bt_rw`, both preloaded with half
+ * of the keys. Prints one line per number of threads:
+ *
+ *     threads=<n> rwlock=<Mops/s> bt_rw=<Mops/s>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "bench.h"
+
+#define BT_RW
+#define BT_ELEM uint64_t
+#define BT_FACTOR 16
+#include "mk_bt.h"
+
+struct work
+{
+    const uint64_t* keys;
+    size_t n;
+    unsigned writes;
+    pthread_rwlock_t* lock;
+    struct bt* bt;
+    struct bt_rw* rw;
+};
+
+static volatile size_t sink;
+
+static void* run_rwlock(void* arg)
+{
+    struct work* w = arg;
+    size_t found = 0;
+    for (size_t i = 0; i < w->n; i++)
+    {
+        if (w->keys[i] % 100 < w->writes)
+        {
+            pthread_rwlock_wrlock(w->lock);
+            bt_insert(w->bt, w->keys[i], NULL);
+        }
+        else
+        {
+            pthread_rwlock_rdlock(w->lock);
+            found += bt_lookup(w->bt, w->keys + i) != NULL;
+        }
+        pthread_rwlock_unlock(w->lock);
+    }
+    sink += found;
+    return NULL;
+}
+
+static void* run_bt_rw(void* arg)
+{
+    struct work* w = arg;
+    struct bt_rw_thread* thread = bt_rw_register(w->rw);
+    size_t found = 0;
+    uint64_t elem;
+    for (size_t i = 0; i < w->n; i++)
+    {
+        if (w->keys[i] % 100 < w->writes) bt_rw_insert(thread, w->keys[i]);
+        else                              found += bt_rw_lookup(thread, w->keys + i, &elem);
+    }
+    bt_rw_flush(thread);
+    sink += found;
+    return NULL;
+}
+
+// Runs `fn` on `threads` threads, each with its slice of `keys`. Returns the
+// throughput in millions of operations per second.
+static double run(void* (*fn)(void*), struct work base, size_t threads)
+{
+    pthread_t* ids  = malloc(threads * sizeof(pthread_t));
+    struct work* ws = malloc(threads * sizeof(struct work));
+    size_t per      = base.n / threads;
+
+    double t0 = now_ns();
+    for (size_t t = 0; t < threads; t++)
+    {
+        ws[t]      = base;
+        ws[t].keys = base.keys + t * per;
+        ws[t].n    = t + 1 < threads ? per : base.n - t * per;
+        pthread_create(ids + t, NULL, fn, ws + t);
+    }
+    for (size_t t = 0; t < threads; t++) pthread_join(ids[t], NULL);
+    double t1 = now_ns();
+
+    free(ids);
+    free(ws);
+    return base.n / (t1 - t0) * 1e3;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n           = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t max_threads = argc > 2 ? strtoull(argv[2], NULL, 10) : 64;
+    unsigned writes    = argc > 3 ? strtoul(argv[3], NULL, 10) : 10;
+
+    // Lookups are for keys in the first half, half of which are preloaded.
+    uint64_t* keys = malloc(n * sizeof(uint64_t));
+    for (size_t i = 0; i < n; i++) keys[i] = splitmix64(splitmix64(i) % (n / 2 + 1));
+
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        pthread_rwlock_t lock;
+        pthread_rwlock_init(&lock, NULL);
+        struct bt bt = bt_mk();
+        struct bt_rw rw;
+        bt_rw_init(&rw);
+        for (size_t i = 0; i < n / 4; i++)
+        {
+            bt_insert(&bt, splitmix64(i), NULL);
+            bt_insert(&rw.tree, splitmix64(i), NULL);
+        }
+
+        struct work w = { .keys = keys, .n = n, .writes = writes, .lock = &lock, .bt = &bt, .rw = &rw };
+        double locked  = run(run_rwlock, w, threads);
+        double batched = run(run_bt_rw, w, threads);
+        printf("threads=%zu rwlock=%.2f bt_rw=%.2f\n", threads, locked, batched);
+
+        bt_free(bt);
+        bt_rw_destroy(&rw);
+        pthread_rwlock_destroy(&lock);
+    }
+
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * > Bench shards - write scaling of `bt_shards` against a single tree.
+ *
+ * ```sh
+ * cc -O2 -I. -pthread tools/bench_shards.c -o bench_shards && ./bench_shards 1000000 64
+ * ```
+ *
+ * For 1, 2, 4, ... up to the given number of threads, inserts the same random
+ * keys, split evenly between the threads, in a tree protected by a single mutex
+ * and in a `bt_shards` with as many shards as threads (at least 8). Prints one
+ * line per number of threads:
+ *
+ *     threads=<n> mutex=<Mops/s> shards=<Mops/s> count=<shards>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "bench.h"
+
+#define BT_SHARDS
+#define BT_ELEM uint64_t
+#define BT_FACTOR 16
+#include "mk_bt.h"
+
+struct work
+{
+    const uint64_t* keys;
+    size_t n;
+    pthread_mutex_t* lock;
+    struct bt* bt;
+    struct bt_shards* shards;
+};
+
+static void* insert_mutex(void* arg)
+{
+    struct work* w = arg;
+    for (size_t i = 0; i < w->n; i++)
+    {
+        pthread_mutex_lock(w->lock);
+        bt_insert(w->bt, w->keys[i], NULL);
+        pthread_mutex_unlock(w->lock);
+    }
+    return NULL;
+}
+
+static void* insert_shards(void* arg)
+{
+    struct work* w = arg;
+    for (size_t i = 0; i < w->n; i++)
+        bt_shards_insert(w->shards, w->keys[i], NULL);
+    return NULL;
+}
+
+// Runs `fn` on `threads` threads, each with its slice of `keys`. Returns the
+// throughput in millions of operations per second.
+static double run(void* (*fn)(void*), struct work base, size_t threads)
+{
+    pthread_t* ids   = malloc(threads * sizeof(pthread_t));
+    struct work* ws  = malloc(threads * sizeof(struct work));
+    size_t per       = base.n / threads;
+
+    double t0 = now_ns();
+    for (size_t t = 0; t < threads; t++)
+    {
+        ws[t]      = base;
+        ws[t].keys = base.keys + t * per;
+        ws[t].n    = t + 1 < threads ? per : base.n - t * per;
+        pthread_create(ids + t, NULL, fn, ws + t);
+    }
+    for (size_t t = 0; t < threads; t++) pthread_join(ids[t], NULL);
+    double t1 = now_ns();
+
+    free(ids);
+    free(ws);
+    return base.n / (t1 - t0) * 1e3;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n           = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t max_threads = argc > 2 ? strtoull(argv[2], NULL, 10) : 64;
+
+    uint64_t* keys = malloc(n * sizeof(uint64_t));
+    for (size_t i = 0; i < n; i++) keys[i] = splitmix64(i);
+
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+        struct bt bt = bt_mk();
+        struct work w = { .keys = keys, .n = n, .lock = &lock, .bt = &bt };
+        double mutex = run(insert_mutex, w, threads);
+        bt_free(bt);
+
+        struct bt_shards shards;
+        bt_shards_init(&shards, threads < 8 ? 8 : threads);
+        w.shards = &shards;
+        double sharded = run(insert_shards, w, threads);
+
+        printf("threads=%zu mutex=%.2f shards=%.2f count=%zu\n", threads, mutex, sharded, shards.count);
+        bt_shards_destroy(&shards);
+    }
+
+    free(keys);
+    return 0;
+}
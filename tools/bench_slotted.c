@@ -0,0 +1,160 @@
+/**
+ * > Bench slotted - variable length entries in the pages of a `bt_slotted`
+ * against a tree of pointers to them.
+ *
+ * ```sh
+ * cc -O2 -I. tools/bench_slotted.c -o bench_slotted && ./bench_slotted 1000000
+ * ```
+ *
+ * The argument is the number of entries, with keys of 8 to 24 bytes and
+ * values of 8 to 120. One tree stores them in its pages, the other points to
+ * a copy of each entry allocated on its own, and compares the keys it points
+ * to. Inserts every entry, looks each one up and scans them in order, and
+ * prints:
+ *
+ *     slotted:  insert=<ns/op> lookup=<ns/op> scan=<ns/entry> bytes=<per entry>
+ *     pointers: insert=<ns/op> lookup=<ns/op> scan=<ns/entry> bytes=<per entry>
+ *
+ * Bytes count pages and nodes, and allocations rounded to 16 bytes with a
+ * header of 8, as glibc does.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define BT_SLOTTED
+#define BT_MKID(name)   slot_##name
+#include "mk_bt.h"
+
+// An entry allocated on its own.
+struct entry
+{
+    uint16_t klen;
+    uint16_t vlen;
+    unsigned char bytes[];
+};
+
+typedef struct entry* entry_ptr;
+
+static int entry_cmp(const entry_ptr* a, const entry_ptr* b)
+{
+    return slot_bt_slotted_cmp((*a)->bytes, (*a)->klen, (*b)->bytes, (*b)->klen);
+}
+
+#define BT_ELEM             entry_ptr
+#define BT_MKID(name)       ptr_##name
+#define BT_CMP              entry_cmp
+#define BT_ELEM_FREE(elem)  free(elem)
+#define BT_FACTOR           16
+#include "mk_bt.h"
+
+// Key of entry `i`, a decimal number after a prefix of up to 16 bytes.
+static size_t make_key(unsigned char* key, uint64_t i)
+{
+    static const char prefix[] = "customer/orders/";
+    size_t len = splitmix64(i) % sizeof(prefix);
+    memcpy(key, prefix, len);
+    return len + sprintf((char*)key + len, "%08llu", (unsigned long long)(splitmix64(~i) % 100000000));
+}
+
+static size_t make_value(unsigned char* value, uint64_t i)
+{
+    size_t len = 8 + splitmix64(i + 1) % 113;
+    memset(value, (int)i, len);
+    return len;
+}
+
+static size_t ptr_node_count(struct ptr_bnode* node)
+{
+    if (!node) return 0;
+    size_t n = 1;
+    for (size_t i = 0; i <= node->n; i++) n += ptr_node_count(node->children[i]);
+    return n;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+
+    unsigned char key[32], value[128];
+    struct slot_bt_slotted slotted = slot_bt_slotted_mk();
+    struct ptr_bt ptrs = ptr_bt_mk();
+    volatile size_t sink = 0;
+    size_t allocated = 0;
+
+    double t0 = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t klen = make_key(key, i);
+        size_t vlen = make_value(value, i);
+        slot_bt_slotted_put(&slotted, key, klen, value, vlen);
+    }
+
+    double t1 = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        const void* found;
+        size_t klen = make_key(key, splitmix64(i + n) % n);
+        size_t vlen;
+        sink += slot_bt_slotted_get(&slotted, key, klen, &found, &vlen);
+    }
+
+    double t2 = now_ns();
+    struct slot_bt_slotted_iter iter = slot_bt_slotted_iter_mk(&slotted);
+    const void *k, *v;
+    size_t kl, vl;
+    while (slot_bt_slotted_iter_next(&iter, &k, &kl, &v, &vl)) sink += vl;
+
+    double t3 = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t klen = make_key(key, i);
+        size_t vlen = make_value(value, i);
+        struct entry* entry = malloc(sizeof(struct entry) + klen + vlen);
+        entry->klen = klen;
+        entry->vlen = vlen;
+        memcpy(entry->bytes, key, klen);
+        memcpy(entry->bytes + klen, value, vlen);
+        struct entry* prev;
+        if (ptr_bt_insert(&ptrs, entry, &prev)) free(prev);
+        else allocated += (sizeof(struct entry) + klen + vlen + 8 + 15) / 16 * 16;
+    }
+
+    double t4 = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        entry_ptr probe = (entry_ptr)value;
+        probe->klen = make_key(probe->bytes, splitmix64(i + n) % n);
+        sink += ptr_bt_lookup(&ptrs, &probe) != NULL;
+    }
+
+    double t5 = now_ns();
+    struct ptr_bt_iter_dfs dfs = ptr_bt_iter_dfs_mk(&ptrs);
+    struct entry** entry;
+    while ((entry = ptr_bt_iter_dfs_next(&dfs))) sink += (*entry)->vlen;
+    double t6 = now_ns();
+
+    if (slotted.size != ptrs.size)
+    {
+        fprintf(stderr, "bench_slotted: the trees disagree\n");
+        return 1;
+    }
+
+    size_t size = slotted.size;
+    size_t nodes = ptr_node_count(ptrs.root) * ((sizeof(struct ptr_bnode) + 8 + 15) / 16 * 16);
+    printf("slotted:  insert=%.2f lookup=%.2f scan=%.2f bytes=%.2f\n",
+           (t1 - t0) / n, (t2 - t1) / n, (t3 - t2) / size, (double)slotted.pages * sizeof(struct slot_bt_spage) / size);
+    printf("pointers: insert=%.2f lookup=%.2f scan=%.2f bytes=%.2f\n",
+           (t4 - t3) / n, (t5 - t4) / n, (t6 - t5) / size, (double)(nodes + allocated) / size);
+
+    slot_bt_slotted_free(slotted);
+    ptr_bt_free(ptrs);
+    return 0;
+}
@@ -0,0 +1,130 @@
+/**
+ * > Bench TTL - expiration sweeps with `bt_expire` against full scans.
+ *
+ * ```sh
+ * cc -O2 -I. tools/bench_ttl.c -o bench_ttl && ./bench_ttl 1000000 100
+ * ```
+ *
+ * Arguments are the number of sessions and of sweeps. Sessions live for a
+ * random time, and every sweep the clock advances, the expired sessions are
+ * removed and as many new ones are added. Runs the same sweeps on two copies
+ * of the tree, one with `bt_expire` in slices of 64 removals and one with a
+ * scan of every element followed by `bt_remove` of the expired ones, and
+ * prints:
+ *
+ *     expired=<per sweep> expire=<ns/sweep> slice=<ns/slice> max=<ns/slice> scan=<ns/sweep>
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bench.h"
+
+struct session
+{
+    uint64_t id;
+    uint64_t expiry;
+};
+
+#define BT_TTL
+#define BT_ELEM                 struct session
+#define BT_KEY                  uint64_t
+#define BT_KEY_OF(elem)         (&(elem)->id)
+#define BT_TTL_EXPIRY(elem)     ((elem)->expiry)
+#define BT_FACTOR               16
+#include "mk_bt.h"
+
+// Sessions live up to `LIFE` ticks, and sweeps are `STEP` ticks apart.
+#define LIFE  1000000
+#define STEP  1000
+#define SLICE 64
+
+static struct session session(uint64_t i, uint64_t now)
+{
+    return (struct session){ splitmix64(i), now + 1 + splitmix64(~i) % LIFE };
+}
+
+// Removes the sessions that expired by `now` with a scan of the whole tree.
+static size_t scan(struct bt* bt, uint64_t now, uint64_t* keys)
+{
+    size_t n = 0;
+    struct bt_iter_dfs iter = bt_iter_dfs_mk(bt);
+    struct session* elem;
+    while ((elem = bt_iter_dfs_next(&iter)))
+    {
+        if (elem->expiry <= now) keys[n++] = elem->id;
+    }
+    for (size_t i = 0; i < n; i++) bt_remove(bt, keys + i, NULL);
+    return n;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n      = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t sweeps = argc > 2 ? strtoull(argv[2], NULL, 10) : 100;
+
+    struct bt a = bt_mk();
+    struct bt b = bt_mk();
+    uint64_t next = 0;
+    for (; next < n; next++)
+    {
+        bt_insert(&a, session(next, 0), NULL);
+        bt_insert(&b, session(next, 0), NULL);
+    }
+
+    uint64_t* keys = malloc(n * sizeof(uint64_t));
+    size_t expired = 0;
+    size_t slices = 0;
+    double expire = 0, slice = 0, scanned = 0;
+    for (size_t s = 1; s <= sweeps; s++)
+    {
+        uint64_t now = s * STEP;
+
+        size_t removed = 0, got;
+        double t0 = now_ns();
+        do
+        {
+            double t = now_ns();
+            got = bt_expire(&a, now, SLICE);
+            t = now_ns() - t;
+            removed += got;
+            slices++;
+            if (t > slice) slice = t;
+        }
+        while (got == SLICE);
+
+        double t1 = now_ns();
+        if (scan(&b, now, keys) != removed)
+        {
+            fprintf(stderr, "bench_ttl: bt_expire and the scan removed different sessions\n");
+            return 1;
+        }
+        double t2 = now_ns();
+
+        expire  += t1 - t0;
+        scanned += t2 - t1;
+        expired += removed;
+
+        for (size_t i = 0; i < removed; i++, next++)
+        {
+            bt_insert(&a, session(next, now), NULL);
+            bt_insert(&b, session(next, now), NULL);
+        }
+    }
+
+    printf("expired=%.2f expire=%.2f slice=%.2f max=%.2f scan=%.2f\n",
+           (double)expired / sweeps,
+           expire / sweeps,
+           expire / slices,
+           slice,
+           scanned / sweeps);
+
+    free(keys);
+    bt_free(a);
+    bt_free(b);
+    return 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * > Bench txn - batches of `bt_txn` changes against one `bt_insert` per change.
+ *
+ * ```sh
+ * cc -O2 -I. tools/bench_txn.c -o bench_txn && ./bench_txn 1000000 4096
+ * ```
+ *
+ * Arguments are the number of preloaded elements and the largest batch. For
+ * batches of 1, 4, 16, ... insertions, of random keys (`uniform`) or of keys
+ * in a small range (`clustered`), inserts `n` new keys in total into a copy of
+ * the same tree either one by one or through transactions, and prints:
+ *
+ *     batch=<size> uniform: insert=<ns/op> txn=<ns/op> clustered: insert=<ns/op> txn=<ns/op>
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define BT_TXN
+#define BT_ELEM uint64_t
+#define BT_FACTOR 16
+#include "mk_bt.h"
+
+// Tree of the even numbers below `2 * n`.
+static struct bt preload(size_t n)
+{
+    uint64_t* elems = malloc(n * sizeof(uint64_t));
+    for (size_t i = 0; i < n; i++) elems[i] = 2 * i;
+    struct bt bt = bt_mk();
+    bt_bulk_load(&bt, elems, n);
+    free(elems);
+    return bt;
+}
+
+// Odd key number `i` of batch `b`, anywhere or within 1024 keys of each other.
+static uint64_t key_gen(size_t n, size_t batch, size_t b, size_t i, int clustered)
+{
+    if (!clustered) return 2 * (splitmix64(b * batch + i) % n) + 1;
+    uint64_t base = splitmix64(b) % n;
+    return 2 * ((base + splitmix64(b * batch + i) % 1024) % n) + 1;
+}
+
+// Returns the ns per insertion of `n` keys in batches of `batch`.
+static double run(size_t n, size_t batch, int clustered, int txn)
+{
+    struct bt bt = preload(n);
+    double t0 = now_ns();
+    for (size_t b = 0; b < n / batch; b++)
+    {
+        if (txn)
+        {
+            struct bt_txn t = bt_txn_begin(&bt);
+            for (size_t i = 0; i < batch; i++) bt_txn_put(&t, key_gen(n, batch, b, i, clustered));
+            bt_txn_commit(&t);
+        }
+        else
+        {
+            for (size_t i = 0; i < batch; i++) bt_insert(&bt, key_gen(n, batch, b, i, clustered), NULL);
+        }
+    }
+    double t1 = now_ns();
+    bt_free(bt);
+    return (t1 - t0) / (n / batch * batch);
+}
+
+int main(int argc, char** argv)
+{
+    size_t n         = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t max_batch = argc > 2 ? strtoull(argv[2], NULL, 10) : 4096;
+
+    for (size_t batch = 1; batch <= max_batch; batch *= 4)
+    {
+        printf("batch=%zu uniform: insert=%.2f txn=%.2f clustered: insert=%.2f txn=%.2f\n",
+               batch,
+               run(n, batch, 0, 0),
+               run(n, batch, 0, 1),
+               run(n, batch, 1, 0),
+               run(n, batch, 1, 1));
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+#!/bin/sh
+#
+# Generates one `<prefix>_bt.h` / `<prefix>_bt.c` pair per line of a manifest,
+# plus a `bt.mk` makefile fragment to build all of them.
+#
+# Usage: tools/gen.sh <manifest> <output dir>
+#
+# Each non empty line of the manifest that does not start with `#` describes
+# one instantiation with `|` separated columns:
+#
+#   prefix | type | factor | cmp | includes | defines | cflags
+#
+#   prefix    Prefix of every generated name, `f64` gives `struct f64_bt` and
+#             `f64_bt_insert`.
+#   type      The `BT_ELEM`, may contain spaces (`struct point`).
+#   factor    The `BT_FACTOR`, empty for the default.
+#   cmp       The `BT_CMP` function, empty for the default. It must be declared
+#             by one of the includes.
+#   includes  Space separated headers needed by the type and comparison
+#             function, written as in an `#include` (`"point.h" <time.h>`).
+#   defines   Any other `-D` flags for this instantiation.
+#   cflags    Extra compiler flags for this compile unit only.
+#
+# Configured through the environment (the Makefile `gen` target sets these):
+#
+#   CC          Compiler used as preprocessor.      (cc)
+#   DEFINES     `-D` flags shared by every instantiation.
+#   FORMATTER   Filter applied to the output.       (cat)
+#   GEN_CFLAGS  Flags for every compile unit.       (-O2 -flto)
+
+set -e
+
+if [ $# -ne 2 ]; then
+    echo "usage: $0 <manifest> <output dir>" >&2
+    exit 1
+fi
+
+MANIFEST=$1
+OUT=$2
+
+CC=${CC:-cc}
+FORMATTER=${FORMATTER:-cat}
+GEN_CFLAGS=${GEN_CFLAGS:--O2 -flto}
+
+ROOT=$(dirname "$0")/..
+
+trim() {
+    echo "$1" | sed 's/^[[:space:]]*//; s/[[:space:]]*$//'
+}
+
+# Same post processing as the `bt.h` and `bt.c` rules in the Makefile.
+expand() {
+    # shellcheck disable=SC2086
+    $CC $DEFINES "$@" -DBT_GENERATE -E "$ROOT/mk_bt.h" \
+        | sed 's/^#.*$//g'                              \
+        | sed 's/^!\(.*\)$/\1/g'                        \
+        | sed '/^$/{N;/^\n$/d;}'                        \
+        | $FORMATTER
+}
+
+mkdir -p "$OUT"
+
+objs=
+rules=
+
+while IFS='|' read -r prefix type factor cmp includes defines cflags; do
+    prefix=$(trim "$prefix")
+    case $prefix in
+        ''|'#'*) continue ;;
+    esac
+
+    type=$(trim "$type")
+    factor=$(trim "$factor")
+    cmp=$(trim "$cmp")
+    cflags=$(trim "$cflags")
+
+    if [ -z "$type" ]; then
+        echo "$MANIFEST: missing type for '$prefix'" >&2
+        exit 1
+    fi
+
+    name=${prefix}_bt
+    guard=$(echo "_${name}_H_" | tr '[:lower:]' '[:upper:]')
+
+    set -- "-DBT_ELEM=$type" "-DBT_MKID(name)=${prefix}_##name"
+    [ -n "$factor" ] && set -- "$@" "-DBT_FACTOR=$factor"
+    [ -n "$cmp" ]    && set -- "$@" "-DBT_CMP=$cmp"
+    # shellcheck disable=SC2086
+    set -- "$@" $defines
+
+    {
+        echo "#ifndef $guard"
+        echo "#define $guard"
+        echo
+        for include in $includes; do
+            echo "#include $include"
+        done
+        expand "$@" -DBT_DECL_ONLY
+        echo
+        echo "#endif"
+    } > "$OUT/$name.h"
+
+    {
+        echo "#include \"$name.h\""
+        expand "$@" -DBT_IMPL_ONLY
+    } > "$OUT/$name.c"
+
+    objs="$objs $OUT/$name.o"
+    if [ -n "$cflags" ]; then
+        rules="$rules$OUT/$name.o: CFLAGS += $cflags
+"
+    fi
+
+    echo "gen: $OUT/$name.h $OUT/$name.c" >&2
+done < "$MANIFEST"
+
+{
+    echo "# Generated by tools/gen.sh from $MANIFEST."
+    echo
+    echo "BT_GEN_OBJS :=$objs"
+    echo
+    echo "\$(BT_GEN_OBJS): CFLAGS += $GEN_CFLAGS"
+    printf '%s' "$rules"
+} > "$OUT/bt.mk"
@@ -0,0 +1,77 @@
+#!/bin/sh
+#
+# Builds `tools/bench.c` for every combination of branching factor and search
+# strategy, runs it on this machine and writes a configuration header with the
+# fastest one to stdout. Progress goes to stderr.
+#
+# Configured through the environment (the Makefile `tune` target sets these):
+#
+#   CC              Compiler.                       (cc)
+#   CFLAGS          Compiler flags.                 (-O2)
+#   DEFINES         Instantiation flags, as in `make 'DEFINES=...'`.
+#   TUNE_FACTORS    Branching factors to try.       (2 4 8 16 32 64)
+#   TUNE_SEARCHES   Search strategies to try.       (BINARY LINEAR)
+#   TUNE_N          Number of elements to insert.   (1000000)
+#   TUNE_RUNS       Runs per configuration, the best one is kept. (3)
+
+set -e
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2}
+TUNE_FACTORS=${TUNE_FACTORS:-2 4 8 16 32 64}
+TUNE_SEARCHES=${TUNE_SEARCHES:-BINARY LINEAR}
+TUNE_N=${TUNE_N:-1000000}
+TUNE_RUNS=${TUNE_RUNS:-3}
+
+ROOT=$(dirname "$0")/..
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+for factor in $TUNE_FACTORS; do
+    for search in $TUNE_SEARCHES; do
+        case $search in
+            BINARY) flags= ;;
+            LINEAR) flags=-DBT_LINEAR_SEARCH ;;
+            *) echo "tune: unknown search strategy '$search'" >&2; exit 1 ;;
+        esac
+
+        # shellcheck disable=SC2086
+        $CC $CFLAGS $DEFINES -DBT_FACTOR="$factor" $flags -I"$ROOT" \
+            "$ROOT/tools/bench.c" -o "$TMP/bench" -lm
+
+        best=
+        run=0
+        while [ $run -lt "$TUNE_RUNS" ]; do
+            line=$("$TMP/bench" "$TUNE_N")
+            score=${line%% *}
+            if [ -z "$best" ] || awk "BEGIN { exit !($score < ${best%% *}) }"; then
+                best=$line
+            fi
+            run=$((run + 1))
+        done
+
+        echo "factor=$factor search=$search $best" >&2
+        echo "$best $factor $search" >> "$TMP/results"
+    done
+done
+
+winner=$(sort -n "$TMP/results" | head -n 1)
+factor=$(echo "$winner" | awk '{ print $(NF - 1) }')
+search=$(echo "$winner" | awk '{ print $NF }')
+
+echo "// Generated by \`make tune\` on $(uname -n) ($(uname -m))."
+echo "//"
+echo "// DEFINES: $DEFINES"
+echo "// CFLAGS:  $CFLAGS"
+echo "// N:       $TUNE_N"
+echo "//"
+echo "// ns/op   insert    hit       miss      iter      factor search"
+sort -n "$TMP/results" | awk '{
+    printf "// %-7s %-9s %-9s %-9s %-9s %-6s %s\n",
+        $1, substr($2, 8), substr($3, 5), substr($4, 6), substr($5, 6), $(NF - 1), $NF
+}'
+echo
+echo "#define BT_FACTOR $factor"
+if [ "$search" = LINEAR ]; then
+    echo "#define BT_LINEAR_SEARCH"
+fi